@@ -28,7 +28,192 @@
 #define FLOATIFY 1.0
 
 /**
- * @brief Speed up by only operating on upper diagonal
+ * @brief Field comparisons held as 32-bit floats (the default)
  */
-#define UPPER_ONLY false
+#define FIELD_STORAGE_FLOAT 0
+
+/**
+ * @brief Field comparisons held as bfloat16 (top half of a float)
+ */
+#define FIELD_STORAGE_BF16 1
+
+/**
+ * @brief Field comparisons held as 16-bit affine-quantized integers
+ */
+#define FIELD_STORAGE_Q16 2
+
+/**
+ * @brief Field comparisons held as 8-bit affine-quantized integers
+ */
+#define FIELD_STORAGE_Q8 3
+
+/**
+ * @brief Identifies preprocessed landscape files
+ */
+#define CACHE_MAGIC "SPCSCAPE"
+
+/**
+ * @brief Bump whenever the preprocessed landscape file layout changes
+ */
+#define CACHE_VERSION 2
+
+/**
+ * @brief Default size limit for the cache directory, in megabytes
+ */
+#define CACHE_DEFAULT_MB 2048
+
+/**
+ * @brief Fields at least this large are aggregated tile by tile
+ */
+#define TILED_MIN_SAMPLES 512
+
+/**
+ * @brief Columns per tile; the tile's index arrays and buffers should sit in L1
+ */
+#define TILE_COLUMNS 1024
+
+/**
+ * @brief Bytes of rows (both fields) a block of tile rows may touch; about half of L2
+ */
+#define TILE_ROW_BYTES (1<<20)
+
+/**
+ * @brief Elements compared per work-stealing task; fixed, so sums don't depend on thread count
+ */
+#define STEAL_TASK_ELEMENTS (1<<15)
+
+/**
+ * @brief Trials whose tasks are run together between work-stealing barriers
+ */
+#define STEAL_BLOCK_TRIALS 16
+
+/**
+ * @brief Permutation sets each pipeline consumer can have queued up
+ */
+#define PIPELINE_RING_SLOTS 8
+
+/**
+ * @brief Independent generators interleaved in a RandomState, so refills vectorize
+ */
+#define RANDOM_LANES 4
+
+/**
+ * @brief 32-bit random numbers drawn ahead per refill (a multiple of 2*RANDOM_LANES)
+ */
+#define RANDOM_BATCH 64
+
+/**
+ * @brief Straight-line distance between coordinate vectors
+ */
+#define DISTANCE_EUCLIDEAN 0
+
+/**
+ * @brief Distance over the earth's surface between (latitude, longitude) pairs in degrees
+ */
+#define DISTANCE_GREAT_CIRCLE 1
+
+/**
+ * @brief Sum of absolute coordinate differences
+ */
+#define DISTANCE_MANHATTAN 2
+
+/**
+ * @brief Bray-Curtis dissimilarity between (non-negative) feature vectors
+ */
+#define DISTANCE_BRAY_CURTIS 3
+
+/**
+ * @brief Mean earth radius, in km, for great-circle distances
+ */
+#define EARTH_RADIUS_KM 6371.0088
+
+/**
+ * @brief Fewest matrix rows worth handing to a distance-building thread
+ */
+#define DISTANCE_THREAD_ROWS 64
+
+/**
+ * @brief Distances recomputed at a time by the matrix-free kernel; small enough to stay in L1
+ */
+#define DISTANCE_SPAN 256
+
+/**
+ * @brief Most distance classes a correlogram can have (class numbers are stored as bytes)
+ */
+#define CORRELOGRAM_MAX_CLASSES 254
+
+/**
+ * @brief Largest field whose exact third moment is found (that needs O(samples^3) work)
+ */
+#define MOMENT_SKEW_MAX_SAMPLES 2000
+
+/**
+ * @brief Past this gamma shape (skewness under 0.02), Pearson type III tails use Wilson-Hilferty
+ */
+#define MOMENT_GAMMA_MAX_SHAPE 10000
+
+/**
+ * @brief Partial sums kept apart in the triangle sum, so it vectorizes
+ */
+#define MOMENT_LANES 8
+
+/**
+ * @brief Uniform relabelings used to scale the tail-sampling temperature ladder
+ */
+#define TAIL_PILOT_TRIALS 256
+
+/**
+ * @brief Batches each chain's samples are split into for the standard error
+ */
+#define TAIL_BATCHES 16
+
+/**
+ * @brief Standard deviations the tilted mean of r moves between rungs
+ */
+#define TAIL_RUNG_SPACING 1.0
+
+/**
+ * @brief Confidence level of the interval reported on each p value
+ */
+#define PRECISION_CONFIDENCE 0.95
+
+/**
+ * @brief Trials run between checks on the p value's interval
+ */
+#define PRECISION_BLOCK_TRIALS 1000
+
+/**
+ * @brief Confidence level of bootstrap intervals on r
+ */
+#define BOOTSTRAP_CONFIDENCE 0.95
+
+/**
+ * @brief No progress reports
+ */
+#define PROGRESS_NONE 0
+
+/**
+ * @brief Progress kept on one status line of stderr
+ */
+#define PROGRESS_STATUS 1
+
+/**
+ * @brief Progress as newline-delimited JSON on stderr
+ */
+#define PROGRESS_NDJSON 2
+
+/**
+ * @brief Identifies permutation bank files
+ */
+#define BANK_MAGIC "SPCPERMS"
+
+/**
+ * @brief Bump whenever the permutation bank file layout changes
+ */
+#define BANK_VERSION 1
+
+/**
+ * @brief Largest field whose bank indices are stored in 16 bits
+ */
+#define BANK_MAX_NARROW 65536
 #endif
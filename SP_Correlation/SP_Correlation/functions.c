@@ -4,12 +4,25 @@
  * @date 3/20/12
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE //pthread_setaffinity_np, for pinning workers to a NUMA node
+#endif
 
 #include <stdio.h>
 #include "functions.h"
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <time.h>
 
 #define VERBOSE false
 
@@ -36,15 +49,113 @@ Field** allocateArrayOfFields(int howmany)
     return malloc(howmany * sizeof(Field));
 }
 
+//Default stream for callers without their own; zeroed, so it seeds itself on first use
+RandomState sharedRandomState;
+
+void seedRandomState(RandomState* theState, unsigned int seed)
+{
+    assert(theState!=NULL);
+    
+    //SplitMix64 spreads the seed over every lane
+    uint64_t z = seed, x;
+    for(int l=0; l<RANDOM_LANES; l++)
+    {
+        for(int w=0; w<4; w++)
+        {
+            z += 0x9E3779B97F4A7C15ULL;
+            x = z;
+            x = (x^(x>>30))*0xBF58476D1CE4E5B9ULL;
+            x = (x^(x>>27))*0x94D049BB133111EBULL;
+            theState->lane[w][l] = x^(x>>31);
+        }
+    }
+    theState->used = RANDOM_BATCH;
+    theState->isSeeded = true;
+}
+
+void seedRandom(unsigned int seed)
+{
+    seedRandomState(&sharedRandomState, seed);
+}
+
+//Refill the batch from every lane at once; the multiplies in xoshiro256**
+//(by 5 and 9) are written as shifts and adds so the lane loop vectorizes
+void refillRandomState(RandomState* theState);
+void refillRandomState(RandomState* theState)
+{
+    if(!theState->isSeeded) seedRandomState(theState, 1);
+    
+    uint64_t* s0 = theState->lane[0];
+    uint64_t* s1 = theState->lane[1];
+    uint64_t* s2 = theState->lane[2];
+    uint64_t* s3 = theState->lane[3];
+    uint64_t out[RANDOM_LANES];
+    uint64_t x, t;
+    for(int k=0; k<RANDOM_BATCH/(2*RANDOM_LANES); k++)
+    {
+        for(int l=0; l<RANDOM_LANES; l++)
+        {
+            x = s1[l] + (s1[l]<<2);
+            x = (x<<7)|(x>>57);
+            out[l] = x + (x<<3);
+            t = s1[l]<<17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = (s3[l]<<45)|(s3[l]>>19);
+        }
+        for(int l=0; l<RANDOM_LANES; l++)
+        {
+            theState->batch[2*(k*RANDOM_LANES+l)] = (uint32_t)(out[l]>>32);
+            theState->batch[2*(k*RANDOM_LANES+l)+1] = (uint32_t)out[l];
+        }
+    }
+    theState->used = 0;
+}
+
+uint32_t nextRandom32(RandomState* theState);
+uint32_t nextRandom32(RandomState* theState)
+{
+    if(theState->used==RANDOM_BATCH) refillRandomState(theState);
+    return theState->batch[theState->used++];
+}
+
+uint32_t randBelowWithState(RandomState* theState, uint32_t range)
+{
+    assert(theState!=NULL);
+    assert(range>0);
+    
+    //Scale a 32-bit draw into [0,range); only the rare draws landing in the
+    //short leftover interval are redrawn, and only those pay for a division
+    uint64_t m = (uint64_t)nextRandom32(theState)*range;
+    uint32_t low = (uint32_t)m;
+    if(low<range)
+    {
+        uint32_t threshold = (0u-range)%range;
+        while(low<threshold)
+        {
+            m = (uint64_t)nextRandom32(theState)*range;
+            low = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m>>32);
+}
+
 int randInRange(int lo, int hi)
 {
+    return randInRangeWithState(&sharedRandomState, lo, hi);
+}
+
+int randInRangeWithState(RandomState* theState, int lo, int hi)
+{
+    assert(theState!=NULL);
     assert(lo<=hi);
     
-    int range = hi-lo+1;
-    int num = rand()%range;
-    num = num + lo;
-    return num;
+    return lo + (int)randBelowWithState(theState, (uint32_t)(hi-lo)+1);
 }
+
 bool inOrder(float l, float r)
 {
     return l >= r;
@@ -85,11 +196,12 @@ Perm* makePerm(int size, int seed)
 {
     assert(size>0);
 
-    if(seed>0) srand(seed);
+    if(seed>0) seedRandom(seed);
     
     Perm* thePerm = allocatePermutation();
     thePerm->size = size;
     thePerm->index = allocateArrayOfInts(size);
+    thePerm->isIdentity = (!seed || size==1);
     
     int j;
 
@@ -100,7 +212,7 @@ Perm* makePerm(int size, int seed)
         {
             thePerm->index[i] = i;
         } else {
-            j = randInRange(0, i);
+            j = randBelowWithState(&sharedRandomState, i+1);
             thePerm->index[i] = thePerm->index[j];
             thePerm->index[j] = i;
         } 
@@ -112,22 +224,31 @@ void modifyPermPermutify(Perm* thePerm, int seed)
 {
     assert(thePerm!=NULL);
 
-    if(seed>0) srand(seed);
-    int j;
-        
-    //Including 0 because the last swap hurts nobody,
-    //and with no seed the last step finishes setting the
-    //permutation to the identity
-    for(int i=thePerm->size-1; i>=0; i--)
+    if(!seed)
     {
-        if(!seed)
-        {
-            thePerm->index[i] = i;
-        } else {
-            j = randInRange(0, i);
-            swapI(&thePerm->index[i], &thePerm->index[j]);
-        } 
+        for(int i=0; i<thePerm->size; i++) thePerm->index[i] = i;
+        thePerm->isIdentity = true;
+        return;
+    }
+    if(seed>0) seedRandom(seed);
+    modifyPermPermutifyWithState(thePerm, &sharedRandomState);
+}
+
+void modifyPermPermutifyWithState(Perm* thePerm, RandomState* theState)
+{
+    assert(thePerm!=NULL);
+    assert(theState!=NULL);
+    
+    int* index = thePerm->index;
+    int j, temp;
+    for(int i=thePerm->size-1; i>0; i--)
+    {
+        j = (int)randBelowWithState(theState, (uint32_t)i+1);
+        temp = index[i];
+        index[i] = index[j];
+        index[j] = temp;
     }
+    thePerm->isIdentity = (thePerm->size<2);
 }
 
 #pragma mark Fields
@@ -137,6 +258,55 @@ Field* allocateField(void)
     return malloc(sizeof(Field));
 }
 
+Field* makeFieldFromField(Field* theField)
+{
+    assert(theField!=NULL);
+    assert(theField->storage==FIELD_STORAGE_FLOAT);
+    
+    int samples = theField->samples;
+    Field* theCopy = allocateField();
+    theCopy->samples = samples;
+    theCopy->fieldnum = theField->fieldnum;
+    theCopy->element = allocateArrayOfArraysOfFloats(samples);
+    theCopy->hasFlatVersion = false;
+    theCopy->flatVersion = NULL;
+    theCopy->perm = makePerm(samples, SEED_IDENTITY);
+    theCopy->storage = FIELD_STORAGE_FLOAT;
+    theCopy->packed = NULL;
+    theCopy->scale = 1.0;
+    theCopy->offset = 0.0;
+    theCopy->errorBound = 0.0;
+    theCopy->sharesElements = false;
+    theCopy->isSymmetric = theField->isSymmetric;
+    
+    for(int x=0; x<samples; x++)
+    {
+        theCopy->element[x] = allocateArrayOfFloats(samples);
+        memcpy(theCopy->element[x], theField->element[x], samples*sizeof(float));
+    }
+    return theCopy;
+}
+
+void freeField(Field* theField)
+{
+    if(theField==NULL) return;
+    
+    if(theField->element != NULL && !theField->sharesElements)
+    {
+        for(int x=0; x<theField->samples; x++) free(theField->element[x]);
+        free(theField->element);
+    }
+    if(theField->hasFlatVersion && theField->flatVersion != NULL)
+    {
+        free(theField->flatVersion->data);
+        free(theField->flatVersion);
+    }
+    if(!theField->sharesElements) free(theField->packed);
+    free(theField->perm->index);
+    free(theField->perm);
+    free(theField);
+}
+
 Field* makeRandomField(int samples)
 {
     assert(samples>0);
@@ -147,6 +317,13 @@ Field* makeRandomField(int samples)
     theField->element = allocateArrayOfArraysOfFloats(samples);
     theField->hasFlatVersion = false;
     theField->perm = makePerm(samples, SEED_IDENTITY);
+    theField->storage = FIELD_STORAGE_FLOAT;
+    theField->packed = NULL;
+    theField->scale = 1.0;
+    theField->offset = 0.0;
+    theField->errorBound = 0.0;
+    theField->sharesElements = false;
+    theField->isSymmetric = true;
 //    theField->isCentered = false;
 //    theField->isRanked = false;
 //    theField->isRankBased = false;
@@ -172,10 +349,24 @@ Field* makeRandomField(int samples)
     return theField;
 }
 
+bool hasPointsHeader(const char* filename);
+bool hasPointsHeader(const char* filename)
+{
+    FILE* theFile = fopen(filename, "r");
+    assert(theFile); //Gotta have a file to process
+    char tag[8] = "";
+    bool isPoints = (fscanf(theFile, "<%7[A-Za-z]", tag)==1 && !strcmp(tag, "Points"));
+    fclose(theFile);
+    return isPoints;
+}
+
 Field* makeFieldFromTDV(const char* filename)
 {
     assert(filename!=NULL);
 
+    //Coordinates instead of comparisons: compute the distances here
+    if(hasPointsHeader(filename)) return makeFieldFromPoints(filename);
+    
     int fieldnum, samples, scan;
     FILE *theFile = fopen(filename, "r");
     assert(theFile); //Gotta have a file to process
@@ -196,6 +387,12 @@ Field* makeFieldFromTDV(const char* filename)
     theField->element = allocateArrayOfArraysOfFloats(samples);
     theField->hasFlatVersion = false;
     theField->perm = makePerm(samples, SEED_IDENTITY);
+    theField->storage = FIELD_STORAGE_FLOAT;
+    theField->packed = NULL;
+    theField->scale = 1.0;
+    theField->offset = 0.0;
+    theField->errorBound = 0.0;
+    theField->sharesElements = false;
 //    theField->isCentered = false;
 //    theField->isRanked = false;
 //    theField->isRankBased = false;
@@ -212,9 +409,26 @@ Field* makeFieldFromTDV(const char* filename)
         }
     }
     fclose(theFile);
+    theField->isSymmetric = isFieldSymmetric(theField);
+    if(!theField->isSymmetric) printf("Note: [%s] is not symmetric; both triangles will be used.\n", filename);
     return theField;
 }
 
+bool isFieldSymmetric(Field* theField)
+{
+    assert(theField!=NULL);
+    assert(theField->storage==FIELD_STORAGE_FLOAT);
+    
+    for(int x=0; x<theField->samples; x++)
+    {
+        for(int y=x+1; y<theField->samples; y++)
+        {
+            if(theField->element[x][y] != theField->element[y][x]) return false;
+        }
+    }
+    return true;
+}
+
 void saveFieldToTDV(const char* filename, Field* theField)
 {
     assert(filename!=NULL);
@@ -229,7 +443,7 @@ void saveFieldToTDV(const char* filename, Field* theField)
         {
             iPerm = theField->perm->index[i];
             jPerm = theField->perm->index[j];
-            fprintf(theFile, "%f", theField->element[iPerm][jPerm]);
+            fprintf(theFile, "%f", fieldElement(theField, iPerm, jPerm));
             if(j<theField->samples-1) fprintf(theFile, "\t");
         }
         fprintf(theFile, "\n");
@@ -252,7 +466,7 @@ void saveFieldToHTML(const char* filename, Field* theField)
         {
             iPerm = theField->perm->index[i];
             jPerm = theField->perm->index[j];
-            fprintf(theFile, "<td>%f</td>", theField->element[iPerm][jPerm]);
+            fprintf(theFile, "<td>%f</td>", fieldElement(theField, iPerm, jPerm));
         }
         fprintf(theFile, "</tr>\n");
     }
@@ -274,7 +488,7 @@ void displayField(Field* theField)
             jPerm = theField->perm->index[y];
             if(x!=y)
             {
-                currentElement = theField->element[iPerm][jPerm];
+                currentElement = fieldElement(theField, iPerm, jPerm);
                 printf("(%d,%d)%3.2f{%2d} ", iPerm, jPerm, currentElement, index);
                 index++;
             } else {
@@ -286,6 +500,357 @@ void displayField(Field* theField)
 }
 
 
+float bf16ToFloat(uint16_t half);
+float bf16ToFloat(uint16_t half)
+{
+    uint32_t bits = ((uint32_t)half) << 16;
+    float widened;
+    memcpy(&widened, &bits, sizeof(widened));
+    return widened;
+}
+
+uint16_t floatToBF16(float value);
+uint16_t floatToBF16(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    //Round to nearest, ties to even
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+}
+
+float fieldElement(Field* theField, int x, int y)
+{
+    assert(theField!=NULL);
+    size_t at = (size_t)x*theField->samples + y;
+    switch(theField->storage)
+    {
+        case FIELD_STORAGE_BF16:
+            return bf16ToFloat(((uint16_t*)theField->packed)[at]);
+        case FIELD_STORAGE_Q16:
+            return theField->offset + theField->scale*((uint16_t*)theField->packed)[at];
+        case FIELD_STORAGE_Q8:
+            return theField->offset + theField->scale*((uint8_t*)theField->packed)[at];
+        default:
+            return theField->element[x][y];
+    }
+}
+
+void modifyFieldCompactify(Field* theField, int storage)
+{
+    assert(theField!=NULL);
+    assert(theField->storage==FIELD_STORAGE_FLOAT);
+    
+    if(storage==FIELD_STORAGE_FLOAT) return;
+    
+    int n = theField->samples;
+    size_t cells = (size_t)n*n;
+    size_t at;
+    float lo=0.0, hi=0.0;
+    float levels;
+    float current, widened, error;
+    bool first=true;
+    
+    //Quantization range only needs the comparisons we'll ever read
+    for(int x=0; x<n; x++)
+    {
+        for(int y=0; y<n; y++)
+        {
+            if(x==y) continue;
+            current = theField->element[x][y];
+            if(first || current<lo) lo=current;
+            if(first || current>hi) hi=current;
+            first=false;
+        }
+    }
+    
+    switch(storage)
+    {
+        case FIELD_STORAGE_BF16:
+            theField->packed = malloc(cells*sizeof(uint16_t));
+            theField->scale = 1.0;
+            theField->offset = 0.0;
+            break;
+        case FIELD_STORAGE_Q16:
+        case FIELD_STORAGE_Q8:
+            levels = (storage==FIELD_STORAGE_Q16) ? UINT16_MAX : UINT8_MAX;
+            theField->packed = malloc(cells*((storage==FIELD_STORAGE_Q16) ?
+                                             sizeof(uint16_t) : sizeof(uint8_t)));
+            theField->offset = lo;
+            theField->scale = (hi>lo) ? (hi-lo)/levels : 1.0;
+            break;
+        default:
+            assert(false); //Unknown storage type
+    }
+    assert(theField->packed!=NULL);
+    
+    theField->storage = storage;
+    theField->errorBound = 0.0;
+    for(int x=0; x<n; x++)
+    {
+        for(int y=0; y<n; y++)
+        {
+            //Main diagonal is never read, but keep it defined
+            current = (x==y) ? lo : theField->element[x][y];
+            at = (size_t)x*n + y;
+            switch(storage)
+            {
+                case FIELD_STORAGE_BF16:
+                    ((uint16_t*)theField->packed)[at] = floatToBF16(current);
+                    break;
+                case FIELD_STORAGE_Q16:
+                    ((uint16_t*)theField->packed)[at] = 
+                        (uint16_t)lroundf((current-theField->offset)/theField->scale);
+                    break;
+                case FIELD_STORAGE_Q8:
+                    ((uint8_t*)theField->packed)[at] = 
+                        (uint8_t)lroundf((current-theField->offset)/theField->scale);
+                    break;
+            }
+            widened = fieldElement(theField, x, y);
+            error = fabsf(widened-current);
+            if(x!=y && error>theField->errorBound) theField->errorBound = error;
+        }
+        //Full-precision row is no longer needed
+        if(!theField->sharesElements) free(theField->element[x]);
+    }
+    if(!theField->sharesElements) free(theField->element);
+    theField->element = NULL;
+    //Packed copy is ours, whoever owned the rows
+    theField->sharesElements = false;
+}
+
+#pragma mark Points
+
+int distanceMetricFromName(const char* name)
+{
+    assert(name!=NULL);
+    if(!strcmp(name, "euclidean")) return DISTANCE_EUCLIDEAN;
+    if(!strcmp(name, "greatcircle")) return DISTANCE_GREAT_CIRCLE;
+    if(!strcmp(name, "manhattan")) return DISTANCE_MANHATTAN;
+    if(!strcmp(name, "braycurtis")) return DISTANCE_BRAY_CURTIS;
+    return -1;
+}
+
+PointSet* makePointSetFromFile(const char* filename)
+{
+    assert(filename!=NULL);
+    
+    int fieldnum, samples, dimensions, scan;
+    char metricName[16];
+    FILE *theFile = fopen(filename, "r");
+    assert(theFile); //Gotta have a file to process
+    scan=fscanf(theFile, "<Points %d:Samples %d:Dimensions %d:Distance %15[a-z]>",
+                &fieldnum, &samples, &dimensions, metricName);
+    int metric = (scan==4) ? distanceMetricFromName(metricName) : -1;
+    if(scan!=4 || samples<1 || dimensions<1 || metric<0)
+    {
+        printf("ERROR: Bad points file <%s>; header should be "
+               "<Points F:Samples S:Dimensions D:Distance euclidean|greatcircle|manhattan|braycurtis>.\n",
+               filename);
+        fclose(theFile);
+        assert(false);
+    }
+    if(metric==DISTANCE_GREAT_CIRCLE && dimensions!=2)
+    {
+        printf("ERROR: Great-circle points in <%s> need 2 dimensions (latitude, longitude).\n", filename);
+        fclose(theFile);
+        assert(false);
+    }
+    printf("Reading [%s] field=%d, samples=%d, %d-D %s points\n",
+           filename, fieldnum, samples, dimensions, metricName);
+    
+    PointSet* thePoints = malloc(sizeof(PointSet));
+    thePoints->fieldnum = fieldnum;
+    thePoints->samples = samples;
+    thePoints->metric = metric;
+    //Latitude/longitude become unit vectors, so distances come from chord lengths
+    thePoints->dimensions = (metric==DISTANCE_GREAT_CIRCLE) ? 3 : dimensions;
+    thePoints->coords = allocateArrayOfFloats(thePoints->dimensions*samples);
+    thePoints->totals = NULL;
+    if(metric==DISTANCE_BRAY_CURTIS) thePoints->totals = allocateArrayOfFloats(samples);
+    
+    double values[dimensions];
+    for(int i=0; i<samples; i++)
+    {
+        for(int d=0; d<dimensions; d++)
+        {
+            if(fscanf(theFile, "%lf", &values[d])!=1)
+            {
+                printf("ERROR: <%s> ends before sample %d is complete.\n", filename, i);
+                fclose(theFile);
+                assert(false);
+            }
+        }
+        if(metric==DISTANCE_GREAT_CIRCLE)
+        {
+            double latitude = values[0]*M_PI/180, longitude = values[1]*M_PI/180;
+            thePoints->coords[i] = cos(latitude)*cos(longitude);
+            thePoints->coords[samples+i] = cos(latitude)*sin(longitude);
+            thePoints->coords[2*samples+i] = sin(latitude);
+        } else {
+            for(int d=0; d<dimensions; d++) thePoints->coords[d*samples+i] = values[d];
+        }
+        if(metric==DISTANCE_BRAY_CURTIS)
+        {
+            thePoints->totals[i] = 0;
+            for(int d=0; d<dimensions; d++) thePoints->totals[i] += values[d];
+        }
+    }
+    fclose(theFile);
+    return thePoints;
+}
+
+void freePointSet(PointSet* thePoints)
+{
+    if(thePoints==NULL) return;
+    free(thePoints->coords);
+    free(thePoints->totals);
+    free(thePoints);
+}
+
+//Dimension by dimension over the whole span, so every inner loop is a
+//contiguous, branch-free pass the compiler can vectorize. Each term is
+//symmetric in i and j and added in the same order, so the matrix comes out
+//exactly symmetric.
+void fillDistanceSpan(PointSet* thePoints, int i, int first, int last, float* span)
+{
+    assert(thePoints!=NULL);
+    assert(span!=NULL);
+    assert(i>=0 && i<thePoints->samples);
+    assert(first>=0 && first<=last && last<=thePoints->samples);
+    
+    int n = thePoints->samples;
+    int width = last-first;
+    float* column;
+    float mine, difference;
+    for(int j=0; j<width; j++) span[j] = 0;
+    
+    for(int d=0; d<thePoints->dimensions; d++)
+    {
+        column = thePoints->coords+(size_t)d*n;
+        mine = column[i];
+        column += first;
+        if(thePoints->metric==DISTANCE_EUCLIDEAN || thePoints->metric==DISTANCE_GREAT_CIRCLE)
+        {
+            for(int j=0; j<width; j++)
+            {
+                difference = column[j]-mine;
+                span[j] += difference*difference;
+            }
+        } else {
+            for(int j=0; j<width; j++) span[j] += fabsf(column[j]-mine);
+        }
+    }
+    
+    switch(thePoints->metric)
+    {
+        case DISTANCE_EUCLIDEAN:
+            for(int j=0; j<width; j++) span[j] = sqrtf(span[j]);
+            break;
+        case DISTANCE_GREAT_CIRCLE:
+            //Chord c between unit vectors spans an angle of 2*asin(c/2)
+            for(int j=0; j<width; j++)
+                span[j] = 2*EARTH_RADIUS_KM*asinf(fminf(1.0f, 0.5f*sqrtf(span[j])));
+            break;
+        case DISTANCE_BRAY_CURTIS:
+        {
+            float* totals = thePoints->totals+first;
+            for(int j=0; j<width; j++)
+            {
+                float total = thePoints->totals[i]+totals[j];
+                span[j] = (total>0) ? span[j]/total : 0;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    //Caveat: main diagonal is exactly zero
+    if(i>=first && i<last) span[i-first] = 0;
+}
+
+void fillDistanceRow(PointSet* thePoints, int i, float* row)
+{
+    assert(thePoints!=NULL);
+    fillDistanceSpan(thePoints, i, 0, thePoints->samples, row);
+}
+
+/**
+ * @brief One thread's share of a distance matrix
+ */
+typedef struct {
+    PointSet* points;
+    Field* theField;
+    int first;  /**< First row to fill */
+    int step;   /**< Rows between ours */
+} DistanceWorker;
+
+void* runDistanceWorker(void* theWorker);
+void* runDistanceWorker(void* theWorker)
+{
+    DistanceWorker* me = theWorker;
+    int n = me->points->samples;
+    for(int i=me->first; i<n; i+=me->step)
+    {
+        //Allocated by the thread that fills it, so it lands in that thread's memory
+        me->theField->element[i] = allocateArrayOfFloats(n);
+        fillDistanceRow(me->points, i, me->theField->element[i]);
+    }
+    return NULL;
+}
+
+Field* makeFieldFromPointSet(PointSet* thePoints)
+{
+    assert(thePoints!=NULL);
+    
+    int samples = thePoints->samples;
+    Field* theField = allocateField();
+    theField->samples = samples;
+    theField->fieldnum = thePoints->fieldnum;
+    theField->element = allocateArrayOfArraysOfFloats(samples);
+    theField->hasFlatVersion = false;
+    theField->flatVersion = NULL;
+    theField->perm = makePerm(samples, SEED_IDENTITY);
+    theField->storage = FIELD_STORAGE_FLOAT;
+    theField->packed = NULL;
+    theField->scale = 1.0;
+    theField->offset = 0.0;
+    theField->errorBound = 0.0;
+    theField->sharesElements = false;
+    
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = samples/DISTANCE_THREAD_ROWS;
+    if(threads>online) threads = (int)online;
+    if(threads<1) threads = 1;
+    
+    //Interleaved rows, so each thread gets long and short rows alike
+    DistanceWorker workers[threads];
+    pthread_t ids[threads];
+    for(int t=0; t<threads; t++)
+    {
+        workers[t].points = thePoints;
+        workers[t].theField = theField;
+        workers[t].first = t;
+        workers[t].step = threads;
+        if(t) pthread_create(&ids[t], NULL, runDistanceWorker, &workers[t]);
+    }
+    runDistanceWorker(&workers[0]);
+    for(int t=1; t<threads; t++) pthread_join(ids[t], NULL);
+    
+    theField->isSymmetric = isFieldSymmetric(theField);
+    return theField;
+}
+
+Field* makeFieldFromPoints(const char* filename)
+{
+    PointSet* thePoints = makePointSetFromFile(filename);
+    Field* theField = makeFieldFromPointSet(thePoints);
+    freePointSet(thePoints);
+    return theField;
+}
+
+
 #pragma mark Landscapes
 
 Landscape* allocateLandscape(void)
@@ -298,6 +863,19 @@ Landscape* makeLandscapeFromTDVs(int files, const char* filenames[])
     assert(files>0);
     assert(filenames!=NULL);
     
+    Field* fields[files];
+    for(int i=0; i<files; i++)
+    {
+        fields[i] = makeFieldFromTDV(filenames[i]);
+    }
+    return makeLandscapeFromFields(files, fields);
+}
+
+Landscape* makeLandscapeFromFields(int files, Field* fields[])
+{
+    assert(files>0);
+    assert(fields!=NULL);
+    
     Landscape* theScape = NULL;
     theScape = allocateLandscape();
     theScape->numFields = files;
@@ -307,32 +885,106 @@ Landscape* makeLandscapeFromTDVs(int files, const char* filenames[])
     
     for(int i=0; i<files; i++)
     {
-        theScape->fields[i] = makeFieldFromTDV(filenames[i]);
+        theScape->fields[i] = fields[i];
         n=theScape->fields[i]->samples;
         theScape->numNonDiagElts  += n*n-n;
     }
+    theScape->isSymmetric = true;
+    for(int i=0; i<files; i++)
+    {
+        if(!theScape->fields[i]->isSymmetric) theScape->isSymmetric = false;
+    }
     theScape->isRaw = true;
     theScape->isRanked=false;
     theScape->isRankBased=false;
     theScape->isCentered=false;
     theScape->hasFlatVersion=false;
     theScape->flatVersion=NULL;
+    theScape->storage=FIELD_STORAGE_FLOAT;
+    theScape->storageErrorBound=0.0;
+    theScape->mapping=NULL;
+    theScape->mappingSize=0;
     
     return theScape;
 }
 
-bool isInLowerDiagonal(int i, int j);
-bool isInLowerDiagonal(int i, int j){ return i<j; }
+Landscape* makeLandscapeFromLandscape(Landscape* theData)
+{
+    assert(theData!=NULL);
+    
+    Landscape* theCopy = allocateLandscape();
+    *theCopy = *theData;
+    theCopy->fields = allocateArrayOfFields(theData->numFields);
+    for(int f=0; f<theData->numFields; f++)
+    {
+        theCopy->fields[f] = makeFieldFromField(theData->fields[f]);
+    }
+    //Flat version would be shared, so let the copy build its own
+    theCopy->hasFlatVersion = false;
+    theCopy->flatVersion = NULL;
+    //Copied fields own their elements
+    theCopy->mapping = NULL;
+    theCopy->mappingSize = 0;
+    return theCopy;
+}
+
+Landscape* makeLandscapeViewOfLandscape(Landscape* theData)
+{
+    assert(theData!=NULL);
+    
+    Landscape* theView = allocateLandscape();
+    *theView = *theData;
+    theView->fields = allocateArrayOfFields(theData->numFields);
+    Field* theField;
+    for(int f=0; f<theData->numFields; f++)
+    {
+        theField = allocateField();
+        *theField = *theData->fields[f];
+        theField->sharesElements = true;
+        theField->hasFlatVersion = false;
+        theField->flatVersion = NULL;
+        theField->perm = makePerm(theField->samples, SEED_IDENTITY);
+        theView->fields[f] = theField;
+    }
+    //Flat version and mapping belong to theData
+    theView->hasFlatVersion = false;
+    theView->flatVersion = NULL;
+    theView->mapping = NULL;
+    theView->mappingSize = 0;
+    return theView;
+}
+
+void freeLandscape(Landscape* theData)
+{
+    if(theData==NULL) return;
+    
+    for(int f=0; f<theData->numFields; f++)
+    {
+        //Rows live in the mapping, but the row index is ours
+        if(theData->mapping != NULL) free(theData->fields[f]->element);
+        freeField(theData->fields[f]);
+    }
+    if(theData->mapping != NULL) munmap(theData->mapping, theData->mappingSize);
+    if(theData->flatVersion != NULL)
+    {
+        free(theData->flatVersion->data);
+        free(theData->flatVersion);
+    }
+    free(theData->fields);
+    free(theData);
+}
 
 void modifyLandscapeMeanify(Landscape* theData)
 {
     assert(theData!=NULL);
     
-    float theTotal = 0.0;
-    int theCount=0;
+    //Float totals drift badly over millions of elements
+    double theTotal = 0.0;
+    long long theCount=0;
     
     //Has this already been done?
     if(theData->isCentered) return;
+    assert(theData->storage==FIELD_STORAGE_FLOAT);
     
     //Processed data isn't raw
     theData->isRaw=false;
@@ -358,25 +1010,24 @@ void modifyLandscapeMeanify(Landscape* theData)
     }
     
     int currentSampleSize;
+    float** element;
     
     //Step one: Find mean
     for(int f=0; f<theData->numFields; f++)
     {
         currentSampleSize = theData->fields[f]->samples;
+        element = theData->fields[f]->element;
         
         for(int x=0; x<currentSampleSize; x++)
         {
-            for(int y=0; y<currentSampleSize; y++)
+            //2x efficiency: Symmetric data only needs the upper triangle
+            for(int y=(theData->isSymmetric ? x+1 : 0); y<currentSampleSize; y++)
             {
                 //Caveat: Skip main diagonal
                 if(x!=y) 
                 {
-                    //2x efficiency: Only need upper triangle
-                    if(!(UPPER_ONLY && isInLowerDiagonal(x,y)))
-                    {
-                        theTotal += theData->fields[f]->element[x][y];
-                        theCount++;
-                    }
+                    theTotal += element[x][y];
+                    theCount++;
                 }
             }
         }
@@ -387,17 +1038,15 @@ void modifyLandscapeMeanify(Landscape* theData)
     for(int f=0; f<theData->numFields; f++)
     {
         currentSampleSize = theData->fields[f]->samples;
+        element = theData->fields[f]->element;
         
         for(int x=0; x<currentSampleSize; x++)
         {
-            for(int y=0; y<currentSampleSize; y++)
+            //Caveat: Skip main diagonal, and visit each pair once
+            for(int y=0; y<x; y++)
             {
-                //Caveat: Skip main diagonal and one redundant triangle
-                if(x!=y && x>y) 
-                {
-                    theData->fields[f]->element[x][y] -= theMean;
-                    theData->fields[f]->element[y][x] -= theMean;
-                }
+                element[x][y] -= theMean;
+                element[y][x] -= theMean;
             }
         }
     }
@@ -412,6 +1061,7 @@ void  modifyLandscapeRankify(Landscape* theData)
     
     //Make sure this isn't redundant effort
     if(theData->isRanked) return;
+    assert(theData->storage==FIELD_STORAGE_FLOAT);
     
     //Processed data isn't raw
     theData->isRaw=false;
@@ -429,22 +1079,33 @@ void  modifyLandscapeRankify(Landscape* theData)
     rankAndCount* rankInfo = NULL;
     
     int currentSampleSize;
+    float** element;
     
     for(int f=0; f<theData->numFields; f++)
     {
         currentSampleSize = theData->fields[f]->samples;
+        element = theData->fields[f]->element;
         
         for(int x=0; x<currentSampleSize; x++)
         {
-            for(int y=0; y<currentSampleSize; y++)
+            if(theData->isSymmetric)
             {
-                //Caveat: Skip main diagonal and one (redundant) triangle
-                if(x!=y && x>y) 
+                //Caveat: Skip main diagonal and one (redundant) triangle.
+                //The list holds one triangle, so each value sits at half its
+                //position in the full list; 2*rank+0.5 is its full-list rank.
+                for(int y=x+1; y<currentSampleSize; y++)
                 {
-                    rankInfo = computeRankInList(theData->fields[f]->element[x][y],
-                                                 sorted, rankInfo);
-                    theData->fields[f]->element[x][y] = rankInfo->rank;
-                    theData->fields[f]->element[y][x] = rankInfo->rank;
+                    rankInfo = computeRankInList(element[x][y], sorted, rankInfo);
+                    element[x][y] = 2*rankInfo->rank+0.5;
+                    element[y][x] = element[x][y];
+                }
+            } else {
+                for(int y=0; y<currentSampleSize; y++)
+                {
+                    //Caveat: Skip main diagonal
+                    if(x==y) continue;
+                    rankInfo = computeRankInList(element[x][y], sorted, rankInfo);
+                    element[x][y] = rankInfo->rank;
                 }
             }
         }
@@ -461,12 +1122,346 @@ void  modifyLandscapeRankify(Landscape* theData)
 }
 
 
-#pragma mark Correlation
-CorrelationAggregate* allocateCA(void)
+void modifyLandscapeCompactify(Landscape* theData, int storage)
 {
-    return malloc(sizeof(CorrelationAggregate));
-}
-
+    assert(theData!=NULL);
+    assert(theData->storage==FIELD_STORAGE_FLOAT);
+    //Quantize after centering, or the stored offsets would go stale
+    assert(theData->isCentered);
+    
+    if(storage==FIELD_STORAGE_FLOAT) return;
+    
+    //Flat version refers to full-precision data
+    theData->hasFlatVersion=false;
+    if(theData->flatVersion != NULL)
+    {
+        free(theData->flatVersion);
+        theData->flatVersion=NULL;
+    }
+    
+    theData->storageErrorBound = 0.0;
+    for(int f=0; f<theData->numFields; f++)
+    {
+        modifyFieldCompactify(theData->fields[f], storage);
+        if(theData->fields[f]->errorBound > theData->storageErrorBound)
+            theData->storageErrorBound = theData->fields[f]->errorBound;
+    }
+    theData->storage = storage;
+}
+
+
+#pragma mark Landscape cache
+uint64_t hashFileContents(const char* filename, uint64_t hash)
+{
+    assert(filename!=NULL);
+    
+    FILE* theFile = fopen(filename, "rb");
+    assert(theFile); //Gotta have a file to process
+    
+    unsigned char buffer[65536];
+    size_t got;
+    uint64_t length = 0;
+    while((got = fread(buffer, 1, sizeof(buffer), theFile)) > 0)
+    {
+        for(size_t i=0; i<got; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ULL; //FNV prime
+        }
+        length += got;
+    }
+    fclose(theFile);
+    
+    //Mark the end of the file, so moving bytes between files changes the hash
+    for(int i=0; i<8; i++)
+    {
+        hash ^= (length >> (8*i)) & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t cacheDataOffset(uint32_t numFields);
+size_t cacheDataOffset(uint32_t numFields)
+{
+    //Header and field sizes, rounded up so element rows start cache-aligned
+    size_t offset = sizeof(CacheFileHeader) + 2*numFields*sizeof(int32_t);
+    return (offset+63) & ~(size_t)63;
+}
+
+bool saveLandscapeToCacheFile(const char* filename, Landscape* theData, uint64_t sourceHash)
+{
+    assert(filename!=NULL);
+    assert(theData!=NULL);
+    assert(theData->isCentered);
+    assert(theData->storage==FIELD_STORAGE_FLOAT);
+    
+    FILE* theFile = fopen(filename, "wb");
+    if(theFile==NULL) return false;
+    
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.numFields = theData->numFields;
+    header.sourceHash = sourceHash;
+    header.isRankBased = theData->isRankBased;
+    header.isSymmetric = theData->isSymmetric;
+    
+    bool good = (fwrite(&header, sizeof(header), 1, theFile) == 1);
+    int32_t sizes[2];
+    for(int f=0; f<theData->numFields && good; f++)
+    {
+        sizes[0] = theData->fields[f]->fieldnum;
+        sizes[1] = theData->fields[f]->samples;
+        good = (fwrite(sizes, sizeof(int32_t), 2, theFile) == 2);
+    }
+    
+    char padding[64];
+    memset(padding, 0, sizeof(padding));
+    size_t written = sizeof(header) + 2*theData->numFields*sizeof(int32_t);
+    size_t needed = cacheDataOffset(theData->numFields) - written;
+    if(good && needed) good = (fwrite(padding, 1, needed, theFile) == needed);
+    
+    Field* theField;
+    for(int f=0; f<theData->numFields && good; f++)
+    {
+        theField = theData->fields[f];
+        for(int x=0; x<theField->samples && good; x++)
+        {
+            good = (fwrite(theField->element[x], sizeof(float), theField->samples, theFile)
+                    == (size_t)theField->samples);
+        }
+    }
+    if(fclose(theFile)!=0) good = false;
+    return good;
+}
+
+Landscape* makeLandscapeFromCacheFile(const char* filename, uint64_t sourceHash)
+{
+    assert(filename!=NULL);
+    
+    int fd = open(filename, O_RDONLY);
+    if(fd<0) return NULL;
+    struct stat info;
+    if(fstat(fd, &info)!=0 || (size_t)info.st_size < sizeof(CacheFileHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    
+    //Private mapping: pages load on demand, and nothing can write back to the cache
+    size_t mappingSize = info.st_size;
+    void* mapping = mmap(NULL, mappingSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping==MAP_FAILED) return NULL;
+    
+    CacheFileHeader* header = mapping;
+    bool good = !memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) &&
+                header->version == CACHE_VERSION &&
+                header->sourceHash == sourceHash &&
+                header->numFields > 0 &&
+                cacheDataOffset(header->numFields) <= mappingSize;
+    
+    //File must hold exactly the elements its header promises
+    int32_t* sizes = (int32_t*)(header+1);
+    size_t expected = good ? cacheDataOffset(header->numFields) : 0;
+    for(uint32_t f=0; good && f<header->numFields; f++)
+    {
+        if(sizes[2*f+1] <= 0) good = false;
+        else expected += (size_t)sizes[2*f+1]*sizes[2*f+1]*sizeof(float);
+    }
+    if(!good || expected != mappingSize)
+    {
+        printf("Note: ignoring stale or damaged cache file <%s>.\n", filename);
+        munmap(mapping, mappingSize);
+        return NULL;
+    }
+    
+    int numFields = header->numFields;
+    Field* fields[numFields];
+    float* nextRow = (float*)((char*)mapping + cacheDataOffset(numFields));
+    int samples;
+    for(int f=0; f<numFields; f++)
+    {
+        samples = sizes[2*f+1];
+        fields[f] = allocateField();
+        fields[f]->fieldnum = sizes[2*f];
+        fields[f]->samples = samples;
+        fields[f]->element = allocateArrayOfArraysOfFloats(samples);
+        fields[f]->hasFlatVersion = false;
+        fields[f]->flatVersion = NULL;
+        fields[f]->perm = makePerm(samples, SEED_IDENTITY);
+        fields[f]->storage = FIELD_STORAGE_FLOAT;
+        fields[f]->packed = NULL;
+        fields[f]->scale = 1.0;
+        fields[f]->offset = 0.0;
+        fields[f]->errorBound = 0.0;
+        //Rows belong to the mapping
+        fields[f]->sharesElements = true;
+        for(int x=0; x<samples; x++)
+        {
+            fields[f]->element[x] = nextRow;
+            nextRow += samples;
+        }
+        //Only a mixed landscape needs its fields checked one by one
+        fields[f]->isSymmetric = header->isSymmetric ? true : isFieldSymmetric(fields[f]);
+    }
+    
+    Landscape* theScape = makeLandscapeFromFields(numFields, fields);
+    theScape->isRaw = false;
+    theScape->isRanked = false;
+    theScape->isRankBased = header->isRankBased;
+    theScape->isCentered = true;
+    theScape->mapping = mapping;
+    theScape->mappingSize = mappingSize;
+    return theScape;
+}
+
+Landscape* makeLandscapeFromCacheWithHash(const char* cacheDir, long long cacheLimit,
+                                          int files, const char* filenames[], 
+                                          bool isRanked, uint64_t inputHash);
+Landscape* makeLandscapeFromCacheWithHash(const char* cacheDir, long long cacheLimit,
+                                          int files, const char* filenames[], 
+                                          bool isRanked, uint64_t inputHash)
+{
+    const char* transform = isRanked ? "spearman" : "pearson";
+    uint64_t key = inputHash;
+    for(const char* c=transform; *c; c++)
+    {
+        key ^= (unsigned char)*c;
+        key *= 1099511628211ULL;
+    }
+    
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%016llx.%s.scape", cacheDir, 
+             (unsigned long long)key, transform);
+    
+    Landscape* theScape = makeLandscapeFromCacheFile(path, key);
+    if(theScape!=NULL)
+    {
+        //Mark as recently used, for eviction
+        utime(path, NULL);
+        printf("Reading [%s] from cache <%s>\n", filenames[0], path);
+        return theScape;
+    }
+    
+    if(isRanked)
+    {
+        //Ranks come from the centered raw data, which may itself be cached
+        Landscape* theRaw = makeLandscapeFromCacheWithHash(cacheDir, cacheLimit, files, 
+                                                           filenames, false, inputHash);
+        theScape = makeLandscapeFromLandscape(theRaw);
+        freeLandscape(theRaw);
+        modifyLandscapeRankify(theScape);
+    } else {
+        theScape = makeLandscapeFromTDVs(files, filenames);
+    }
+    modifyLandscapeMeanify(theScape);
+    
+    //Write somewhere private, then move into place all at once
+    char temporary[PATH_MAX+16];
+    snprintf(temporary, sizeof(temporary), "%s.tmpXXXXXX", path);
+    int fd = mkstemp(temporary);
+    if(fd>=0)
+    {
+        close(fd);
+        if(saveLandscapeToCacheFile(temporary, theScape, key) && !rename(temporary, path))
+        {
+            modifyCacheEvict(cacheDir, cacheLimit);
+        } else {
+            unlink(temporary);
+            printf("Note: couldn't write cache file <%s>.\n", path);
+        }
+    } else {
+        printf("Note: couldn't write to cache directory <%s>.\n", cacheDir);
+    }
+    return theScape;
+}
+
+Landscape* makeLandscapeFromCache(const char* cacheDir, long long cacheLimit,
+                                  int files, const char* filenames[], bool isRanked)
+{
+    assert(cacheDir!=NULL);
+    assert(filenames!=NULL);
+    assert(files>0);
+    
+    //Key on contents, so edited inputs never match an old entry
+    uint64_t inputHash = 14695981039346656037ULL; //FNV offset basis
+    for(int i=0; i<files; i++) inputHash = hashFileContents(filenames[i], inputHash);
+    
+    return makeLandscapeFromCacheWithHash(cacheDir, cacheLimit, files, filenames, 
+                                          isRanked, inputHash);
+}
+
+void modifyCacheEvict(const char* cacheDir, long long cacheLimit)
+{
+    assert(cacheDir!=NULL);
+    
+    DIR* theDir = opendir(cacheDir);
+    if(theDir==NULL) return;
+    
+    int count = 0, capacity = 0;
+    char** paths = NULL;
+    long long* sizes = NULL;
+    time_t* used = NULL;
+    long long total = 0;
+    
+    struct dirent* entry;
+    struct stat info;
+    char path[PATH_MAX];
+    size_t length;
+    while((entry = readdir(theDir)) != NULL)
+    {
+        length = strlen(entry->d_name);
+        if(length<6 || strcmp(entry->d_name+length-6, ".scape")) continue;
+        snprintf(path, sizeof(path), "%s/%s", cacheDir, entry->d_name);
+        if(stat(path, &info)!=0) continue;
+        
+        if(count == capacity)
+        {
+            capacity = capacity ? 2*capacity : 16;
+            paths = realloc(paths, capacity*sizeof(char*));
+            sizes = realloc(sizes, capacity*sizeof(long long));
+            used = realloc(used, capacity*sizeof(time_t));
+        }
+        paths[count] = strdup(path);
+        sizes[count] = info.st_size;
+        used[count] = info.st_mtime;
+        total += info.st_size;
+        count++;
+    }
+    closedir(theDir);
+    
+    //Least recently used goes first
+    int oldest;
+    while(total > cacheLimit)
+    {
+        oldest = -1;
+        for(int i=0; i<count; i++)
+        {
+            if(paths[i]!=NULL && (oldest<0 || used[i]<used[oldest])) oldest = i;
+        }
+        if(oldest<0) break;
+        unlink(paths[oldest]);
+        total -= sizes[oldest];
+        free(paths[oldest]);
+        paths[oldest] = NULL;
+    }
+    
+    for(int i=0; i<count; i++) free(paths[i]);
+    free(paths);
+    free(sizes);
+    free(used);
+}
+
+
+#pragma mark Correlation
+CorrelationAggregate* allocateCA(void)
+{
+    return malloc(sizeof(CorrelationAggregate));
+}
+
 void initializeCA(CorrelationAggregate* theCA)
 {
     assert(theCA!=NULL);
@@ -494,6 +1489,351 @@ float finishCorrelation(CorrelationAggregate* theCA)
     return (FLOATIFY*n)/(sqrt(l*r));
 }
 
+//Kernels with the sample count fixed at compile time. The trip counts are
+//constants, so the compiler unrolls the loops, and both permutations are
+//copied into local arrays up front instead of chasing perm->index per element.
+//Each row is gathered into a pair of small buffers, then accumulated column-wise
+//so the multiply-adds vectorize without reordering any single sum.
+//Symmetric pairs start each row just past the diagonal and count the sums twice.
+//An identity-permuted side (the preserved landscape) is copied row by row, not gathered.
+#define DEFINE_FIXED_SIZE_KERNEL(N) \
+void augmentCAByFieldsOfSize##N(CorrelationAggregate* theCA, Field* X, Field* Y); \
+void augmentCAByFieldsOfSize##N(CorrelationAggregate* theCA, Field* X, Field* Y) \
+{ \
+    int xPerm[N], yPerm[N]; \
+    float xRow[N], yRow[N]; \
+    float numerator[N], denominatorL[N], denominatorR[N]; \
+    float *xSource, *ySource; \
+    bool triangle = X->isSymmetric && Y->isSymmetric; \
+    bool xLinear = X->perm->isIdentity, yLinear = Y->perm->isIdentity; \
+    int start; \
+    for(int j=0; j<N; j++) \
+    { \
+        xPerm[j] = X->perm->index[j]; \
+        yPerm[j] = Y->perm->index[j]; \
+        numerator[j] = denominatorL[j] = denominatorR[j] = 0; \
+    } \
+    for(int i=0; i<N; i++) \
+    { \
+        start = triangle ? i+1 : 0; \
+        xSource = X->element[xPerm[i]]; \
+        ySource = Y->element[yPerm[i]]; \
+        if(xLinear) for(int j=start; j<N; j++) xRow[j] = xSource[j]; \
+        else for(int j=start; j<N; j++) xRow[j] = xSource[xPerm[j]]; \
+        if(yLinear) for(int j=start; j<N; j++) yRow[j] = ySource[j]; \
+        else for(int j=start; j<N; j++) yRow[j] = ySource[yPerm[j]]; \
+        /*Caveat: Skip main diagonal*/ \
+        xRow[i] = 0; \
+        yRow[i] = 0; \
+        for(int j=start; j<N; j++) \
+        { \
+            numerator[j] += xRow[j]*yRow[j]; \
+            denominatorL[j] += xRow[j]*xRow[j]; \
+            denominatorR[j] += yRow[j]*yRow[j]; \
+        } \
+    } \
+    float weight = triangle ? 2 : 1; \
+    for(int j=0; j<N; j++) \
+    { \
+        theCA->numerator += weight*numerator[j]; \
+        theCA->denominatorL += weight*denominatorL[j]; \
+        theCA->denominatorR += weight*denominatorR[j]; \
+    } \
+}
+
+DEFINE_FIXED_SIZE_KERNEL(4)
+DEFINE_FIXED_SIZE_KERNEL(5)
+DEFINE_FIXED_SIZE_KERNEL(6)
+DEFINE_FIXED_SIZE_KERNEL(8)
+DEFINE_FIXED_SIZE_KERNEL(10)
+DEFINE_FIXED_SIZE_KERNEL(12)
+DEFINE_FIXED_SIZE_KERNEL(16)
+DEFINE_FIXED_SIZE_KERNEL(20)
+DEFINE_FIXED_SIZE_KERNEL(24)
+DEFINE_FIXED_SIZE_KERNEL(32)
+DEFINE_FIXED_SIZE_KERNEL(48)
+DEFINE_FIXED_SIZE_KERNEL(64)
+
+bool augmentCAByFixedSizeFields(CorrelationAggregate* theCA, Field* X, Field* Y)
+{
+    assert(theCA!=NULL);
+    assert(X!=NULL);
+    assert(Y!=NULL);
+    assert(X->samples == Y->samples);
+    
+    //Fixed kernels read full float rows
+    if(X->storage!=FIELD_STORAGE_FLOAT || Y->storage!=FIELD_STORAGE_FLOAT) return false;
+    
+    switch(X->samples)
+    {
+        case 4:  augmentCAByFieldsOfSize4(theCA, X, Y);  return true;
+        case 5:  augmentCAByFieldsOfSize5(theCA, X, Y);  return true;
+        case 6:  augmentCAByFieldsOfSize6(theCA, X, Y);  return true;
+        case 8:  augmentCAByFieldsOfSize8(theCA, X, Y);  return true;
+        case 10: augmentCAByFieldsOfSize10(theCA, X, Y); return true;
+        case 12: augmentCAByFieldsOfSize12(theCA, X, Y); return true;
+        case 16: augmentCAByFieldsOfSize16(theCA, X, Y); return true;
+        case 20: augmentCAByFieldsOfSize20(theCA, X, Y); return true;
+        case 24: augmentCAByFieldsOfSize24(theCA, X, Y); return true;
+        case 32: augmentCAByFieldsOfSize32(theCA, X, Y); return true;
+        case 48: augmentCAByFieldsOfSize48(theCA, X, Y); return true;
+        case 64: augmentCAByFieldsOfSize64(theCA, X, Y); return true;
+        default: return false;
+    }
+}
+
+//Large fields: the permuted side's column gather runs over the whole row and
+//misses cache for nearly every element. Columns are split into tiles of
+//TILE_COLUMNS; within a tile they are reordered by Y's permuted index, so the
+//gather from each Y row moves forward through memory, and X (usually the
+//identity-permuted preserved side) stays inside a window of the tile's width.
+//Rows are taken in blocks small enough that both fields' touched lines stay in
+//L2 while every tile of the block is processed. Symmetric pairs only visit
+//columns past each row's diagonal: tiles wholly left of it are skipped, and
+//the tile it falls in is walked in plain column order from the diagonal on.
+void augmentCAByTiledFields(CorrelationAggregate* theCA, Field* X, Field* Y)
+{
+    assert(theCA!=NULL);
+    assert(X!=NULL);
+    assert(Y!=NULL);
+    assert(X->samples == Y->samples);
+    assert(X->storage==FIELD_STORAGE_FLOAT && Y->storage==FIELD_STORAGE_FLOAT);
+    
+    int n = X->samples;
+    int* xPerm = X->perm->index;
+    int* yPerm = Y->perm->index;
+    bool triangle = X->isSymmetric && Y->isSymmetric;
+    int numTiles = (n+TILE_COLUMNS-1)/TILE_COLUMNS;
+    int blockRows = TILE_ROW_BYTES/(2*sizeof(float)*n);
+    if(blockRows<1) blockRows = 1;
+    
+    //Tile t holds columns [t*TILE_COLUMNS, ...) at the same offsets in
+    //xColumn/yColumn, in order of increasing Y column
+    int* yInverse = allocateArrayOfInts(n);
+    int* xColumn = allocateArrayOfInts(n);
+    int* yColumn = allocateArrayOfInts(n);
+    int* localDiagonal = allocateArrayOfInts(n);
+    int* filled = allocateArrayOfInts(numTiles);
+    float* xBuffer = allocateArrayOfFloats(TILE_COLUMNS);
+    float* yBuffer = allocateArrayOfFloats(TILE_COLUMNS);
+    float* numerator = allocateArrayOfFloats(TILE_COLUMNS);
+    float* denominatorL = allocateArrayOfFloats(TILE_COLUMNS);
+    float* denominatorR = allocateArrayOfFloats(TILE_COLUMNS);
+    
+    for(int j=0; j<n; j++) yInverse[yPerm[j]] = j;
+    for(int t=0; t<numTiles; t++) filled[t] = 0;
+    for(int c=0; c<n; c++)
+    {
+        int j = yInverse[c];
+        int t = j/TILE_COLUMNS;
+        int local = filled[t]++;
+        xColumn[t*TILE_COLUMNS+local] = xPerm[j];
+        yColumn[t*TILE_COLUMNS+local] = c;
+        localDiagonal[j] = local;
+    }
+    for(int k=0; k<TILE_COLUMNS; k++)
+        numerator[k] = denominatorL[k] = denominatorR[k] = 0;
+    
+    for(int i0=0; i0<n; i0+=blockRows)
+    {
+        int i1 = (i0+blockRows<n) ? i0+blockRows : n;
+        for(int t=0; t<numTiles; t++)
+        {
+            int j0 = t*TILE_COLUMNS;
+            int width = filled[t];
+            int* xTile = xColumn+j0;
+            int* yTile = yColumn+j0;
+            //Rows past the tile's last column have nothing left of it to add
+            int iEnd = (triangle && i1>j0+width-1) ? j0+width-1 : i1;
+            for(int i=i0; i<iEnd; i++)
+            {
+                float* xSource = X->element[xPerm[i]];
+                float* ySource = Y->element[yPerm[i]];
+                if(triangle && i>=j0)
+                {
+                    //Symmetric, and the diagonal is in this tile: columns past it only
+                    if(X->perm->isIdentity) memcpy(xBuffer+i+1-j0, xSource+i+1, (j0+width-i-1)*sizeof(float));
+                    else for(int k=i+1-j0; k<width; k++) xBuffer[k] = xSource[xPerm[j0+k]];
+                    for(int k=i+1-j0; k<width; k++) yBuffer[k] = ySource[yPerm[j0+k]];
+                    for(int k=i+1-j0; k<width; k++)
+                    {
+                        numerator[k] += xBuffer[k]*yBuffer[k];
+                        denominatorL[k] += xBuffer[k]*xBuffer[k];
+                        denominatorR[k] += yBuffer[k]*yBuffer[k];
+                    }
+                    continue;
+                }
+                for(int k=0; k<width; k++)
+                {
+                    xBuffer[k] = xSource[xTile[k]];
+                    yBuffer[k] = ySource[yTile[k]];
+                }
+                //Caveat: Skip main diagonal
+                if(i>=j0 && i<j0+width)
+                {
+                    xBuffer[localDiagonal[i]] = 0;
+                    yBuffer[localDiagonal[i]] = 0;
+                }
+                for(int k=0; k<width; k++)
+                {
+                    numerator[k] += xBuffer[k]*yBuffer[k];
+                    denominatorL[k] += xBuffer[k]*xBuffer[k];
+                    denominatorR[k] += yBuffer[k]*yBuffer[k];
+                }
+            }
+        }
+    }
+    
+    float weight = triangle ? 2 : 1;
+    for(int k=0; k<TILE_COLUMNS; k++)
+    {
+        theCA->numerator += weight*numerator[k];
+        theCA->denominatorL += weight*denominatorL[k];
+        theCA->denominatorR += weight*denominatorR[k];
+    }
+    free(yInverse);
+    free(xColumn);
+    free(yColumn);
+    free(localDiagonal);
+    free(filled);
+    free(xBuffer);
+    free(yBuffer);
+    free(numerator);
+    free(denominatorL);
+    free(denominatorR);
+}
+
+//Add columns [from,to) of one row pair to sums (numerator, left, right).
+//A NULL index means that side is identity-permuted and its row is read straight
+//through; only the permuted side pays for the gather.
+void augmentSumsByRow(float* sums, float* xSource, float* ySource,
+                      int* xIndex, int* yIndex, int from, int to);
+void augmentSumsByRow(float* sums, float* xSource, float* ySource,
+                      int* xIndex, int* yIndex, int from, int to)
+{
+    float numerator = 0, denominatorL = 0, denominatorR = 0, xVal, yVal;
+    if(xIndex==NULL && yIndex==NULL)
+    {
+        for(int j=from; j<to; j++)
+        {
+            xVal = xSource[j];
+            yVal = ySource[j];
+            numerator += xVal*yVal;
+            denominatorL += xVal*xVal;
+            denominatorR += yVal*yVal;
+        }
+    } else if(xIndex==NULL) {
+        for(int j=from; j<to; j++)
+        {
+            xVal = xSource[j];
+            yVal = ySource[yIndex[j]];
+            numerator += xVal*yVal;
+            denominatorL += xVal*xVal;
+            denominatorR += yVal*yVal;
+        }
+    } else if(yIndex==NULL) {
+        for(int j=from; j<to; j++)
+        {
+            xVal = xSource[xIndex[j]];
+            yVal = ySource[j];
+            numerator += xVal*yVal;
+            denominatorL += xVal*xVal;
+            denominatorR += yVal*yVal;
+        }
+    } else {
+        for(int j=from; j<to; j++)
+        {
+            xVal = xSource[xIndex[j]];
+            yVal = ySource[yIndex[j]];
+            numerator += xVal*yVal;
+            denominatorL += xVal*xVal;
+            denominatorR += yVal*yVal;
+        }
+    }
+    sums[0] += numerator;
+    sums[1] += denominatorL;
+    sums[2] += denominatorR;
+}
+
+//Widen columns [from,to) of a compact field's row, gathered through perm, into out.
+//The storage format is settled once per row, so each format gets its own tight loop.
+void widenFieldRow(Field* theField, int row, int* perm, float* out, int from, int to);
+void widenFieldRow(Field* theField, int row, int* perm, float* out, int from, int to)
+{
+    size_t start = (size_t)row*theField->samples;
+    float scale = theField->scale, offset = theField->offset;
+    switch(theField->storage)
+    {
+        case FIELD_STORAGE_BF16:
+        {
+            uint16_t* source = (uint16_t*)theField->packed + start;
+            for(int j=from; j<to; j++) out[j] = bf16ToFloat(source[perm[j]]);
+            break;
+        }
+        case FIELD_STORAGE_Q16:
+        {
+            uint16_t* source = (uint16_t*)theField->packed + start;
+            for(int j=from; j<to; j++) out[j] = offset + scale*source[perm[j]];
+            break;
+        }
+        case FIELD_STORAGE_Q8:
+        {
+            uint8_t* source = (uint8_t*)theField->packed + start;
+            for(int j=from; j<to; j++) out[j] = offset + scale*source[perm[j]];
+            break;
+        }
+        default:
+        {
+            float* source = theField->element[row];
+            for(int j=from; j<to; j++) out[j] = source[perm[j]];
+        }
+    }
+}
+
+//Rows [firstRow,lastRow) of the permuted square, one partial sum per row
+void augmentCAByRowRange(CorrelationAggregate* theCA, Field* X, Field* Y,
+                         int firstRow, int lastRow);
+void augmentCAByRowRange(CorrelationAggregate* theCA, Field* X, Field* Y,
+                         int firstRow, int lastRow)
+{
+    int n = X->samples;
+    int* xPerm = X->perm->index;
+    int* yPerm = Y->perm->index;
+    bool isCompact = (X->storage!=FIELD_STORAGE_FLOAT || Y->storage!=FIELD_STORAGE_FLOAT);
+    //Symmetric pairs: each row from just past the diagonal, counted twice
+    bool triangle = X->isSymmetric && Y->isSymmetric;
+    float weight = triangle ? 2 : 1;
+    float sums[3];
+    //Compact rows are widened into buffers, then summed like float rows
+    float* xRow = isCompact ? allocateArrayOfFloats(n) : NULL;
+    float* yRow = isCompact ? allocateArrayOfFloats(n) : NULL;
+    for(int i=firstRow; i<lastRow; i++)
+    {
+        sums[0] = sums[1] = sums[2] = 0;
+        if(isCompact)
+        {
+            widenFieldRow(X, xPerm[i], xPerm, xRow, triangle ? i+1 : 0, n);
+            widenFieldRow(Y, yPerm[i], yPerm, yRow, triangle ? i+1 : 0, n);
+            //Caveat: Skip main diagonal
+            if(!triangle) augmentSumsByRow(sums, xRow, yRow, NULL, NULL, 0, i);
+            augmentSumsByRow(sums, xRow, yRow, NULL, NULL, i+1, n);
+        } else {
+            float* xSource = X->element[xPerm[i]];
+            float* ySource = Y->element[yPerm[i]];
+            int* xIndex = X->perm->isIdentity ? NULL : xPerm;
+            int* yIndex = Y->perm->isIdentity ? NULL : yPerm;
+            //Caveat: Skip main diagonal
+            if(!triangle) augmentSumsByRow(sums, xSource, ySource, xIndex, yIndex, 0, i);
+            augmentSumsByRow(sums, xSource, ySource, xIndex, yIndex, i+1, n);
+        }
+        theCA->numerator += weight*sums[0];
+        theCA->denominatorL += weight*sums[1];
+        theCA->denominatorR += weight*sums[2];
+    }
+    free(xRow);
+    free(yRow);
+}
+
 void augmentCAByFields(CorrelationAggregate* theCA, Field* X, Field* Y)
 {
     assert(X!=NULL);
@@ -504,10 +1844,6 @@ void augmentCAByFields(CorrelationAggregate* theCA, Field* X, Field* Y)
     //Compute correlation
     
     //initializeCA(theCA);
-    float yVal;
-    float xVal;
-    int iPerm, jPerm;
-    
     
     if(VERBOSE)
     {
@@ -519,34 +1855,37 @@ void augmentCAByFields(CorrelationAggregate* theCA, Field* X, Field* Y)
                theCA->denominatorL, theCA->denominatorR);
     }
     
-    for(int i=0; i<X->samples; i++)
+    //Small fields: use a kernel specialized for this sample count
+    if(augmentCAByFixedSizeFields(theCA, X, Y)) return;
+    
+    //Large fields: walk the square tile by tile to keep the gathers in cache
+    if(X->samples>=TILED_MIN_SAMPLES
+       && X->storage==FIELD_STORAGE_FLOAT && Y->storage==FIELD_STORAGE_FLOAT)
     {
-        if(VERBOSE) printf("\ti=%d\n",i);
-        for(int j=0; j<X->samples; j++)
-        {
-            if(VERBOSE) printf("\t\tj=%d",j);
-            //Caveat: Skip main diagonal 
-            if(i!=j)
-            {
-                iPerm = Y->perm->index[i];
-                jPerm = Y->perm->index[j];
-                yVal  = Y->element[iPerm][jPerm];
-
-                iPerm = X->perm->index[i];
-                jPerm = X->perm->index[j];
-                xVal  = X->element[iPerm][jPerm];
-                //2x efficiency: Only need upper triangle
-                if(!(UPPER_ONLY && isInLowerDiagonal(i, j)))
-                {
-                    if(VERBOSE) printf("\t\t\tx=%f, y=%f, ", xVal, yVal);
-                    augmentCAByValues(theCA, xVal, yVal);
-                    if(VERBOSE) printf("n=%f, L=%f, R=%f", theCA->numerator, 
-                           theCA->denominatorL, theCA->denominatorR);
-                }
-            }
-            if(VERBOSE) printf("\n");
-        }
+        augmentCAByTiledFields(theCA, X, Y);
+        return;
+    }
+    
+    //Everything else: row by row, reading identity-permuted rows straight through
+    augmentCAByRowRange(theCA, X, Y, 0, X->samples);
+}
+
+void augmentCAByFieldRows(CorrelationAggregate* theCA, Field* X, Field* Y,
+                          int firstRow, int lastRow)
+{
+    assert(theCA!=NULL);
+    assert(X!=NULL);
+    assert(Y!=NULL);
+    assert(X->samples == Y->samples);
+    assert(firstRow>=0 && firstRow<=lastRow && lastRow<=X->samples);
+    
+    //Whole fields go through the size-specialized kernels
+    if(firstRow==0 && lastRow==X->samples)
+    {
+        augmentCAByFields(theCA, X, Y);
+        return;
     }
+    augmentCAByRowRange(theCA, X, Y, firstRow, lastRow);
 }
 
 float mantelR(Landscape* mPreserved, 
@@ -591,48 +1930,4388 @@ float mantelRPartial(Landscape* mPermuted,
     
     if(noAggregator) free(theCA);
 
-    return (AB-AC*BC)/sqrt((1-AC*AC)*(1-BC*BC));    
+    return (AB-AC*BC)/sqrt((1-AC*AC)*(1-BC*BC));    
+}
+
+StatisticalData* allocateStatData(void)
+{
+    //Zeroed, so optional results read as absent
+    return calloc(1, sizeof(StatisticalData));
+}
+
+StatisticalData* correlateAndFindP(Landscape* lPermuted, 
+                                   Landscape* lPreserved, 
+                                   int trials)
+{
+    return correlateAndFindPWithState(lPermuted, lPreserved, trials, NULL);
+}
+
+StatisticalData* correlateAndFindPWithState(Landscape* lPermuted, 
+                                            Landscape* lPreserved, 
+                                            int trials,
+                                            RandomState* theState)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    float currentCor;
+    CorrelationAggregate* aCA = allocateCA();
+
+    theResults->correlationType = "Unset";
+
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
+    {
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
+    }
+
+    for(int perm=0; perm<trials; perm++)
+    {
+        //Make new random permutations
+        for(int f=0; f<lPreserved->numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            if(perm && theState!=NULL)
+                modifyPermPermutifyWithState(lPermuted->fields[f]->perm, theState);
+            else
+                modifyPermPermutify(lPermuted->fields[f]->perm,
+                                    (!perm)?SEED_IDENTITY:SEED_RANDOM);
+        }
+        
+        currentCor=mantelR(lPreserved, lPermuted, aCA);
+        theResults->listOfCorrelations->data[perm] = currentCor;
+        //Store the first result specially
+        if(!perm) theResults->correlationOfInterest = currentCor;
+    }
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+StatisticalData* correlateAndFindPToWidth(Landscape* lPermuted, 
+                                          Landscape* lPreserved, 
+                                          int maxTrials,
+                                          float targetWidth)
+{
+    assert(targetWidth>0);
+    return correlateAndFindPWithProgress(lPermuted, lPreserved, maxTrials, targetWidth, NULL);
+}
+
+void initializeProgressMonitor(ProgressMonitor* theMonitor)
+{
+    assert(theMonitor!=NULL);
+    
+    theMonitor->callback = NULL;
+    theMonitor->context = NULL;
+    theMonitor->correlationType = "Unset";
+    theMonitor->everyTrials = 0;
+    theMonitor->everySeconds = 0;
+    theMonitor->deadline = 0;
+}
+
+void reportProgressStatusLine(ProgressReport* theReport, void* context)
+{
+    assert(theReport!=NULL);
+    FILE* output = context;
+    
+    //Rewritten in place until the run ends
+    fprintf(output, "\r%s: %d/%d trials, p = %.6f [%.6f, %.6f], %.0f trials/s   ",
+            theReport->correlationType, theReport->trials, theReport->trialsRequested,
+            theReport->pValue, theReport->low, theReport->high, theReport->trialsPerSecond);
+    if(theReport->isFinal) fprintf(output, "\n");
+    fflush(output);
+}
+
+void reportProgressNDJSON(ProgressReport* theReport, void* context)
+{
+    assert(theReport!=NULL);
+    FILE* output = context;
+    
+    fprintf(output, "{\"type\":\"%s\",\"r\":%.6f,\"trials\":%d,\"requested\":%d,"
+            "\"p\":%.8g,\"low\":%.8g,\"high\":%.8g,\"elapsed\":%.3f,"
+            "\"trials_per_second\":%.1f,\"final\":%s}\n",
+            theReport->correlationType, theReport->correlationOfInterest, theReport->trials,
+            theReport->trialsRequested, theReport->pValue, theReport->low, theReport->high,
+            theReport->elapsed, theReport->trialsPerSecond, theReport->isFinal ? "true" : "false");
+    fflush(output);
+}
+
+//Fill in a report on the trials so far and hand it over
+void sendProgressReport(ProgressMonitor* theMonitor, StatisticalData* theResults,
+                        int trials, int trialsRequested, int atLeast, double started, bool isFinal);
+void sendProgressReport(ProgressMonitor* theMonitor, StatisticalData* theResults,
+                        int trials, int trialsRequested, int atLeast, double started, bool isFinal)
+{
+    if(theMonitor->callback==NULL) return;
+    ProgressReport theReport;
+    theReport.correlationType = theMonitor->correlationType;
+    theReport.correlationOfInterest = theResults->correlationOfInterest;
+    theReport.trials = trials;
+    theReport.trialsRequested = trialsRequested;
+    theReport.atLeast = atLeast;
+    theReport.pValue = atLeast/(FLOATIFY*trials);
+    computeClopperPearson(atLeast, trials, &theReport.low, &theReport.high);
+    theReport.elapsed = secondsNow()-started;
+    theReport.trialsPerSecond = (theReport.elapsed>0) ? trials/theReport.elapsed : 0;
+    theReport.isFinal = isFinal;
+    theMonitor->callback(&theReport, theMonitor->context);
+}
+
+StatisticalData* correlateAndFindPWithProgress(Landscape* lPermuted, 
+                                               Landscape* lPreserved, 
+                                               int maxTrials,
+                                               float targetWidth,
+                                               ProgressMonitor* theMonitor)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(maxTrials>0);
+    StatisticalData* theResults=allocateStatData();
+    List* theList = allocateList();
+    theResults->listOfCorrelations = theList;
+    theList->count = 0;
+    theList->data = NULL;
+    theList->isSorted = false;
+    theList->isMeanValid = false;
+    float currentCor;
+    CorrelationAggregate* aCA = allocateCA();
+    
+    theResults->correlationType = "Unset";
+    theResults->targetWidth = targetWidth;
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
+    {
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
+    }
+    
+    int atLeast = 0;
+    double low, high;
+    double started = secondsNow(), lastReport = started, now;
+    for(int perm=0; perm<maxTrials; perm++)
+    {
+        //Between blocks: stop if the interval is narrow enough, else make room for more
+        if(perm%PRECISION_BLOCK_TRIALS == 0)
+        {
+            if(perm && targetWidth>0)
+            {
+                computeClopperPearson(atLeast, perm, &low, &high);
+                if(high-low <= targetWidth) break;
+            }
+            theList->data = realloc(theList->data, (perm+PRECISION_BLOCK_TRIALS)*sizeof(float));
+            assert(theList->data!=NULL);
+        }
+        
+        //Identity permutation the first time through, random the rest
+        for(int f=0; f<lPreserved->numFields; f++)
+            modifyPermPermutify(lPermuted->fields[f]->perm, (!perm)?SEED_IDENTITY:SEED_RANDOM);
+        
+        currentCor=mantelR(lPreserved, lPermuted, aCA);
+        theList->data[perm] = currentCor;
+        theList->count = perm+1;
+        //Store the first result specially
+        if(!perm) theResults->correlationOfInterest = currentCor;
+        if(currentCor >= theResults->correlationOfInterest) atLeast++;
+        
+        if(theMonitor==NULL || perm+1==maxTrials) continue;
+        now = secondsNow();
+        if(theMonitor->deadline>0 && now>=theMonitor->deadline)
+        {
+            //Out of time: what's done so far is the result
+            theResults->trialsRequested = maxTrials;
+            break;
+        }
+        if((theMonitor->everyTrials>0 && (perm+1)%theMonitor->everyTrials==0)
+           || (theMonitor->everySeconds>0 && now-lastReport>=theMonitor->everySeconds))
+        {
+            sendProgressReport(theMonitor, theResults, perm+1, maxTrials, atLeast, started, false);
+            lastReport = now;
+        }
+    }
+    if(theMonitor!=NULL)
+        sendProgressReport(theMonitor, theResults, theList->count, maxTrials, atLeast, started, true);
+    free(aCA);
+    modifyListSortify(theList);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theList, 
+                                             NULL);
+    return theResults;
+}
+
+StatisticalData* correlatePartialAndFindP(Landscape* lPermuted, 
+                                          Landscape* lPreserved, 
+                                          Landscape* lGiven, 
+                                          int trials)
+{
+    return correlatePartialAndFindPWithState(lPermuted, lPreserved, lGiven, trials, NULL);
+}
+
+StatisticalData* correlatePartialAndFindPWithState(Landscape* lPermuted, 
+                                                   Landscape* lPreserved, 
+                                                   Landscape* lGiven, 
+                                                   int trials,
+                                                   RandomState* theState)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lGiven!=NULL);
+    
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lGiven->numFields == lPreserved->numFields);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    float currentCor;
+    CorrelationAggregate* aCA = allocateCA();
+    
+    theResults->correlationType = "Unset";
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    modifyLandscapeMeanify(lGiven);
+    
+    //Partial tests always run at full precision
+    theResults->storageErrorBound = -1.0;
+    
+    for(int perm=0; perm<trials; perm++)
+    {
+        //Make new random permutations
+        for(int f=0; f<lPreserved->numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            if(perm && theState!=NULL)
+                modifyPermPermutifyWithState(lPermuted->fields[f]->perm, theState);
+            else
+                modifyPermPermutify(lPermuted->fields[f]->perm,
+                                    (!perm)?SEED_IDENTITY:SEED_RANDOM);
+        }
+        
+        currentCor=mantelRPartial(lPermuted, lPreserved, lGiven, aCA);
+        theResults->listOfCorrelations->data[perm] = currentCor;
+        //Store the first result specially
+        if(!perm) theResults->correlationOfInterest = currentCor;
+    }
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+Landscape* makeResidualLandscape(Landscape* lData, Landscape* lGiven)
+{
+    assert(lData!=NULL);
+    assert(lGiven!=NULL);
+    assert(lData->numFields == lGiven->numFields);
+    
+    modifyLandscapeMeanify(lData);
+    modifyLandscapeMeanify(lGiven);
+    
+    //Least-squares slope through the origin (both are centered)
+    double numerator = 0.0, denominator = 0.0;
+    Field *D, *G;
+    for(int f=0; f<lData->numFields; f++)
+    {
+        D = lData->fields[f];
+        G = lGiven->fields[f];
+        assert(D->samples == G->samples);
+        for(int x=0; x<D->samples; x++)
+        {
+            for(int y=0; y<D->samples; y++)
+            {
+                //Caveat: Skip main diagonal
+                if(x==y) continue;
+                numerator += (double)D->element[x][y]*G->element[x][y];
+                denominator += (double)G->element[x][y]*G->element[x][y];
+            }
+        }
+    }
+    float slope = numerator/denominator;
+    
+    //Residuals of centered data are centered too
+    Landscape* theResiduals = makeLandscapeFromLandscape(lData);
+    for(int f=0; f<theResiduals->numFields; f++)
+    {
+        D = theResiduals->fields[f];
+        G = lGiven->fields[f];
+        for(int x=0; x<D->samples; x++)
+        {
+            for(int y=0; y<D->samples; y++)
+            {
+                if(x!=y) D->element[x][y] -= slope*G->element[x][y];
+            }
+        }
+        D->isSymmetric = D->isSymmetric && G->isSymmetric;
+    }
+    theResiduals->isSymmetric = lData->isSymmetric && lGiven->isSymmetric;
+    return theResiduals;
+}
+
+StatisticalData* correlateResidualsAndFindP(Landscape* lPermuted, 
+                                            Landscape* lPreserved, 
+                                            Landscape* lGiven, 
+                                            int trials)
+{
+    return correlateResidualsAndFindPWithState(lPermuted, lPreserved, lGiven, trials, NULL);
+}
+
+StatisticalData* correlateResidualsAndFindPWithState(Landscape* lPermuted, 
+                                                     Landscape* lPreserved, 
+                                                     Landscape* lGiven, 
+                                                     int trials,
+                                                     RandomState* theState)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lGiven!=NULL);
+    
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lGiven->numFields == lPreserved->numFields);
+    
+    //The regressions happen once; after that it's an ordinary Mantel test,
+    //so each trial is one pass through the kernels instead of three
+    Landscape* preservedResiduals = makeResidualLandscape(lPreserved, lGiven);
+    Landscape* permutedResiduals = makeResidualLandscape(lPermuted, lGiven);
+    
+    StatisticalData* theResults = correlateAndFindPWithState(permutedResiduals, 
+                                                             preservedResiduals,
+                                                             trials, theState);
+    freeLandscape(preservedResiduals);
+    freeLandscape(permutedResiduals);
+    return theResults;
+}
+
+
+float fractionAtLeast(List* theData, float datum)
+{
+    assert(theData!=NULL);
+    
+    int atLeast = 0;
+    for(int i=0; i<theData->count; i++)
+    {
+        if(theData->data[i] >= datum) atLeast++;
+    }
+    return atLeast/(FLOATIFY*theData->count);
+}
+
+//Regularized incomplete beta function I_x(a,b), by continued fraction
+double regularizedBeta(double a, double b, double x);
+double regularizedBeta(double a, double b, double x)
+{
+    if(x<=0) return 0;
+    if(x>=1) return 1;
+    //The fraction converges quickly on this side; use symmetry for the other
+    if(x > (a+1)/(a+b+2)) return 1 - regularizedBeta(b, a, 1-x);
+    double front = exp(lgamma(a+b) - lgamma(a) - lgamma(b) + a*log(x) + b*log(1-x))/a;
+    double C = 1, D = 1 - (a+b)*x/(a+1), h, delta;
+    if(fabs(D)<1e-300) D = 1e-300;
+    D = 1/D;
+    h = D;
+    for(int m=1; m<10000; m++)
+    {
+        //Even then odd terms (modified Lentz)
+        for(int odd=0; odd<2; odd++)
+        {
+            double an = odd ? -(a+m)*(a+b+m)*x/((a+2*m)*(a+2*m+1))
+                            : m*(b-m)*x/((a+2*m-1)*(a+2*m));
+            D = 1 + an*D;
+            if(fabs(D)<1e-300) D = 1e-300;
+            C = 1 + an/C;
+            if(fabs(C)<1e-300) C = 1e-300;
+            D = 1/D;
+            delta = C*D;
+            h *= delta;
+        }
+        if(fabs(delta-1)<1e-15) break;
+    }
+    return front*h;
+}
+
+//x with I_x(a,b) = level, by bisection
+double inverseRegularizedBeta(double a, double b, double level);
+double inverseRegularizedBeta(double a, double b, double level)
+{
+    double lo = 0, hi = 1;
+    for(int step=0; step<60; step++)
+    {
+        double mid = (lo+hi)/2;
+        if(regularizedBeta(a, b, mid) < level) lo = mid;
+        else hi = mid;
+    }
+    return (lo+hi)/2;
+}
+
+void computeClopperPearson(int successes, int trials, double* low, double* high)
+{
+    assert(trials>0);
+    assert(successes>=0 && successes<=trials);
+    assert(low!=NULL && high!=NULL);
+    
+    double alpha = 1-PRECISION_CONFIDENCE;
+    *low = (successes==0) ? 0 : inverseRegularizedBeta(successes, trials-successes+1, alpha/2);
+    *high = (successes==trials) ? 1 : inverseRegularizedBeta(successes+1, trials-successes, 1-alpha/2);
+}
+
+void saveData(StatisticalData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    FILE* output = NULL;
+    char fname[100];
+    
+    int trials = dataToSave->listOfCorrelations->count;
+    float rank = dataToSave->rankInfo->rank+1;
+    
+    sprintf(fname, "testinfo.%d.%s.%s", 
+            timestamp, dataToSave->correlationType, "txt");
+    output = fopen(fname, "w");
+    fprintf(output, "%s correlation is %f\n", 
+            dataToSave->correlationType,
+            dataToSave->correlationOfInterest);
+    fprintf(output, "In %d trials, %d matches had average rank %f\n", 
+            trials, dataToSave->rankInfo->count, rank);
+    fprintf(output, "Assuming uniqueness, %f of the trials were >=\n", 
+            (trials - rank)/(FLOATIFY*trials));
+    fprintf(output, "Assuming uniqueness, %f of the trials were <=\n", 
+            (rank)/(FLOATIFY*trials));
+    if(dataToSave->storageErrorBound >= 0)
+    {
+        fprintf(output, "Compact storage: every comparison within %g of full precision\n",
+                dataToSave->storageErrorBound);
+    }
+    
+    //Monte Carlo error on the fraction >=, counting ties
+    int atLeast = 0;
+    double low, high;
+    for(int i=0; i<trials; i++)
+        if(dataToSave->listOfCorrelations->data[i] >= dataToSave->correlationOfInterest) atLeast++;
+    computeClopperPearson(atLeast, trials, &low, &high);
+    fprintf(output, "%.0f%% Clopper-Pearson interval on the fraction >=: [%f, %f]\n",
+            100*PRECISION_CONFIDENCE, low, high);
+    if(dataToSave->trialsRequested > 0)
+    {
+        fprintf(output, "Time budget ran out after %d of %d trials\n",
+                trials, dataToSave->trialsRequested);
+    }
+    if(dataToSave->targetWidth > 0)
+    {
+        fprintf(output, "Target interval width %g %s after %d trials\n", dataToSave->targetWidth,
+                (high-low <= dataToSave->targetWidth) ? "met" : "not met", trials);
+    }
+    fclose(output);
+    
+    sprintf(fname, "testinfo.%d.%s.%s", 
+            timestamp, dataToSave->correlationType, "tdv");
+    saveListToTDV(fname, dataToSave->listOfCorrelations);
+}
+
+RunOptions* allocateRunOptions(void)
+{
+    return malloc(sizeof(RunOptions));
+}
+
+void initializeRunOptions(RunOptions* theOptions)
+{
+    assert(theOptions!=NULL);
+    
+    theOptions->storage = FIELD_STORAGE_FLOAT;
+    theOptions->allPairs = 0;
+    theOptions->oneVsMany = 0;
+    theOptions->batchSize = 8;
+    theOptions->manifest = NULL;
+    theOptions->threads = 1;
+    theOptions->cacheDir = NULL;
+    theOptions->cacheLimit = CACHE_DEFAULT_MB*1024LL*1024LL;
+    theOptions->memoryLimit = 0;
+    theOptions->scratchDir = NULL;
+    theOptions->numa = true;
+    theOptions->steal = false;
+    theOptions->generators = 0;
+    theOptions->matrixFree = false;
+    theOptions->numClasses = 0;
+    theOptions->classBounds = NULL;
+    theOptions->regression = 0;
+    theOptions->residual = false;
+    theOptions->moments = false;
+    theOptions->tail = false;
+    theOptions->targetWidth = 0;
+    theOptions->bootstrap = 0;
+    theOptions->progress = PROGRESS_NONE;
+    theOptions->progressTrials = 0;
+    theOptions->progressSeconds = 0;
+    theOptions->timeBudget = 0;
+    theOptions->bankFile = NULL;
+    theOptions->makeBankFile = NULL;
+}
+
+//Trade centered landscapes for ranked ones, from the cache when there is one
+void rankLandscapesForRun(Landscape** lPreserved, Landscape** lPermuted, int filesets,
+                          const char* s[], const char* p[], RunOptions* options);
+void rankLandscapesForRun(Landscape** lPreserved, Landscape** lPermuted, int filesets,
+                          const char* s[], const char* p[], RunOptions* options)
+{
+    if(options->cacheDir!=NULL)
+    {
+        freeLandscape(*lPreserved);
+        freeLandscape(*lPermuted);
+        *lPreserved = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                             filesets, s, true);
+        *lPermuted = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                            filesets, p, true);
+    } else {
+        modifyLandscapeRankify(*lPreserved);
+        modifyLandscapeRankify(*lPermuted);
+    }
+}
+
+void processFilePairs(int trials, int filesets, const char* argv[], int timestamp,
+                      RunOptions* options)
+{
+    RunOptions defaults;
+    if(options==NULL)
+    {
+        initializeRunOptions(&defaults);
+        options = &defaults;
+    }
+    
+    //The time budget covers the whole run, loading included
+    ProgressMonitor theMonitor;
+    initializeProgressMonitor(&theMonitor);
+    if(options->timeBudget>0) theMonitor.deadline = secondsNow()+options->timeBudget;
+    if(options->progress==PROGRESS_STATUS) theMonitor.callback = reportProgressStatusLine;
+    if(options->progress==PROGRESS_NDJSON) theMonitor.callback = reportProgressNDJSON;
+    theMonitor.context = stderr;
+    theMonitor.everyTrials = options->progressTrials;
+    theMonitor.everySeconds = options->progressSeconds;
+    bool isMonitored = (options->progress!=PROGRESS_NONE || options->timeBudget>0);
+    
+    const char* s[filesets]; //static: distances
+    const char* p[filesets]; //permuted: differences
+    int groupSize=2;
+    int firstFile=2;
+    for(int i=0; i<filesets; i++)
+    {
+        s[i] = argv[groupSize*i+firstFile];
+        p[i] = argv[groupSize*i+firstFile+1];
+    }
+    
+    StatisticalData* theStats = NULL;
+    
+    //Matrix free: the preserved distances are only ever coordinates
+    if(options->matrixFree)
+    {
+        PointLandscape* pPreserved = makePointLandscapeFromFiles(filesets, s);
+        Landscape* lPermuted = makeLandscapeFromTDVs(filesets, p);
+        
+        theStats = correlatePointsAndFindP(lPermuted, pPreserved, trials);
+        theStats->correlationType = "Pearson";
+        saveData(theStats, timestamp);
+        
+        //Ranking would need every distance at once
+        printf("Note: matrix-free mode; skipping Spearman correlation.\n");
+        freePointLandscape(pPreserved);
+        freeLandscape(lPermuted);
+        return;
+    }
+    
+    //Out of core: only row blocks within the memory budget are ever resident
+    if(options->memoryLimit>0)
+    {
+        const char* scratchDir = options->scratchDir;
+        if(scratchDir==NULL) scratchDir = getenv("TMPDIR");
+        if(scratchDir==NULL) scratchDir = "/tmp";
+        StreamedLandscape* sPreserved = makeStreamedLandscapeFromTDVs(filesets, s, scratchDir);
+        StreamedLandscape* sPermuted = makeStreamedLandscapeFromTDVs(filesets, p, scratchDir);
+        
+        theStats = correlateStreamedAndFindP(sPermuted, sPreserved, trials, options->memoryLimit);
+        theStats->correlationType = "Pearson";
+        saveData(theStats, timestamp);
+        
+        //Ranking would need every element at once
+        printf("Note: out-of-core mode; skipping Spearman correlation.\n");
+        freeStreamedLandscape(sPreserved);
+        freeStreamedLandscape(sPermuted);
+        return;
+    }
+    
+    //Load data
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    if(options->cacheDir!=NULL)
+    {
+        lPreserved = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                            filesets, s, false);
+        lPermuted = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                           filesets, p, false);
+    } else {
+        lPreserved = makeLandscapeFromTDVs(filesets, s);
+        lPermuted = makeLandscapeFromTDVs(filesets, p);
+    }
+    
+    //Moments: the same centered landscapes, but no permutation loop
+    if(options->moments)
+    {
+        if(lPreserved->isSymmetric && lPermuted->isSymmetric)
+        {
+            MomentData* theMoments = correlateAndApproximateP(lPermuted, lPreserved);
+            theMoments->correlationType = "Pearson";
+            saveMomentData(theMoments, timestamp);
+            free(theMoments);
+            
+            rankLandscapesForRun(&lPreserved, &lPermuted, filesets, s, p, options);
+            theMoments = correlateAndApproximateP(lPermuted, lPreserved);
+            theMoments->correlationType = "Spearman";
+            saveMomentData(theMoments, timestamp);
+            free(theMoments);
+            
+            freeLandscape(lPreserved);
+            freeLandscape(lPermuted);
+            return;
+        }
+        printf("Note: moments need symmetric fields; running %d trials instead.\n", trials);
+    }
+    
+    //Tail sampling: tempered chains in place of uniform permutations
+    if(options->tail)
+    {
+        TailData* theTail = correlateAndEstimateTailP(lPermuted, lPreserved, trials);
+        theTail->correlationType = "Pearson";
+        saveTailData(theTail, timestamp);
+        free(theTail);
+        
+        rankLandscapesForRun(&lPreserved, &lPermuted, filesets, s, p, options);
+        theTail = correlateAndEstimateTailP(lPermuted, lPreserved, trials);
+        theTail->correlationType = "Spearman";
+        saveTailData(theTail, timestamp);
+        free(theTail);
+        
+        freeLandscape(lPreserved);
+        freeLandscape(lPermuted);
+        return;
+    }
+    
+    //A permutation bank stands in for the random number generator
+    PermBank* theBank = NULL;
+    if(options->bankFile!=NULL)
+    {
+        theBank = openPermutationBank(options->bankFile);
+        int* streams = (theBank!=NULL) ? makeBankStreamsForLandscape(theBank, lPermuted) : NULL;
+        if(streams==NULL)
+        {
+            printf("Note: bank <%s> lacks streams for these fields; drawing permutations instead.\n",
+                   options->bankFile);
+            closePermutationBank(theBank);
+            theBank = NULL;
+        }
+        else if(trials > theBank->trials)
+        {
+            printf("Note: bank <%s> holds %d trials; running that many.\n",
+                   options->bankFile, theBank->trials);
+            trials = theBank->trials;
+        }
+        free(streams);
+    }
+    
+    //Compact storage has to happen after centering
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+    {
+        modifyLandscapeMeanify(lPreserved);
+        modifyLandscapeMeanify(lPermuted);
+        modifyLandscapeCompactify(lPreserved, options->storage);
+        modifyLandscapeCompactify(lPermuted, options->storage);
+    }
+    
+    //Pearson correlation
+    bool isIncremental = (options->targetWidth>0 || isMonitored);
+    if(isIncremental && (options->threads>1 || options->generators>0))
+        printf("Note: trials with a target width, progress or time budget run on one thread.\n");
+    theMonitor.correlationType = "Pearson";
+    if(isIncremental)
+        theStats = correlateAndFindPWithProgress(lPermuted, lPreserved, trials, options->targetWidth,
+                                                 isMonitored ? &theMonitor : NULL);
+    else if(theBank!=NULL)
+        theStats = correlateAndFindPFromBank(lPermuted, lPreserved, trials, options->threads, theBank);
+    else if(options->generators>0)
+        theStats = correlateAndFindPPipelined(lPermuted, lPreserved, trials, options->threads,
+                                              options->generators, 2*timestamp);
+    else if(options->threads>1 && options->steal)
+        theStats = correlateAndFindPStealing(lPermuted, lPreserved, trials, options->threads,
+                                             2*timestamp);
+    else if(options->threads>1)
+        theStats = correlateAndFindPThreaded(lPermuted, lPreserved, trials, options->threads,
+                                             2*timestamp, options->numa);
+    else
+        theStats = correlateAndFindP(lPermuted, lPreserved, trials);
+    theStats->correlationType = "Pearson";
+    saveData(theStats, timestamp);
+    
+    //Full-precision values are gone, so there's nothing left to rank or resample
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+    {
+        printf("Note: compact storage requested; skipping Spearman correlation.\n");
+        if(options->bootstrap) printf("Note: compact storage requested; skipping bootstrap.\n");
+        closePermutationBank(theBank);
+        return;
+    }
+    
+    //Interval on r, alongside the p value
+    if(options->bootstrap)
+    {
+        BootstrapData* theBootstrap = correlateAndBootstrapR(lPermuted, lPreserved, options->bootstrap,
+                                                             options->threads, 2*timestamp);
+        theBootstrap->correlationType = "Pearson";
+        saveBootstrapData(theBootstrap, timestamp);
+        freeBootstrapData(theBootstrap);
+    }
+    
+    if(theMonitor.deadline>0 && secondsNow()>=theMonitor.deadline)
+    {
+        printf("Note: time budget spent; skipping Spearman correlation.\n");
+        closePermutationBank(theBank);
+        return;
+    }
+    
+    //Rank data
+    rankLandscapesForRun(&lPreserved, &lPermuted, filesets, s, p, options);
+    
+    //Spearman correlation
+    theMonitor.correlationType = "Spearman";
+    if(isIncremental)
+        theStats = correlateAndFindPWithProgress(lPermuted, lPreserved, trials, options->targetWidth,
+                                                 isMonitored ? &theMonitor : NULL);
+    else if(theBank!=NULL)
+        theStats = correlateAndFindPFromBank(lPermuted, lPreserved, trials, options->threads, theBank);
+    else if(options->generators>0)
+        theStats = correlateAndFindPPipelined(lPermuted, lPreserved, trials, options->threads,
+                                              options->generators, 2*timestamp+1);
+    else if(options->threads>1 && options->steal)
+        theStats = correlateAndFindPStealing(lPermuted, lPreserved, trials, options->threads,
+                                             2*timestamp+1);
+    else if(options->threads>1)
+        theStats = correlateAndFindPThreaded(lPermuted, lPreserved, trials, options->threads,
+                                             2*timestamp+1, options->numa);
+    else
+        theStats = correlateAndFindP(lPermuted, lPreserved, trials);
+    theStats->correlationType = "Spearman";
+    saveData(theStats, timestamp);
+    closePermutationBank(theBank);
+    
+    //Ranks stay as they are for the whole landscape, rather than being redone per replicate
+    if(options->bootstrap)
+    {
+        BootstrapData* theBootstrap = correlateAndBootstrapR(lPermuted, lPreserved, options->bootstrap,
+                                                             options->threads, 2*timestamp+1);
+        theBootstrap->correlationType = "Spearman";
+        saveBootstrapData(theBootstrap, timestamp);
+        freeBootstrapData(theBootstrap);
+    }
+}
+
+void processFileTriples(int trials, int filesets, const char* argv[], int timestamp,
+                        RunOptions* options)
+{
+    const char* s[filesets]; //static: distances
+    const char* p[filesets]; //permuted: differences
+    const char* g[filesets]; //given: differences to relativize by
+    int groupSize = 3;
+    int firstFile = 2;
+    for(int i=0; i<filesets; i++)
+    {
+        s[i] = argv[groupSize*i+firstFile];
+        p[i] = argv[groupSize*i+firstFile+1];
+        g[i] = argv[groupSize*i+firstFile+2];
+    }
+    
+    RunOptions defaults;
+    if(options==NULL)
+    {
+        initializeRunOptions(&defaults);
+        options = &defaults;
+    }
+    
+    //Load data
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    Landscape* lGiven;
+    if(options->cacheDir!=NULL)
+    {
+        lPreserved = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                            filesets, s, false);
+        lPermuted = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                           filesets, p, false);
+        lGiven = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                        filesets, g, false);
+    } else {
+        lPreserved = makeLandscapeFromTDVs(filesets, s);
+        lPermuted = makeLandscapeFromTDVs(filesets, p);
+        lGiven = makeLandscapeFromTDVs(filesets, g);
+    }
+    
+    StatisticalData* theStats = NULL;
+    
+    //Pearson correlation
+    if(options->residual)
+        theStats = correlateResidualsAndFindP(lPermuted, lPreserved, lGiven, trials);
+    else
+        theStats = correlatePartialAndFindP(lPermuted, lPreserved, lGiven, trials);
+    theStats->correlationType = "Pearson (Partial)";
+    saveData(theStats, timestamp);
+    
+    //Rank data
+    if(options->cacheDir!=NULL)
+    {
+        freeLandscape(lPreserved);
+        freeLandscape(lPermuted);
+        freeLandscape(lGiven);
+        lPreserved = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                            filesets, s, true);
+        lPermuted = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                           filesets, p, true);
+        lGiven = makeLandscapeFromCache(options->cacheDir, options->cacheLimit, 
+                                        filesets, g, true);
+    } else {
+        modifyLandscapeRankify(lPreserved);
+        modifyLandscapeRankify(lPermuted);
+        modifyLandscapeRankify(lGiven);
+    }
+    
+    //Spearman correlation
+    if(options->residual)
+        theStats = correlateResidualsAndFindP(lPermuted, lPreserved, lGiven, trials);
+    else
+        theStats = correlatePartialAndFindP(lPermuted, lPreserved, lGiven, trials);
+    theStats->correlationType = "Spearman (Partial)";
+    saveData(theStats, timestamp);
+}
+
+
+#pragma mark Out of core
+
+//Stream one TDV file into an unlinked binary file of rows, adding its
+//off-diagonal elements to the running totals
+StreamedField* makeStreamedFieldFromTDV(const char* filename, const char* scratchDir,
+                                        double* total, double* totalOfSquares);
+StreamedField* makeStreamedFieldFromTDV(const char* filename, const char* scratchDir,
+                                        double* total, double* totalOfSquares)
+{
+    assert(filename!=NULL);
+    assert(scratchDir!=NULL);
+    
+    //Coordinates instead of comparisons: rows are computed rather than parsed
+    PointSet* thePoints = hasPointsHeader(filename) ? makePointSetFromFile(filename) : NULL;
+    
+    int fieldnum, samples, scan;
+    FILE *theFile = fopen(filename, "r");
+    assert(theFile); //Gotta have a file to process
+    if(thePoints!=NULL)
+    {
+        fieldnum = thePoints->fieldnum;
+        samples = thePoints->samples;
+        scan = 2;
+    } else {
+        scan=fscanf(theFile, "<Field %d:Samples %d>", &fieldnum, &samples);
+    }
+    if(scan!=2)
+    {
+        printf("ERROR: Bad input file <%s> missing header.\n", filename);
+        fclose(theFile);
+    } else {
+        printf("Streaming [%s] field=%d, samples=%d\n", filename, fieldnum, samples);
+    }
+    assert(scan==2);
+    
+    char temporary[PATH_MAX+16];
+    snprintf(temporary, sizeof(temporary), "%s/spcstream.XXXXXX", scratchDir);
+    int fd = mkstemp(temporary);
+    if(fd<0) printf("ERROR: couldn't write to scratch directory <%s>.\n", scratchDir);
+    assert(fd>=0);
+    //Nobody else needs the name; the space goes back when the descriptor closes
+    unlink(temporary);
+    
+    StreamedField* theField = malloc(sizeof(StreamedField));
+    theField->fieldnum = fieldnum;
+    theField->samples = samples;
+    theField->descriptor = fd;
+    
+    float* row = allocateArrayOfFloats(samples);
+    for(int x=0; x<samples; x++)
+    {
+        if(thePoints!=NULL) fillDistanceRow(thePoints, x, row);
+        for(int y=0; y<samples; y++)
+        {
+            if(thePoints==NULL) fscanf(theFile, "%f", &row[y]);
+            //Caveat: Skip main diagonal
+            if(x==y)
+            {
+                if(row[y]!=0) printf("HEY! Nonzero on main diagonal.\n");
+                continue;
+            }
+            *total += row[y];
+            *totalOfSquares += (double)row[y]*row[y];
+        }
+        if(write(fd, row, samples*sizeof(float)) != (ssize_t)(samples*sizeof(float)))
+        {
+            printf("ERROR: couldn't write scratch file for <%s>.\n", filename);
+            assert(false);
+        }
+    }
+    free(row);
+    freePointSet(thePoints);
+    fclose(theFile);
+    return theField;
+}
+
+StreamedLandscape* makeStreamedLandscapeFromTDVs(int files, const char* filenames[],
+                                                 const char* scratchDir)
+{
+    assert(files>0);
+    assert(filenames!=NULL);
+    assert(scratchDir!=NULL);
+    
+    StreamedLandscape* theData = malloc(sizeof(StreamedLandscape));
+    theData->numFields = files;
+    theData->fields = malloc(files*sizeof(StreamedField*));
+    theData->numNonDiagElts = 0;
+    
+    double total = 0, totalOfSquares = 0;
+    for(int f=0; f<files; f++)
+    {
+        theData->fields[f] = makeStreamedFieldFromTDV(filenames[f], scratchDir, 
+                                                      &total, &totalOfSquares);
+        theData->numNonDiagElts += (long long)theData->fields[f]->samples
+                                 * (theData->fields[f]->samples-1);
+    }
+    theData->mean = total/theData->numNonDiagElts;
+    theData->sumOfSquares = totalOfSquares - total*theData->mean;
+    return theData;
+}
+
+void freeStreamedLandscape(StreamedLandscape* theData)
+{
+    if(theData==NULL) return;
+    
+    for(int f=0; f<theData->numFields; f++)
+    {
+        close(theData->fields[f]->descriptor);
+        free(theData->fields[f]);
+    }
+    free(theData->fields);
+    free(theData);
+}
+
+void readStreamedRows(StreamedField* theField, int firstRow, int rows, float* buffer, double mean)
+{
+    assert(theField!=NULL);
+    assert(buffer!=NULL);
+    assert(firstRow>=0 && firstRow+rows<=theField->samples);
+    
+    int n = theField->samples;
+    size_t wanted = (size_t)rows*n*sizeof(float);
+    off_t offset = (off_t)firstRow*n*sizeof(float);
+    size_t got = 0;
+    ssize_t now;
+    while(got<wanted)
+    {
+        now = pread(theField->descriptor, (char*)buffer+got, wanted-got, offset+got);
+        if(now<=0)
+        {
+            printf("ERROR: couldn't read field %d from scratch file.\n", theField->fieldnum);
+            assert(false);
+        }
+        got += now;
+    }
+    for(int r=0; r<rows; r++)
+    {
+        for(int c=0; c<n; c++) buffer[(size_t)r*n+c] -= mean;
+        //Caveat: Skip main diagonal (zero on one side drops it from the sums)
+        buffer[(size_t)r*n+firstRow+r] = 0;
+    }
+}
+
+StatisticalData* correlateStreamedAndFindP(StreamedLandscape* lPermuted,
+                                           StreamedLandscape* lPreserved,
+                                           int trials, long long memoryLimit)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(trials>0);
+    assert(memoryLimit>0);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    theResults->correlationType = "Unset";
+    theResults->storageErrorBound = -1.0;
+    
+    int largest = 0;
+    for(int f=0; f<lPreserved->numFields; f++)
+    {
+        assert(lPreserved->fields[f]->samples == lPermuted->fields[f]->samples);
+        if(lPreserved->fields[f]->samples>largest) largest = lPreserved->fields[f]->samples;
+    }
+    long long rowBytes = (long long)largest*sizeof(float);
+    
+    //A quarter of the budget holds the batch's permutations, the rest two row blocks.
+    //Every block read is shared by the whole batch of trials.
+    long long batch = (memoryLimit/4)/rowBytes;
+    if(batch<1) batch = 1;
+    if(batch>trials) batch = trials;
+    long long blockRows = (memoryLimit-batch*rowBytes)/(2*rowBytes);
+    if(blockRows<1) blockRows = 1;
+    if(blockRows>largest) blockRows = largest;
+    printf("Streaming %d trials in passes of %lld, %lld rows per block\n", 
+           trials, batch, blockRows);
+    
+    int* perms = malloc((size_t)batch*largest*sizeof(int));
+    assert(perms!=NULL);
+    float* xBlock = malloc(blockRows*rowBytes);
+    float* yBlock = malloc(blockRows*rowBytes);
+    double* numerators = malloc(batch*sizeof(double));
+    double denominator = sqrt(lPreserved->sumOfSquares*lPermuted->sumOfSquares);
+    Perm thePerm;
+    
+    for(int first=0; first<trials; first+=batch)
+    {
+        int count = (trials-first<batch) ? trials-first : (int)batch;
+        for(int t=0; t<count; t++) numerators[t] = 0;
+        
+        for(int f=0; f<lPreserved->numFields; f++)
+        {
+            StreamedField* X = lPreserved->fields[f];
+            StreamedField* Y = lPermuted->fields[f];
+            int n = X->samples;
+            
+            //Identity permutation the first time through, random the rest
+            for(int t=0; t<count; t++)
+            {
+                thePerm.size = n;
+                thePerm.index = perms+(size_t)t*n;
+                modifyPermPermutify(&thePerm, SEED_IDENTITY);
+                if(first+t) modifyPermPermutify(&thePerm, SEED_RANDOM);
+            }
+            
+            int rows = (blockRows<n) ? (int)blockRows : n;
+            for(int a0=0; a0<n; a0+=rows)
+            {
+                int aRows = (a0+rows<n) ? rows : n-a0;
+                readStreamedRows(X, a0, aRows, xBlock, lPreserved->mean);
+                for(int b0=0; b0<n; b0+=rows)
+                {
+                    int bRows = (b0+rows<n) ? rows : n-b0;
+                    readStreamedRows(Y, b0, bRows, yBlock, lPermuted->mean);
+                    
+                    //Each trial pairs X row i with Y row perm[i], if it's in this block
+                    for(int t=0; t<count; t++)
+                    {
+                        int* perm = perms+(size_t)t*n;
+                        double partial = 0;
+                        for(int i=a0; i<a0+aRows; i++)
+                        {
+                            if(perm[i]<b0 || perm[i]>=b0+bRows) continue;
+                            float* xRow = xBlock+(size_t)(i-a0)*n;
+                            float* yRow = yBlock+(size_t)(perm[i]-b0)*n;
+                            float sum = 0;
+                            for(int j=0; j<n; j++) sum += xRow[j]*yRow[perm[j]];
+                            partial += sum;
+                        }
+                        numerators[t] += partial;
+                    }
+                }
+            }
+        }
+        for(int t=0; t<count; t++)
+        {
+            theResults->listOfCorrelations->data[first+t] = (FLOATIFY*numerators[t])/denominator;
+        }
+    }
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
+    
+    free(perms);
+    free(xBlock);
+    free(yBlock);
+    free(numerators);
+    
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+#pragma mark Matrix free
+
+PointLandscape* makePointLandscapeFromFiles(int files, const char* filenames[])
+{
+    assert(files>0);
+    assert(filenames!=NULL);
+    
+    PointLandscape* theData = malloc(sizeof(PointLandscape));
+    theData->numFields = files;
+    theData->fields = malloc(files*sizeof(PointSet*));
+    theData->numNonDiagElts = 0;
+    
+    //One pass over every distance (one triangle; they're symmetric) for the statistics
+    double total = 0, totalOfSquares = 0;
+    for(int f=0; f<files; f++)
+    {
+        PointSet* thePoints = makePointSetFromFile(filenames[f]);
+        int n = thePoints->samples;
+        float* row = allocateArrayOfFloats(n);
+        for(int i=0; i<n; i++)
+        {
+            fillDistanceSpan(thePoints, i, i+1, n, row);
+            double rowTotal = 0, rowSquares = 0;
+            for(int j=0; j<n-i-1; j++)
+            {
+                rowTotal += row[j];
+                rowSquares += (double)row[j]*row[j];
+            }
+            total += 2*rowTotal;
+            totalOfSquares += 2*rowSquares;
+        }
+        free(row);
+        theData->fields[f] = thePoints;
+        theData->numNonDiagElts += (long long)n*(n-1);
+    }
+    theData->mean = total/theData->numNonDiagElts;
+    theData->sumOfSquares = totalOfSquares - total*theData->mean;
+    return theData;
+}
+
+void freePointLandscape(PointLandscape* theData)
+{
+    if(theData==NULL) return;
+    
+    for(int f=0; f<theData->numFields; f++) freePointSet(theData->fields[f]);
+    free(theData->fields);
+    free(theData);
+}
+
+//Sum of (distance-mean)*Permute(Y) over the off-diagonal elements. Distances
+//are rebuilt a span at a time in an L1-sized buffer, so of the two matrices
+//only Y is ever read from memory.
+double sumPointsByField(PointSet* X, double mean, Field* Y, float* span);
+double sumPointsByField(PointSet* X, double mean, Field* Y, float* span)
+{
+    int n = X->samples;
+    int* p = Y->perm->index;
+    bool identity = Y->perm->isIdentity;
+    //Distances are symmetric, so a symmetric Y only needs one triangle
+    bool triangle = Y->isSymmetric;
+    float centre = mean;
+    double total = 0;
+    
+    for(int i=0; i<n; i++)
+    {
+        float* yRow = Y->element[p[i]];
+        for(int first=(triangle ? i+1 : 0); first<n; first+=DISTANCE_SPAN)
+        {
+            int last = (first+DISTANCE_SPAN<n) ? first+DISTANCE_SPAN : n;
+            fillDistanceSpan(X, i, first, last, span);
+            //Caveat: Skip main diagonal (centered distance of zero)
+            if(i>=first && i<last) span[i-first] = centre;
+            
+            float sum = 0;
+            if(identity)
+            {
+                for(int j=first; j<last; j++) sum += (span[j-first]-centre)*yRow[j];
+            } else {
+                for(int j=first; j<last; j++) sum += (span[j-first]-centre)*yRow[p[j]];
+            }
+            total += sum;
+        }
+    }
+    return triangle ? 2*total : total;
+}
+
+StatisticalData* correlatePointsAndFindP(Landscape* lPermuted,
+                                         PointLandscape* lPreserved,
+                                         int trials)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lPermuted->storage==FIELD_STORAGE_FLOAT);
+    assert(trials>0);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    theResults->correlationType = "Unset";
+    theResults->storageErrorBound = -1.0;
+    
+    modifyLandscapeMeanify(lPermuted);
+    
+    //Permuting within fields doesn't change Y's sum of squares, so both halves
+    //of the denominator are fixed before the first trial
+    double ySquares = 0;
+    for(int f=0; f<lPermuted->numFields; f++)
+    {
+        Field* Y = lPermuted->fields[f];
+        assert(Y->samples == lPreserved->fields[f]->samples);
+        for(int i=0; i<Y->samples; i++)
+        {
+            double rowSquares = 0;
+            for(int j=0; j<Y->samples; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i!=j) rowSquares += (double)Y->element[i][j]*Y->element[i][j];
+            }
+            ySquares += rowSquares;
+        }
+    }
+    double denominator = sqrt(lPreserved->sumOfSquares*ySquares);
+    
+    float* span = allocateArrayOfFloats(DISTANCE_SPAN);
+    for(int perm=0; perm<trials; perm++)
+    {
+        double numerator = 0;
+        for(int f=0; f<lPreserved->numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            modifyPermPermutify(lPermuted->fields[f]->perm, (!perm)?SEED_IDENTITY:SEED_RANDOM);
+            numerator += sumPointsByField(lPreserved->fields[f], lPreserved->mean,
+                                          lPermuted->fields[f], span);
+        }
+        theResults->listOfCorrelations->data[perm] = (FLOATIFY*numerator)/denominator;
+    }
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
+    free(span);
+    
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+#pragma mark NUMA
+
+//Parse a sysfs cpu list such as "0-3,8-11"; returns how many cpus it named
+int parseCPUList(const char* text, int* cpus, int capacity);
+int parseCPUList(const char* text, int* cpus, int capacity)
+{
+    int count = 0, first, last, used;
+    while(sscanf(text, "%d%n", &first, &used)==1)
+    {
+        text += used;
+        last = first;
+        if(*text=='-' && sscanf(text+1, "%d%n", &last, &used)==1) text += used+1;
+        for(int c=first; c<=last; c++)
+        {
+            if(cpus!=NULL && count<capacity) cpus[count] = c;
+            count++;
+        }
+        if(*text!=',') break;
+        text++;
+    }
+    return count;
+}
+
+Topology* makeTopologyFromSystem(void)
+{
+    Topology* theTopology = malloc(sizeof(Topology));
+    theTopology->numNodes = 0;
+    theTopology->numCPUs = NULL;
+    theTopology->cpus = NULL;
+    
+#ifdef __linux__
+    //One directory per node, each with the cpus it holds
+    char path[PATH_MAX];
+    char text[4096];
+    FILE* theFile;
+    for(int node=0; ; node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        theFile = fopen(path, "r");
+        if(theFile==NULL) break;
+        if(fgets(text, sizeof(text), theFile)==NULL) text[0] = '\0';
+        fclose(theFile);
+        
+        int n = theTopology->numNodes++;
+        theTopology->numCPUs = realloc(theTopology->numCPUs, theTopology->numNodes*sizeof(int));
+        theTopology->cpus = realloc(theTopology->cpus, theTopology->numNodes*sizeof(int*));
+        theTopology->numCPUs[n] = parseCPUList(text, NULL, 0);
+        theTopology->cpus[n] = allocateArrayOfInts(theTopology->numCPUs[n]+1);
+        parseCPUList(text, theTopology->cpus[n], theTopology->numCPUs[n]);
+    }
+#endif
+    
+    //No NUMA information: one node holding every cpu
+    if(theTopology->numNodes==0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        if(online<1) online = 1;
+        theTopology->numNodes = 1;
+        theTopology->numCPUs = allocateArrayOfInts(1);
+        theTopology->cpus = malloc(sizeof(int*));
+        theTopology->numCPUs[0] = (int)online;
+        theTopology->cpus[0] = allocateArrayOfInts((int)online);
+        for(int c=0; c<online; c++) theTopology->cpus[0][c] = c;
+    }
+    return theTopology;
+}
+
+void freeTopology(Topology* theTopology)
+{
+    if(theTopology==NULL) return;
+    
+    for(int n=0; n<theTopology->numNodes; n++) free(theTopology->cpus[n]);
+    free(theTopology->cpus);
+    free(theTopology->numCPUs);
+    free(theTopology);
+}
+
+int nodeForThread(Topology* theTopology, int thread, int threads)
+{
+    assert(theTopology!=NULL);
+    assert(thread>=0 && thread<threads);
+    
+    return (int)((long long)thread*theTopology->numNodes/threads);
+}
+
+bool pinThreadToNode(Topology* theTopology, int node)
+{
+    assert(theTopology!=NULL);
+    assert(node>=0 && node<theTopology->numNodes);
+    
+#ifdef __linux__
+    cpu_set_t theSet;
+    CPU_ZERO(&theSet);
+    for(int c=0; c<theTopology->numCPUs[node]; c++) CPU_SET(theTopology->cpus[node][c], &theSet);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(theSet), &theSet);
+#else
+    //No affinity API to bind to; the scheduler decides
+    return false;
+#endif
+}
+
+/**
+ * @brief Shared state for a multithreaded permutation test
+ */
+typedef struct {
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    Topology* topology;
+    Landscape** nodePreserved; /**< Copy of lPreserved local to each node (or lPreserved) */
+    Landscape** nodePermuted;  /**< Copy of lPermuted local to each node (or lPermuted) */
+    bool* isNodeReady;
+    bool replicate;
+    bool* isPinned;
+    pthread_mutex_t lock;
+    pthread_cond_t built;
+    int trials;
+    int threads;
+    unsigned int seed;
+    float* correlations;
+} TrialRun;
+
+typedef struct {
+    TrialRun* run;
+    int index;
+} TrialWorker;
+
+void* runTrialWorker(void* theWorker);
+void* runTrialWorker(void* theWorker)
+{
+    TrialRun* run = ((TrialWorker*)theWorker)->run;
+    int index = ((TrialWorker*)theWorker)->index;
+    int node = nodeForThread(run->topology, index, run->threads);
+    bool isLeader = (index==0 || nodeForThread(run->topology, index-1, run->threads)!=node);
+    
+    if(run->replicate) run->isPinned[index] = pinThreadToNode(run->topology, node);
+    
+    //First thread on each node copies the landscapes, so first touch puts them
+    //in that node's memory; the node's other threads wait for it
+    if(isLeader)
+    {
+        //Node 0 keeps the originals, which the main thread loaded
+        Landscape* preserved = run->lPreserved;
+        Landscape* permuted = run->lPermuted;
+        if(run->replicate && node>0)
+        {
+            preserved = makeLandscapeFromLandscape(run->lPreserved);
+            permuted = makeLandscapeFromLandscape(run->lPermuted);
+        }
+        pthread_mutex_lock(&run->lock);
+        run->nodePreserved[node] = preserved;
+        run->nodePermuted[node] = permuted;
+        run->isNodeReady[node] = true;
+        pthread_cond_broadcast(&run->built);
+        pthread_mutex_unlock(&run->lock);
+    } else {
+        pthread_mutex_lock(&run->lock);
+        while(!run->isNodeReady[node]) pthread_cond_wait(&run->built, &run->lock);
+        pthread_mutex_unlock(&run->lock);
+    }
+    
+    //Own permutations over the node's shared elements
+    Landscape* lPreserved = run->nodePreserved[node];
+    Landscape* lPermuted = makeLandscapeViewOfLandscape(run->nodePermuted[node]);
+    CorrelationAggregate* aCA = allocateCA();
+    RandomState theState;
+    int first = (int)((long long)index*run->trials/run->threads);
+    int last = (int)((long long)(index+1)*run->trials/run->threads);
+    
+    for(int perm=first; perm<last; perm++)
+    {
+        //Seeded per trial, so results don't depend on the thread count
+        seedRandomState(&theState, run->seed + 2654435761u*(unsigned int)perm);
+        for(int f=0; f<lPermuted->numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            modifyPermPermutify(lPermuted->fields[f]->perm, SEED_IDENTITY);
+            if(perm) modifyPermPermutifyWithState(lPermuted->fields[f]->perm, &theState);
+        }
+        run->correlations[perm] = mantelR(lPreserved, lPermuted, aCA);
+    }
+    free(aCA);
+    freeLandscape(lPermuted);
+    return NULL;
+}
+
+StatisticalData* correlateAndFindPThreaded(Landscape* lPermuted,
+                                           Landscape* lPreserved,
+                                           int trials, int threads,
+                                           unsigned int seed, bool numa)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(trials>0);
+    assert(threads>0);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    theResults->correlationType = "Unset";
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
+    {
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
+    }
+    
+    if(threads>trials) threads = trials;
+    TrialRun run;
+    run.lPreserved = lPreserved;
+    run.lPermuted = lPermuted;
+    run.topology = makeTopologyFromSystem();
+    run.nodePreserved = malloc(run.topology->numNodes*sizeof(Landscape*));
+    run.nodePermuted = malloc(run.topology->numNodes*sizeof(Landscape*));
+    run.isNodeReady = calloc(run.topology->numNodes, sizeof(bool));
+    run.isPinned = calloc(threads, sizeof(bool));
+    //Copies only pay off across nodes, and compact fields can't be copied
+    run.replicate = numa && run.topology->numNodes>1
+                 && lPreserved->storage==FIELD_STORAGE_FLOAT
+                 && lPermuted->storage==FIELD_STORAGE_FLOAT;
+    run.trials = trials;
+    run.threads = threads;
+    run.seed = seed;
+    run.correlations = theResults->listOfCorrelations->data;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.built, NULL);
+    
+    pthread_t workers[threads];
+    TrialWorker roles[threads];
+    for(int t=0; t<threads; t++)
+    {
+        roles[t].run = &run;
+        roles[t].index = t;
+        pthread_create(&workers[t], NULL, runTrialWorker, &roles[t]);
+    }
+    for(int t=0; t<threads; t++) pthread_join(workers[t], NULL);
+    
+    //Report what actually ran where
+    printf("Topology: %d node(s), %d thread(s), %s\n", run.topology->numNodes, threads,
+           run.replicate ? "landscapes replicated per node" : "landscapes shared");
+    for(int n=0; n<run.topology->numNodes; n++)
+    {
+        int firstThread = -1, lastThread = -1, pinned = 0;
+        for(int t=0; t<threads; t++)
+        {
+            if(nodeForThread(run.topology, t, threads)!=n) continue;
+            if(firstThread<0) firstThread = t;
+            lastThread = t;
+            if(run.isPinned[t]) pinned++;
+        }
+        printf("\tnode %d: %d cpu(s)", n, run.topology->numCPUs[n]);
+        if(firstThread>=0) printf(", threads %d-%d (%d pinned)", firstThread, lastThread, pinned);
+        printf("\n");
+        if(run.replicate && n>0 && run.isNodeReady[n])
+        {
+            freeLandscape(run.nodePreserved[n]);
+            freeLandscape(run.nodePermuted[n]);
+        }
+    }
+    
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.built);
+    free(run.nodePreserved);
+    free(run.nodePermuted);
+    free(run.isNodeReady);
+    free(run.isPinned);
+    freeTopology(run.topology);
+    
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+#pragma mark Work stealing
+
+/**
+ * @brief Hand-rolled barrier (pthread_barrier_t is missing on some platforms)
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t passed;
+    int parties;
+    int waiting;
+    int generation;
+} StealBarrier;
+
+void waitAtBarrier(StealBarrier* theBarrier);
+void waitAtBarrier(StealBarrier* theBarrier)
+{
+    pthread_mutex_lock(&theBarrier->lock);
+    int generation = theBarrier->generation;
+    if(++theBarrier->waiting == theBarrier->parties)
+    {
+        theBarrier->waiting = 0;
+        theBarrier->generation++;
+        pthread_cond_broadcast(&theBarrier->passed);
+    } else {
+        while(generation == theBarrier->generation)
+            pthread_cond_wait(&theBarrier->passed, &theBarrier->lock);
+    }
+    pthread_mutex_unlock(&theBarrier->lock);
+}
+
+FieldTask* makeFieldTasksFromLandscape(Landscape* theData, int* numTasks)
+{
+    assert(theData!=NULL);
+    assert(numTasks!=NULL);
+    
+    long long target = STEAL_TASK_ELEMENTS;
+    
+    //Upper bound: every field split to the row, plus one per field
+    int capacity = theData->numFields;
+    for(int f=0; f<theData->numFields; f++) capacity += theData->fields[f]->samples;
+    FieldTask* theTasks = malloc(capacity*sizeof(FieldTask));
+    int count = 0;
+    long long pending = 0;
+    
+    for(int f=0; f<theData->numFields; f++)
+    {
+        int n = theData->fields[f]->samples;
+        //Symmetric fields only visit the upper triangle
+        bool triangle = theData->fields[f]->isSymmetric;
+        long long weight = triangle ? (long long)n*(n-1)/2 : (long long)n*n;
+        if(weight<=target)
+        {
+            //Small fields ride together until the task is heavy enough
+            if(pending==0 || pending+weight>target)
+            {
+                theTasks[count].firstField = f;
+                theTasks[count].firstRow = 0;
+                theTasks[count].lastRow = n;
+                theTasks[count].weight = 0;
+                count++;
+                pending = 0;
+            }
+            theTasks[count-1].lastField = f+1;
+            theTasks[count-1].weight += weight;
+            pending += weight;
+        } else {
+            //Large fields split into row blocks of about the target weight;
+            //triangle rows shorten as they go, so later blocks take more of them
+            int r = 0, end;
+            long long blockWeight;
+            while(r<n)
+            {
+                end = r;
+                blockWeight = 0;
+                while(end<n && blockWeight<target)
+                {
+                    blockWeight += triangle ? n-1-end : n;
+                    end++;
+                }
+                theTasks[count].firstField = f;
+                theTasks[count].lastField = f+1;
+                theTasks[count].firstRow = r;
+                theTasks[count].lastRow = end;
+                theTasks[count].weight = blockWeight;
+                count++;
+                r = end;
+            }
+            pending = 0;
+        }
+    }
+    *numTasks = count;
+    return theTasks;
+}
+
+/**
+ * @brief Shared state for a work-stealing permutation test
+ */
+typedef struct {
+    Landscape* lPreserved;
+    Landscape** views;   /**< One view of lPermuted per trial in a block */
+    FieldTask* tasks;
+    int numTasks;
+    uint64_t* ranges;    /**< Per worker: next unit in the high word, end in the low word */
+    int* firstTasks;     /**< Task each worker's range starts at */
+    CorrelationAggregate* partials; /**< Per task, per trial in the block */
+    StealBarrier barrier;
+    int trials;
+    int threads;
+    int blockTrials;
+    unsigned int seed;
+    float* correlations;
+    long long* tasksRun; /**< Per worker */
+    long long* tasksStolen; /**< Per worker */
+} StealRun;
+
+typedef struct {
+    StealRun* run;
+    int index;
+} StealWorker;
+
+//Work is handed out in units of one task for one trial of the block, task-major.
+//Owner takes from the front of its range
+int popFieldTask(uint64_t* range);
+int popFieldTask(uint64_t* range)
+{
+    uint64_t old = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+    uint32_t head, tail;
+    do {
+        head = (uint32_t)(old>>32);
+        tail = (uint32_t)old;
+        if(head>=tail) return -1;
+    } while(!__atomic_compare_exchange_n(range, &old, ((uint64_t)(head+1)<<32)|tail,
+                                         false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return (int)head;
+}
+
+//Thieves take from the back, leaving the owner its next tasks
+int stealFieldTask(uint64_t* range);
+int stealFieldTask(uint64_t* range)
+{
+    uint64_t old = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+    uint32_t head, tail;
+    do {
+        head = (uint32_t)(old>>32);
+        tail = (uint32_t)old;
+        if(head>=tail) return -1;
+    } while(!__atomic_compare_exchange_n(range, &old, ((uint64_t)head<<32)|(tail-1),
+                                         false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return (int)(tail-1);
+}
+
+void runFieldTask(StealRun* run, int unit, int count);
+void runFieldTask(StealRun* run, int unit, int count)
+{
+    int task = unit/count;
+    int b = unit%count;
+    FieldTask* theTask = &run->tasks[task];
+    CorrelationAggregate* theCA = &run->partials[(size_t)task*run->blockTrials+b];
+    initializeCA(theCA);
+    for(int f=theTask->firstField; f<theTask->lastField; f++)
+    {
+        Field* X = run->lPreserved->fields[f];
+        Field* Y = run->views[b]->fields[f];
+        if(theTask->lastField-theTask->firstField>1)
+            augmentCAByFields(theCA, X, Y);
+        else
+            augmentCAByFieldRows(theCA, X, Y, theTask->firstRow, theTask->lastRow);
+    }
+}
+
+//Give each worker back its starting share, for a block of count trials
+void resetStealRanges(StealRun* run, int count);
+void resetStealRanges(StealRun* run, int count)
+{
+    for(int w=0; w<run->threads; w++)
+    {
+        int end = (w+1<run->threads) ? run->firstTasks[w+1] : run->numTasks;
+        __atomic_store_n(&run->ranges[w], 
+                         ((uint64_t)(run->firstTasks[w]*count)<<32)|(uint32_t)(end*count),
+                         __ATOMIC_RELEASE);
+    }
+}
+
+void* runStealWorker(void* theWorker);
+void* runStealWorker(void* theWorker)
+{
+    StealRun* run = ((StealWorker*)theWorker)->run;
+    int me = ((StealWorker*)theWorker)->index;
+    RandomState theState;
+    int task;
+    
+    for(int first=0; first<run->trials; first+=run->blockTrials)
+    {
+        int count = (run->trials-first<run->blockTrials) ? run->trials-first : run->blockTrials;
+        
+        //Everyone shuffles a share of the block's trials, seeded per trial
+        for(int b=me; b<count; b+=run->threads)
+        {
+            Landscape* theView = run->views[b];
+            seedRandomState(&theState, run->seed + 2654435761u*(unsigned int)(first+b));
+            for(int f=0; f<theView->numFields; f++)
+            {
+                //Identity permutation the first time through, random the rest
+                modifyPermPermutify(theView->fields[f]->perm, SEED_IDENTITY);
+                if(first+b) modifyPermPermutifyWithState(theView->fields[f]->perm, &theState);
+            }
+        }
+        waitAtBarrier(&run->barrier);
+        
+        //Own tasks first, then take from the back of everyone else's
+        while((task = popFieldTask(&run->ranges[me]))>=0)
+        {
+            runFieldTask(run, task, count);
+            run->tasksRun[me]++;
+        }
+        for(int v=1; v<run->threads; v++)
+        {
+            int victim = (me+v)%run->threads;
+            while((task = stealFieldTask(&run->ranges[victim]))>=0)
+            {
+                runFieldTask(run, task, count);
+                run->tasksRun[me]++;
+                run->tasksStolen[me]++;
+            }
+        }
+        waitAtBarrier(&run->barrier);
+        
+        //Fixed reduction order, so the schedule can't change the sums
+        if(me==0)
+        {
+            CorrelationAggregate theCA;
+            for(int b=0; b<count; b++)
+            {
+                initializeCA(&theCA);
+                for(int t=0; t<run->numTasks; t++)
+                {
+                    CorrelationAggregate* part = &run->partials[(size_t)t*run->blockTrials+b];
+                    theCA.numerator += part->numerator;
+                    theCA.denominatorL += part->denominatorL;
+                    theCA.denominatorR += part->denominatorR;
+                }
+                run->correlations[first+b] = finishCorrelation(&theCA);
+            }
+            int next = run->trials-first-count;
+            if(next>0) resetStealRanges(run, (next<run->blockTrials) ? next : run->blockTrials);
+        }
+    }
+    return NULL;
+}
+
+StatisticalData* correlateAndFindPStealing(Landscape* lPermuted,
+                                           Landscape* lPreserved,
+                                           int trials, int threads,
+                                           unsigned int seed)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(trials>0);
+    assert(threads>0);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    theResults->correlationType = "Unset";
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
+    {
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
+    }
+    
+    StealRun run;
+    run.lPreserved = lPreserved;
+    run.tasks = makeFieldTasksFromLandscape(lPreserved, &run.numTasks);
+    run.trials = trials;
+    run.threads = threads;
+    run.blockTrials = (trials<STEAL_BLOCK_TRIALS) ? trials : STEAL_BLOCK_TRIALS;
+    run.seed = seed;
+    run.correlations = theResults->listOfCorrelations->data;
+    run.views = malloc(run.blockTrials*sizeof(Landscape*));
+    for(int b=0; b<run.blockTrials; b++) run.views[b] = makeLandscapeViewOfLandscape(lPermuted);
+    run.partials = malloc((size_t)run.numTasks*run.blockTrials*sizeof(CorrelationAggregate));
+    run.ranges = malloc(threads*sizeof(uint64_t));
+    run.firstTasks = allocateArrayOfInts(threads);
+    run.tasksRun = calloc(threads, sizeof(long long));
+    run.tasksStolen = calloc(threads, sizeof(long long));
+    
+    //Start each worker on an equal share of the weight
+    long long total = 0, sofar = 0;
+    for(int t=0; t<run.numTasks; t++) total += run.tasks[t].weight;
+    int w = 0;
+    run.firstTasks[0] = 0;
+    for(int t=0; t<run.numTasks; t++)
+    {
+        while(w+1<threads && sofar >= total*(w+1)/threads) run.firstTasks[++w] = t;
+        sofar += run.tasks[t].weight;
+    }
+    while(w+1<threads) run.firstTasks[++w] = run.numTasks;
+    resetStealRanges(&run, run.blockTrials);
+    
+    pthread_mutex_init(&run.barrier.lock, NULL);
+    pthread_cond_init(&run.barrier.passed, NULL);
+    run.barrier.parties = threads;
+    run.barrier.waiting = 0;
+    run.barrier.generation = 0;
+    
+    pthread_t workers[threads];
+    StealWorker roles[threads];
+    for(int t=0; t<threads; t++)
+    {
+        roles[t].run = &run;
+        roles[t].index = t;
+        pthread_create(&workers[t], NULL, runStealWorker, &roles[t]);
+    }
+    for(int t=0; t<threads; t++) pthread_join(workers[t], NULL);
+    
+    printf("Work stealing: %d task(s) over %d field(s), %d thread(s)\n", 
+           run.numTasks, lPreserved->numFields, threads);
+    for(int t=0; t<threads; t++)
+        printf("\tthread %d: %lld task runs, %lld stolen\n", t, run.tasksRun[t], run.tasksStolen[t]);
+    
+    pthread_mutex_destroy(&run.barrier.lock);
+    pthread_cond_destroy(&run.barrier.passed);
+    for(int b=0; b<run.blockTrials; b++) freeLandscape(run.views[b]);
+    free(run.views);
+    free(run.tasks);
+    free(run.partials);
+    free(run.ranges);
+    free(run.firstTasks);
+    free(run.tasksRun);
+    free(run.tasksStolen);
+    
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+#pragma mark Pipeline
+
+PermRing* makePermRing(int capacity, int slotInts)
+{
+    assert(capacity>0);
+    assert(slotInts>0);
+    
+    PermRing* theRing = malloc(sizeof(PermRing));
+    theRing->capacity = capacity;
+    theRing->slotInts = slotInts;
+    theRing->slots = allocateArrayOfInts(capacity*slotInts);
+    theRing->trialOf = allocateArrayOfInts(capacity);
+    theRing->head = 0;
+    theRing->tail = 0;
+    return theRing;
+}
+
+void freePermRing(PermRing* theRing)
+{
+    if(theRing==NULL) return;
+    
+    free(theRing->slots);
+    free(theRing->trialOf);
+    free(theRing);
+}
+
+int* reservePermSlot(PermRing* theRing)
+{
+    assert(theRing!=NULL);
+    
+    uint64_t head = __atomic_load_n(&theRing->head, __ATOMIC_ACQUIRE);
+    if(theRing->tail-head >= (uint64_t)theRing->capacity) return NULL;
+    return theRing->slots + (theRing->tail%theRing->capacity)*theRing->slotInts;
+}
+
+void publishPermSlot(PermRing* theRing, int trial)
+{
+    assert(theRing!=NULL);
+    
+    theRing->trialOf[theRing->tail%theRing->capacity] = trial;
+    __atomic_store_n(&theRing->tail, theRing->tail+1, __ATOMIC_RELEASE);
+}
+
+int* peekPermSlot(PermRing* theRing, int* trial)
+{
+    assert(theRing!=NULL);
+    assert(trial!=NULL);
+    
+    uint64_t tail = __atomic_load_n(&theRing->tail, __ATOMIC_ACQUIRE);
+    if(theRing->head==tail) return NULL;
+    *trial = theRing->trialOf[theRing->head%theRing->capacity];
+    return theRing->slots + (theRing->head%theRing->capacity)*theRing->slotInts;
+}
+
+void releasePermSlot(PermRing* theRing)
+{
+    assert(theRing!=NULL);
+    
+    __atomic_store_n(&theRing->head, theRing->head+1, __ATOMIC_RELEASE);
+}
+
+double secondsNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9*now.tv_nsec;
+}
+
+/**
+ * @brief Shared state for a pipelined permutation test
+ */
+typedef struct {
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    PermRing** rings;  /**< One per consumer, each fed by a single generator */
+    int trials;
+    int consumers;
+    int generators;
+    unsigned int seed;
+    float* correlations;
+    double* busy;      /**< Seconds spent working, generators then consumers */
+} PipelineRun;
+
+typedef struct {
+    PipelineRun* run;
+    int index;
+} PipelineWorker;
+
+//Consumer c takes trials c, c+consumers, ...; generator g feeds consumers g, g+generators, ...
+void* runPermGenerator(void* theWorker);
+void* runPermGenerator(void* theWorker)
+{
+    PipelineRun* run = ((PipelineWorker*)theWorker)->run;
+    int me = ((PipelineWorker*)theWorker)->index;
+    int numFields = run->lPermuted->numFields;
+    int next[run->consumers];
+    int remaining = 0;
+    RandomState theState;
+    Perm thePerm;
+    int* slot;
+    double started;
+    
+    for(int c=me; c<run->consumers; c+=run->generators)
+    {
+        next[c] = c;
+        if(c<run->trials) remaining += (run->trials-1-c)/run->consumers+1;
+    }
+    //Round-robin over our consumers, skipping any whose ring is full
+    while(remaining>0)
+    {
+        bool produced = false;
+        for(int c=me; c<run->consumers; c+=run->generators)
+        {
+            if(next[c]>=run->trials) continue;
+            slot = reservePermSlot(run->rings[c]);
+            if(slot==NULL) continue;
+            
+            started = secondsNow();
+            int trial = next[c];
+            //Seeded per trial, so results don't depend on the thread count
+            seedRandomState(&theState, run->seed + 2654435761u*(unsigned int)trial);
+            for(int f=0; f<numFields; f++)
+            {
+                thePerm.size = run->lPermuted->fields[f]->samples;
+                thePerm.index = slot;
+                //Identity permutation the first time through, random the rest
+                modifyPermPermutify(&thePerm, SEED_IDENTITY);
+                if(trial) modifyPermPermutifyWithState(&thePerm, &theState);
+                slot += thePerm.size;
+            }
+            publishPermSlot(run->rings[c], trial);
+            run->busy[me] += secondsNow()-started;
+            
+            next[c] += run->consumers;
+            remaining--;
+            produced = true;
+        }
+        if(!produced) sched_yield();
+    }
+    return NULL;
+}
+
+void* runPermConsumer(void* theWorker);
+void* runPermConsumer(void* theWorker)
+{
+    PipelineRun* run = ((PipelineWorker*)theWorker)->run;
+    int me = ((PipelineWorker*)theWorker)->index;
+    PermRing* theRing = run->rings[me];
+    Landscape* lPermuted = makeLandscapeViewOfLandscape(run->lPermuted);
+    int numFields = lPermuted->numFields;
+    int* owned[numFields];
+    CorrelationAggregate* aCA = allocateCA();
+    int* slot;
+    int trial;
+    double started;
+    
+    for(int f=0; f<numFields; f++) owned[f] = lPermuted->fields[f]->perm->index;
+    for(int done=me; done<run->trials; done+=run->consumers)
+    {
+        while((slot = peekPermSlot(theRing, &trial))==NULL) sched_yield();
+        
+        started = secondsNow();
+        //Read the permutations straight out of the ring
+        for(int f=0; f<numFields; f++)
+        {
+            lPermuted->fields[f]->perm->index = slot;
+            lPermuted->fields[f]->perm->isIdentity = (trial==0);
+            slot += lPermuted->fields[f]->samples;
+        }
+        run->correlations[trial] = mantelR(run->lPreserved, lPermuted, aCA);
+        releasePermSlot(theRing);
+        run->busy[run->generators+me] += secondsNow()-started;
+    }
+    
+    for(int f=0; f<numFields; f++)
+    {
+        lPermuted->fields[f]->perm->index = owned[f];
+        modifyPermPermutify(lPermuted->fields[f]->perm, SEED_IDENTITY);
+    }
+    freeLandscape(lPermuted);
+    free(aCA);
+    return NULL;
+}
+
+StatisticalData* correlateAndFindPPipelined(Landscape* lPermuted,
+                                            Landscape* lPreserved,
+                                            int trials, int consumers, int generators,
+                                            unsigned int seed)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(trials>0);
+    assert(consumers>0);
+    assert(generators>0);
+    
+    StatisticalData* theResults=allocateStatData();
+    theResults->listOfCorrelations = allocateList();
+    theResults->listOfCorrelations->count = trials;
+    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
+    theResults->correlationType = "Unset";
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
+    {
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
+    }
+    
+    if(consumers>trials) consumers = trials;
+    if(generators>consumers) generators = consumers;
+    int slotInts = 0;
+    for(int f=0; f<lPermuted->numFields; f++) slotInts += lPermuted->fields[f]->samples;
+    
+    PipelineRun run;
+    run.lPreserved = lPreserved;
+    run.lPermuted = lPermuted;
+    run.trials = trials;
+    run.consumers = consumers;
+    run.generators = generators;
+    run.seed = seed;
+    run.correlations = theResults->listOfCorrelations->data;
+    run.busy = calloc(generators+consumers, sizeof(double));
+    run.rings = malloc(consumers*sizeof(PermRing*));
+    for(int c=0; c<consumers; c++) run.rings[c] = makePermRing(PIPELINE_RING_SLOTS, slotInts);
+    
+    pthread_t workers[generators+consumers];
+    PipelineWorker roles[generators+consumers];
+    double started = secondsNow();
+    for(int t=0; t<generators+consumers; t++)
+    {
+        roles[t].run = &run;
+        roles[t].index = (t<generators) ? t : t-generators;
+        pthread_create(&workers[t], NULL, (t<generators) ? runPermGenerator : runPermConsumer,
+                       &roles[t]);
+    }
+    for(int t=0; t<generators+consumers; t++) pthread_join(workers[t], NULL);
+    double elapsed = secondsNow()-started;
+    
+    //Share of the run each side spent working rather than waiting on the other
+    double generating = 0, consuming = 0;
+    for(int t=0; t<generators; t++) generating += run.busy[t];
+    for(int t=0; t<consumers; t++) consuming += run.busy[generators+t];
+    printf("Pipeline: %d generator(s) %.0f%% busy, %d consumer(s) %.0f%% busy over %.3fs\n",
+           generators, 100*generating/(generators*elapsed),
+           consumers, 100*consuming/(consumers*elapsed), elapsed);
+    
+    for(int c=0; c<consumers; c++) freePermRing(run.rings[c]);
+    free(run.rings);
+    free(run.busy);
+    
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
+    modifyListSortify(theResults->listOfCorrelations);
+    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
+                                             theResults->listOfCorrelations, 
+                                             NULL);
+    return theResults;
+}
+
+
+#pragma mark All pairs
+PairwiseData* allocatePairwiseData(void)
+{
+    return malloc(sizeof(PairwiseData));
+}
+
+void freePairwiseData(PairwiseData* theData)
+{
+    if(theData==NULL) return;
+    for(int i=0; i<theData->numScapes; i++)
+    {
+        free(theData->correlation[i]);
+        free(theData->pValue[i]);
+    }
+    free(theData->correlation);
+    free(theData->pValue);
+    free(theData);
+}
+
+float** allocateSquareOfFloats(int size);
+float** allocateSquareOfFloats(int size)
+{
+    float** theSquare = allocateArrayOfArraysOfFloats(size);
+    for(int i=0; i<size; i++)
+    {
+        theSquare[i] = allocateArrayOfFloats(size);
+    }
+    return theSquare;
+}
+
+float sumOfSquaresInLandscape(Landscape* theData);
+float sumOfSquaresInLandscape(Landscape* theData)
+{
+    assert(theData!=NULL);
+    
+    float theTotal = 0.0;
+    float fieldTotal;
+    Field* theField;
+    for(int f=0; f<theData->numFields; f++)
+    {
+        theField = theData->fields[f];
+        fieldTotal = 0.0;
+        for(int x=0; x<theField->samples; x++)
+        {
+            //Symmetric fields: upper triangle, counted twice
+            for(int y=(theField->isSymmetric ? x+1 : 0); y<theField->samples; y++)
+            {
+                //Caveat: Skip main diagonal
+                if(x!=y) fieldTotal += theField->element[x][y]*theField->element[x][y];
+            }
+        }
+        theTotal += theField->isSymmetric ? 2*fieldTotal : fieldTotal;
+    }
+    return theTotal;
+}
+
+bool areFieldsSymmetric(int count, Field* fields[]);
+bool areFieldsSymmetric(int count, Field* fields[])
+{
+    for(int c=0; c<count; c++)
+    {
+        if(!fields[c]->isSymmetric) return false;
+    }
+    return true;
+}
+
+//With triangle set, only the part above the diagonal is filled in
+void gatherPermutedField(float* gathered, Field* theField, Perm* thePerm, bool triangle);
+void gatherPermutedField(float* gathered, Field* theField, Perm* thePerm, bool triangle)
+{
+    assert(gathered!=NULL);
+    assert(theField!=NULL);
+    assert(thePerm!=NULL);
+    
+    int n = theField->samples;
+    float* fromRow;
+    for(int i=0; i<n; i++)
+    {
+        fromRow = theField->element[thePerm->index[i]];
+        if(thePerm->isIdentity)
+        {
+            //Unpermuted (the first trial): rows copy straight across
+            memcpy(gathered+i*n, fromRow, n*sizeof(float));
+        } else {
+            for(int j=(triangle ? i+1 : 0); j<n; j++)
+            {
+                gathered[i*n+j] = fromRow[thePerm->index[j]];
+            }
+        }
+        //Main diagonal never counts, so zero it out of every dot product
+        gathered[i*n+i] = 0.0;
+    }
+}
+
+//With triangle set, rows start past the diagonal and count twice
+void augmentTotalsByGatheredField(float* totals, int count, Field* partners[], float* gathered,
+                                  bool triangle);
+void augmentTotalsByGatheredField(float* totals, int count, Field* partners[], float* gathered,
+                                  bool triangle)
+{
+    assert(totals!=NULL);
+    assert(partners!=NULL);
+    assert(gathered!=NULL);
+    
+    int n = partners[0]->samples;
+    float rowTotal, weight = triangle ? 2 : 1;
+    float *gatheredRow, *partnerRow;
+    int start;
+    for(int i=0; i<n; i++)
+    {
+        //Gathered row stays in cache while every partner visits it
+        gatheredRow = gathered+i*n;
+        start = triangle ? i+1 : 0;
+        for(int c=0; c<count; c++)
+        {
+            partnerRow = partners[c]->element[i];
+            rowTotal = 0.0;
+            for(int j=start; j<n; j++) rowTotal += partnerRow[j]*gatheredRow[j];
+            totals[c] += weight*rowTotal;
+        }
+    }
+}
+
+PairwiseData* correlateAllPairsAndFindP(int numScapes, Landscape* scapes[], int trials)
+{
+    assert(numScapes>1);
+    assert(scapes!=NULL);
+    assert(trials>0);
+    
+    int numFields = scapes[0]->numFields;
+    for(int m=0; m<numScapes; m++)
+    {
+        assert(scapes[m]->numFields == numFields);
+        assert(scapes[m]->storage == FIELD_STORAGE_FLOAT);
+        for(int f=0; f<numFields; f++)
+            assert(scapes[m]->fields[f]->samples == scapes[0]->fields[f]->samples);
+        modifyLandscapeMeanify(scapes[m]);
+    }
+    
+    PairwiseData* theResults = allocatePairwiseData();
+    theResults->correlationType = "Unset";
+    theResults->numScapes = numScapes;
+    theResults->trials = trials;
+    theResults->correlation = allocateSquareOfFloats(numScapes);
+    theResults->pValue = allocateSquareOfFloats(numScapes);
+    float** numerator = allocateSquareOfFloats(numScapes);
+    //Counted exactly; a float count stops growing past 2^24 trials
+    long long* atLeast = calloc((size_t)numScapes*numScapes, sizeof(long long));
+    assert(atLeast!=NULL);
+    
+    //Denominators don't depend on the permutation, so find them once
+    float* sumOfSquares = allocateArrayOfFloats(numScapes);
+    for(int m=0; m<numScapes; m++) sumOfSquares[m] = sumOfSquaresInLandscape(scapes[m]);
+    
+    //One permutation per field, shared by every landscape
+    Perm** perms = malloc(numFields*sizeof(Perm*));
+    float** gathered = allocateArrayOfArraysOfFloats(numFields);
+    int n;
+    for(int f=0; f<numFields; f++)
+    {
+        n = scapes[0]->fields[f]->samples;
+        perms[f] = makePerm(n, SEED_IDENTITY);
+        gathered[f] = allocateArrayOfFloats(n*n);
+    }
+    
+    float currentCor;
+    bool triangle;
+    Field* partners[numScapes];
+    for(int perm=0; perm<trials; perm++)
+    {
+        //Identity permutation the first time through, random the rest
+        for(int f=0; f<numFields; f++)
+        {
+            modifyPermPermutify(perms[f], (!perm)?SEED_IDENTITY:SEED_RANDOM);
+        }
+        for(int a=0; a<numScapes; a++)
+            for(int b=0; b<numScapes; b++) numerator[a][b] = 0.0;
+        
+        for(int b=1; b<numScapes; b++)
+        {
+            //Permute landscape b once, then reuse it against every partner
+            for(int f=0; f<numFields; f++)
+            {
+                for(int a=0; a<b; a++) partners[a] = scapes[a]->fields[f];
+                triangle = scapes[b]->fields[f]->isSymmetric && areFieldsSymmetric(b, partners);
+                gatherPermutedField(gathered[f], scapes[b]->fields[f], perms[f], triangle);
+                augmentTotalsByGatheredField(numerator[b], b, partners, gathered[f], triangle);
+            }
+        }
+        
+        for(int b=1; b<numScapes; b++)
+        {
+            for(int a=0; a<b; a++)
+            {
+                currentCor = (FLOATIFY*numerator[b][a])/sqrt(sumOfSquares[a]*sumOfSquares[b]);
+                //Store the first result specially
+                if(!perm) theResults->correlation[a][b] = currentCor;
+                if(currentCor >= theResults->correlation[a][b]) atLeast[a*numScapes+b]++;
+            }
+        }
+    }
+    
+    //Fill in the redundant triangle and the trivial diagonal
+    for(int a=0; a<numScapes; a++)
+    {
+        theResults->correlation[a][a] = 1.0;
+        theResults->pValue[a][a] = 0.0;
+        for(int b=a+1; b<numScapes; b++)
+        {
+            theResults->pValue[a][b] = (double)atLeast[a*numScapes+b]/trials;
+            theResults->correlation[b][a] = theResults->correlation[a][b];
+            theResults->pValue[b][a] = theResults->pValue[a][b];
+        }
+    }
+    
+    for(int f=0; f<numFields; f++)
+    {
+        free(perms[f]->index);
+        free(perms[f]);
+        free(gathered[f]);
+    }
+    for(int m=0; m<numScapes; m++) free(numerator[m]);
+    free(perms);
+    free(gathered);
+    free(numerator);
+    free(atLeast);
+    free(sumOfSquares);
+    return theResults;
+}
+
+void saveSquareToTDV(const char* filename, float** theSquare, int size);
+void saveSquareToTDV(const char* filename, float** theSquare, int size)
+{
+    assert(theSquare!=NULL);
+    FILE* fout = fopen(filename, "w");
+    assert(fout!=NULL);
+    for(int i=0; i<size; i++)
+    {
+        for(int j=0; j<size; j++)
+        {
+            fprintf(fout, "%f", theSquare[i][j]);
+            if(j<size-1) fprintf(fout, "\t");
+        }
+        fprintf(fout, "\n");
+    }
+    fclose(fout);
+}
+
+void savePairwiseData(PairwiseData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.AllPairs.r.tdv", 
+            timestamp, dataToSave->correlationType);
+    saveSquareToTDV(fname, dataToSave->correlation, dataToSave->numScapes);
+    sprintf(fname, "testinfo.%d.%s.AllPairs.p.tdv", 
+            timestamp, dataToSave->correlationType);
+    saveSquareToTDV(fname, dataToSave->pValue, dataToSave->numScapes);
+}
+
+void processAllPairs(int trials, int filesets, const char* argv[], int timestamp,
+                     RunOptions* options)
+{
+    assert(options!=NULL);
+    assert(options->allPairs>1);
+    
+    int numScapes = options->allPairs;
+    int firstFile = 2;
+    const char* names[filesets];
+    Landscape* scapes[numScapes];
+    
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+        printf("Note: compact storage isn't used in all-pairs mode.\n");
+    
+    //Load data: each field's files are listed landscape by landscape
+    for(int m=0; m<numScapes; m++)
+    {
+        for(int i=0; i<filesets; i++)
+        {
+            names[i] = argv[numScapes*i+firstFile+m];
+        }
+        scapes[m] = makeLandscapeFromTDVs(filesets, names);
+    }
+    
+    PairwiseData* thePairs = NULL;
+    
+    //Pearson correlation
+    thePairs = correlateAllPairsAndFindP(numScapes, scapes, trials);
+    thePairs->correlationType = "Pearson";
+    savePairwiseData(thePairs, timestamp);
+    freePairwiseData(thePairs);
+    
+    //Rank data
+    for(int m=0; m<numScapes; m++) modifyLandscapeRankify(scapes[m]);
+    
+    //Spearman correlation
+    thePairs = correlateAllPairsAndFindP(numScapes, scapes, trials);
+    thePairs->correlationType = "Spearman";
+    savePairwiseData(thePairs, timestamp);
+    freePairwiseData(thePairs);
+    
+    for(int m=0; m<numScapes; m++) freeLandscape(scapes[m]);
+}
+
+
+#pragma mark One vs many
+CandidateData* allocateCandidateData(void)
+{
+    return malloc(sizeof(CandidateData));
+}
+
+CandidateData* correlateOneVsManyAndFindP(Landscape* lPreserved, int numCandidates,
+                                          Landscape* candidates[], int trials, int seed)
+{
+    assert(lPreserved!=NULL);
+    assert(candidates!=NULL);
+    assert(numCandidates>0);
+    assert(trials>0);
+    assert(lPreserved->storage == FIELD_STORAGE_FLOAT);
+    
+    int numFields = lPreserved->numFields;
+    modifyLandscapeMeanify(lPreserved);
+    for(int c=0; c<numCandidates; c++)
+    {
+        assert(candidates[c]->numFields == numFields);
+        assert(candidates[c]->storage == FIELD_STORAGE_FLOAT);
+        for(int f=0; f<numFields; f++)
+            assert(candidates[c]->fields[f]->samples == lPreserved->fields[f]->samples);
+        modifyLandscapeMeanify(candidates[c]);
+    }
+    
+    CandidateData* theResults = allocateCandidateData();
+    theResults->correlationType = "Unset";
+    theResults->numCandidates = numCandidates;
+    theResults->trials = trials;
+    theResults->correlation = allocateArrayOfFloats(numCandidates);
+    theResults->pValue = allocateArrayOfFloats(numCandidates);
+    
+    //Denominators don't depend on the permutation, so find them once
+    float preservedSumOfSquares = sumOfSquaresInLandscape(lPreserved);
+    float* sumOfSquares = allocateArrayOfFloats(numCandidates);
+    float* numerator = allocateArrayOfFloats(numCandidates);
+    //Counted exactly; a float count stops growing past 2^24 trials
+    long long* atLeast = calloc(numCandidates, sizeof(long long));
+    assert(atLeast!=NULL);
+    for(int c=0; c<numCandidates; c++) sumOfSquares[c] = sumOfSquaresInLandscape(candidates[c]);
+    
+    //Relabeling the preserved side has the same null distribution as relabeling
+    //each candidate, but only needs one gather per field per trial.
+    Perm** perms = malloc(numFields*sizeof(Perm*));
+    float** gathered = allocateArrayOfArraysOfFloats(numFields);
+    int n;
+    for(int f=0; f<numFields; f++)
+    {
+        n = lPreserved->fields[f]->samples;
+        perms[f] = makePerm(n, SEED_IDENTITY);
+        gathered[f] = allocateArrayOfFloats(n*n);
+    }
+    
+    if(seed>0) seedRandom(seed);
+    float currentCor;
+    bool triangle;
+    Field* partners[numCandidates];
+    for(int perm=0; perm<trials; perm++)
+    {
+        for(int c=0; c<numCandidates; c++) numerator[c] = 0.0;
+        for(int f=0; f<numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            modifyPermPermutify(perms[f], (!perm)?SEED_IDENTITY:SEED_RANDOM);
+            for(int c=0; c<numCandidates; c++) partners[c] = candidates[c]->fields[f];
+            triangle = lPreserved->fields[f]->isSymmetric && areFieldsSymmetric(numCandidates, partners);
+            gatherPermutedField(gathered[f], lPreserved->fields[f], perms[f], triangle);
+            augmentTotalsByGatheredField(numerator, numCandidates, partners, gathered[f], triangle);
+        }
+        
+        for(int c=0; c<numCandidates; c++)
+        {
+            currentCor = (FLOATIFY*numerator[c])/sqrt(preservedSumOfSquares*sumOfSquares[c]);
+            //Store the first result specially
+            if(!perm) theResults->correlation[c] = currentCor;
+            if(currentCor >= theResults->correlation[c]) atLeast[c]++;
+        }
+    }
+    for(int c=0; c<numCandidates; c++) theResults->pValue[c] = (double)atLeast[c]/trials;
+    free(atLeast);
+    
+    for(int f=0; f<numFields; f++)
+    {
+        free(perms[f]->index);
+        free(perms[f]);
+        free(gathered[f]);
+    }
+    free(perms);
+    free(gathered);
+    free(numerator);
+    free(sumOfSquares);
+    return theResults;
+}
+
+void freeCandidateData(CandidateData* theData);
+void freeCandidateData(CandidateData* theData)
+{
+    if(theData==NULL) return;
+    free(theData->correlation);
+    free(theData->pValue);
+    free(theData);
+}
+
+void processOneVsMany(int trials, int filesets, const char* argv[], int timestamp,
+                      RunOptions* options)
+{
+    assert(options!=NULL);
+    assert(options->oneVsMany>0);
+    
+    int numCandidates = options->oneVsMany;
+    int batchSize = (options->batchSize>0) ? options->batchSize : numCandidates;
+    int groupSize = numCandidates+1;
+    int firstFile = 2;
+    const char* names[filesets];
+    Landscape* batch[batchSize];
+    
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+        printf("Note: compact storage isn't used in one-vs-many mode.\n");
+    
+    //Prepare the preserved landscape once for each correlation type
+    for(int i=0; i<filesets; i++) names[i] = argv[groupSize*i+firstFile];
+    Landscape* lPearson = makeLandscapeFromTDVs(filesets, names);
+    Landscape* lSpearman = makeLandscapeFromLandscape(lPearson);
+    modifyLandscapeMeanify(lPearson);
+    modifyLandscapeRankify(lSpearman);
+    modifyLandscapeMeanify(lSpearman);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.OneVsMany.tdv", timestamp);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "Candidate\tPearson\tPearson p\tSpearman\tSpearman p\n");
+    
+    CandidateData *thePearson, *theSpearman;
+    int count;
+    //Stream candidates through in batches; every batch restarts the same permutations
+    for(int start=0; start<numCandidates; start+=batchSize)
+    {
+        count = numCandidates-start;
+        if(count>batchSize) count = batchSize;
+        
+        for(int c=0; c<count; c++)
+        {
+            for(int i=0; i<filesets; i++) names[i] = argv[groupSize*i+firstFile+1+start+c];
+            batch[c] = makeLandscapeFromTDVs(filesets, names);
+        }
+        
+        thePearson = correlateOneVsManyAndFindP(lPearson, count, batch, trials, timestamp);
+        for(int c=0; c<count; c++) modifyLandscapeRankify(batch[c]);
+        theSpearman = correlateOneVsManyAndFindP(lSpearman, count, batch, trials, timestamp);
+        
+        for(int c=0; c<count; c++)
+        {
+            //Candidates are named after their first field's file
+            fprintf(output, "%s\t%f\t%f\t%f\t%f\n", argv[firstFile+1+start+c],
+                    thePearson->correlation[c], thePearson->pValue[c],
+                    theSpearman->correlation[c], theSpearman->pValue[c]);
+            freeLandscape(batch[c]);
+        }
+        fflush(output);
+        freeCandidateData(thePearson);
+        freeCandidateData(theSpearman);
+    }
+    fclose(output);
+    freeLandscape(lPearson);
+    freeLandscape(lSpearman);
+}
+
+
+#pragma mark Correlogram
+CorrelogramData* allocateCorrelogramData(void)
+{
+    return malloc(sizeof(CorrelogramData));
+}
+
+void freeCorrelogramData(CorrelogramData* theData)
+{
+    if(theData==NULL) return;
+    free(theData->bounds);
+    free(theData->comparisons);
+    free(theData->correlation);
+    free(theData->pValue);
+    free(theData->corrected);
+    free(theData);
+}
+
+//Class number of every comparison, row-major, so a trial only has to look
+//them up. Comparisons outside every class (and the diagonal) get numClasses.
+unsigned char* makeClassIndexFromField(Field* theField, int numClasses, float* bounds);
+unsigned char* makeClassIndexFromField(Field* theField, int numClasses, float* bounds)
+{
+    int n = theField->samples;
+    unsigned char* classOf = malloc((size_t)n*n);
+    assert(classOf!=NULL);
+    for(int i=0; i<n; i++)
+    {
+        for(int j=0; j<n; j++)
+        {
+            float distance = theField->element[i][j];
+            int k = numClasses;
+            //Caveat: Skip main diagonal
+            if(i!=j && distance>=bounds[0] && distance<bounds[numClasses])
+            {
+                //Classes are few; the last edge not above distance gives the class
+                for(k=0; distance>=bounds[k+1]; k++) ;
+            }
+            classOf[(size_t)i*n+j] = k;
+        }
+    }
+    return classOf;
+}
+
+//Add Permute(Y) to the total of each comparison's class
+void augmentClassSumsByField(double* sums, unsigned char* classOf, Field* Y, bool triangle);
+void augmentClassSumsByField(double* sums, unsigned char* classOf, Field* Y, bool triangle)
+{
+    int n = Y->samples;
+    int* p = Y->perm->index;
+    unsigned char* classRow;
+    float* yRow;
+    for(int i=0; i<n; i++)
+    {
+        classRow = classOf+(size_t)i*n;
+        yRow = Y->element[p[i]];
+        if(Y->perm->isIdentity)
+        {
+            for(int j=(triangle ? i+1 : 0); j<n; j++) sums[classRow[j]] += yRow[j];
+        } else {
+            for(int j=(triangle ? i+1 : 0); j<n; j++) sums[classRow[j]] += yRow[p[j]];
+        }
+    }
+}
+
+CorrelogramData* correlogramAndFindP(Landscape* lPermuted, Landscape* lPreserved,
+                                     int numClasses, float* bounds, int trials)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lPermuted->storage == FIELD_STORAGE_FLOAT);
+    assert(lPreserved->storage == FIELD_STORAGE_FLOAT);
+    //Classes are ranges of the original distances
+    assert(lPreserved->isRaw);
+    assert(numClasses>0 && numClasses<=CORRELOGRAM_MAX_CLASSES);
+    assert(bounds!=NULL);
+    assert(trials>0);
+    for(int k=0; k<numClasses; k++) assert(bounds[k]<bounds[k+1]);
+    
+    int numFields = lPreserved->numFields;
+    modifyLandscapeMeanify(lPermuted);
+    //Class membership is symmetric whenever the distances are
+    bool triangle = lPreserved->isSymmetric && lPermuted->isSymmetric;
+    
+    CorrelogramData* theResults = allocateCorrelogramData();
+    theResults->correlationType = "Unset";
+    theResults->numClasses = numClasses;
+    theResults->trials = trials;
+    theResults->bounds = allocateArrayOfFloats(numClasses+1);
+    memcpy(theResults->bounds, bounds, (numClasses+1)*sizeof(float));
+    theResults->comparisons = malloc(numClasses*sizeof(long long));
+    theResults->correlation = allocateArrayOfFloats(numClasses);
+    theResults->pValue = allocateArrayOfFloats(numClasses);
+    theResults->corrected = allocateArrayOfFloats(numClasses);
+    
+    //Everything but the class sums is fixed under permutation: find it once
+    unsigned char* classOf[numFields];
+    double yTotal = 0, ySquares = 0;
+    long long numNonDiagElts = 0;
+    for(int k=0; k<numClasses; k++) theResults->comparisons[k] = 0;
+    for(int f=0; f<numFields; f++)
+    {
+        Field* X = lPreserved->fields[f];
+        Field* Y = lPermuted->fields[f];
+        assert(X->samples == Y->samples);
+        classOf[f] = makeClassIndexFromField(X, numClasses, bounds);
+        for(int i=0; i<X->samples; i++)
+        {
+            for(int j=0; j<X->samples; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i==j) continue;
+                int k = classOf[f][(size_t)i*X->samples+j];
+                if(k<numClasses) theResults->comparisons[k]++;
+                yTotal += Y->element[i][j];
+                ySquares += (double)Y->element[i][j]*Y->element[i][j];
+            }
+        }
+        numNonDiagElts += (long long)X->samples*(X->samples-1);
+    }
+    //Y isn't quite centered in floats, so each class's numerator is
+    //sum(y in class) - (share of comparisons in class)*sum(y)
+    double share[numClasses], denominator[numClasses];
+    //Counted exactly; a float count stops growing past 2^24 trials
+    long long atLeast[numClasses];
+    for(int k=0; k<numClasses; k++)
+    {
+        double m = theResults->comparisons[k];
+        share[k] = m/numNonDiagElts;
+        denominator[k] = sqrt((m-m*share[k])*ySquares);
+        if(denominator[k]==0)
+            printf("Note: distance class %d [%g, %g) holds %s comparison; its r is 0.\n",
+                   k, bounds[k], bounds[k+1], (m==0) ? "no" : "every");
+        atLeast[k] = 0;
+    }
+    
+    double sums[numClasses+1];
+    float currentCor;
+    for(int perm=0; perm<trials; perm++)
+    {
+        for(int k=0; k<=numClasses; k++) sums[k] = 0;
+        for(int f=0; f<numFields; f++)
+        {
+            //Identity permutation the first time through, random the rest
+            modifyPermPermutify(lPermuted->fields[f]->perm, (!perm)?SEED_IDENTITY:SEED_RANDOM);
+            augmentClassSumsByField(sums, classOf[f], lPermuted->fields[f], triangle);
+        }
+        for(int k=0; k<numClasses; k++)
+        {
+            if(triangle) sums[k] *= 2;
+            currentCor = 0;
+            if(denominator[k]>0) currentCor = (FLOATIFY*(sums[k]-share[k]*yTotal))/denominator[k];
+            //Store the first result specially
+            if(!perm) theResults->correlation[k] = currentCor;
+            //Either sign of autocorrelation counts, so compare sizes
+            if(fabsf(currentCor) >= fabsf(theResults->correlation[k])) atLeast[k]++;
+        }
+    }
+    
+    for(int k=0; k<numClasses; k++)
+    {
+        theResults->pValue[k] = (double)atLeast[k]/trials;
+        theResults->corrected[k] = fminf(1.0, (k+1)*theResults->pValue[k]);
+    }
+    for(int f=0; f<numFields; f++) free(classOf[f]);
+    return theResults;
+}
+
+void saveCorrelogramData(CorrelogramData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.Correlogram.tdv", 
+            timestamp, dataToSave->correlationType);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "Class\tFrom\tTo\tComparisons\tr\tp\tp (progressive Bonferroni)\n");
+    for(int k=0; k<dataToSave->numClasses; k++)
+    {
+        fprintf(output, "%d\t%g\t%g\t%lld\t%f\t%f\t%f\n", k+1,
+                dataToSave->bounds[k], dataToSave->bounds[k+1], dataToSave->comparisons[k],
+                dataToSave->correlation[k], dataToSave->pValue[k], dataToSave->corrected[k]);
+    }
+    fprintf(output, "Trials: %d\n", dataToSave->trials);
+    fclose(output);
+}
+
+void processCorrelogram(int trials, int filesets, const char* argv[], int timestamp,
+                        RunOptions* options)
+{
+    assert(options!=NULL);
+    assert(options->numClasses>0);
+    
+    const char* s[filesets]; //static: distances
+    const char* p[filesets]; //permuted: differences
+    int groupSize=2;
+    int firstFile=2;
+    for(int i=0; i<filesets; i++)
+    {
+        s[i] = argv[groupSize*i+firstFile];
+        p[i] = argv[groupSize*i+firstFile+1];
+    }
+    
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+        printf("Note: compact storage isn't used in correlogram mode.\n");
+    
+    //Classes come from the raw distances, whichever way the other side is treated
+    Landscape* lPreserved = makeLandscapeFromTDVs(filesets, s);
+    Landscape* lPermuted = makeLandscapeFromTDVs(filesets, p);
+    
+    CorrelogramData* theClasses = NULL;
+    
+    //Pearson correlation
+    theClasses = correlogramAndFindP(lPermuted, lPreserved, options->numClasses, 
+                                     options->classBounds, trials);
+    theClasses->correlationType = "Pearson";
+    saveCorrelogramData(theClasses, timestamp);
+    freeCorrelogramData(theClasses);
+    
+    //Rank data (class membership is already a 0/1 indicator)
+    modifyLandscapeRankify(lPermuted);
+    
+    //Spearman correlation
+    theClasses = correlogramAndFindP(lPermuted, lPreserved, options->numClasses, 
+                                     options->classBounds, trials);
+    theClasses->correlationType = "Spearman";
+    saveCorrelogramData(theClasses, timestamp);
+    freeCorrelogramData(theClasses);
+    
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+}
+
+
+#pragma mark Regression
+RegressionData* allocateRegressionData(void)
+{
+    return malloc(sizeof(RegressionData));
+}
+
+void freeRegressionData(RegressionData* theData)
+{
+    if(theData==NULL) return;
+    free(theData->coefficient);
+    free(theData->pValue);
+    free(theData);
+}
+
+//Off-diagonal mean, before centering takes it away
+double meanOfLandscape(Landscape* theData);
+double meanOfLandscape(Landscape* theData)
+{
+    double theTotal = 0;
+    long long theCount = 0;
+    for(int f=0; f<theData->numFields; f++)
+    {
+        Field* theField = theData->fields[f];
+        for(int x=0; x<theField->samples; x++)
+        {
+            for(int y=0; y<theField->samples; y++)
+            {
+                //Caveat: Skip main diagonal
+                if(x!=y) theTotal += theField->element[x][y];
+            }
+        }
+        theCount += (long long)theField->samples*(theField->samples-1);
+    }
+    return theTotal/theCount;
+}
+
+//As augmentTotalsByGatheredField, but summed in double throughout: the normal
+//equations add up O(samples^2) products, and near-collinear predictors need every digit
+void augmentDoubleTotalsByGatheredField(double* totals, int count, Field* partners[],
+                                        float* gathered, bool triangle);
+void augmentDoubleTotalsByGatheredField(double* totals, int count, Field* partners[],
+                                        float* gathered, bool triangle)
+{
+    int n = partners[0]->samples;
+    double rowTotal, weight = triangle ? 2 : 1;
+    float *gatheredRow, *partnerRow;
+    int start;
+    for(int i=0; i<n; i++)
+    {
+        gatheredRow = gathered+i*n;
+        start = triangle ? i+1 : 0;
+        for(int c=0; c<count; c++)
+        {
+            partnerRow = partners[c]->element[i];
+            rowTotal = 0.0;
+            for(int j=start; j<n; j++) rowTotal += (double)partnerRow[j]*gatheredRow[j];
+            totals[c] += weight*rowTotal;
+        }
+    }
+}
+
+//Cholesky factor of a symmetric size*size matrix, in place (lower triangle).
+//Returns FALSE if the matrix isn't positive definite.
+bool modifyMatrixCholesky(double* A, int size);
+bool modifyMatrixCholesky(double* A, int size)
+{
+    for(int j=0; j<size; j++)
+    {
+        double pivot = A[j*size+j];
+        for(int k=0; k<j; k++) pivot -= A[j*size+k]*A[j*size+k];
+        //Relative to the original diagonal, so scale doesn't matter
+        if(pivot <= 1e-10*A[j*size+j]) return false;
+        A[j*size+j] = sqrt(pivot);
+        for(int i=j+1; i<size; i++)
+        {
+            double value = A[i*size+j];
+            for(int k=0; k<j; k++) value -= A[i*size+k]*A[j*size+k];
+            A[i*size+j] = value/A[j*size+j];
+        }
+    }
+    return true;
+}
+
+//Solve (L L')x = b with the factor from modifyMatrixCholesky
+void solveCholesky(double* L, int size, double* b, double* x);
+void solveCholesky(double* L, int size, double* b, double* x)
+{
+    for(int i=0; i<size; i++)
+    {
+        x[i] = b[i];
+        for(int k=0; k<i; k++) x[i] -= L[i*size+k]*x[k];
+        x[i] /= L[i*size+i];
+    }
+    for(int i=size-1; i>=0; i--)
+    {
+        for(int k=i+1; k<size; k++) x[i] -= L[k*size+i]*x[k];
+        x[i] /= L[i*size+i];
+    }
+}
+
+RegressionData* regressAndFindP(Landscape* lResponse, int numPredictors,
+                                Landscape* predictors[], int trials)
+{
+    assert(lResponse!=NULL);
+    assert(predictors!=NULL);
+    assert(numPredictors>0);
+    assert(trials>0);
+    assert(lResponse->storage == FIELD_STORAGE_FLOAT);
+    
+    int numFields = lResponse->numFields;
+    int P = numPredictors;
+    //Centering moves only the intercept, so remember where the means were
+    double responseMean = meanOfLandscape(lResponse);
+    double predictorMean[P];
+    modifyLandscapeMeanify(lResponse);
+    int largest = 0;
+    for(int f=0; f<numFields; f++)
+        if(lResponse->fields[f]->samples>largest) largest = lResponse->fields[f]->samples;
+    for(int p=0; p<P; p++)
+    {
+        assert(predictors[p]->numFields == numFields);
+        assert(predictors[p]->storage == FIELD_STORAGE_FLOAT);
+        for(int f=0; f<numFields; f++)
+            assert(predictors[p]->fields[f]->samples == lResponse->fields[f]->samples);
+        predictorMean[p] = meanOfLandscape(predictors[p]);
+        modifyLandscapeMeanify(predictors[p]);
+    }
+    
+    RegressionData* theResults = allocateRegressionData();
+    theResults->correlationType = "Unset";
+    theResults->numPredictors = P;
+    theResults->trials = trials;
+    theResults->coefficient = allocateArrayOfFloats(P);
+    theResults->pValue = allocateArrayOfFloats(P);
+    theResults->rSquaredP = 0;
+    
+    float* gathered = allocateArrayOfFloats(largest*largest);
+    Field* partners[P];
+    bool triangle[numFields];
+    for(int f=0; f<numFields; f++)
+    {
+        for(int p=0; p<P; p++) partners[p] = predictors[p]->fields[f];
+        triangle[f] = lResponse->fields[f]->isSymmetric && areFieldsSymmetric(P, partners);
+    }
+    
+    //X'X and y'y don't depend on the permutation: find them, and factor X'X, once.
+    //Column q of X'X is predictor q run through the same kernel as y.
+    double XtX[P*P];
+    double column[P];
+    double yty = 0;
+    Field* response[1];
+    Perm* identity;
+    for(int q=0; q<=P; q++)
+    {
+        for(int p=0; p<P; p++) column[p] = 0;
+        for(int f=0; f<numFields; f++)
+        {
+            for(int p=0; p<P; p++) partners[p] = predictors[p]->fields[f];
+            identity = makePerm(lResponse->fields[f]->samples, SEED_IDENTITY);
+            //Last pass: y against itself
+            if(q==P)
+            {
+                response[0] = lResponse->fields[f];
+                gatherPermutedField(gathered, response[0], identity, triangle[f]);
+                augmentDoubleTotalsByGatheredField(&yty, 1, response, gathered, triangle[f]);
+            } else {
+                gatherPermutedField(gathered, partners[q], identity, triangle[f]);
+                augmentDoubleTotalsByGatheredField(column, P, partners, gathered, triangle[f]);
+            }
+            free(identity->index);
+            free(identity);
+        }
+        if(q<P) for(int p=0; p<P; p++) XtX[p*P+q] = column[p];
+    }
+    if(!modifyMatrixCholesky(XtX, P))
+    {
+        printf("ERROR: Predictor landscapes are collinear; drop one and try again.\n");
+        free(gathered);
+        freeRegressionData(theResults);
+        return NULL;
+    }
+    
+    //Counted exactly; a float count stops growing past 2^24 trials
+    long long r2AtLeast = 0;
+    long long atLeast[P];
+    double Xty[P], beta[P], fit;
+    float currentR2;
+    for(int perm=0; perm<trials; perm++)
+    {
+        for(int p=0; p<P; p++) Xty[p] = 0;
+        for(int f=0; f<numFields; f++)
+        {
+            Field* Y = lResponse->fields[f];
+            //Identity permutation the first time through, random the rest
+            modifyPermPermutify(Y->perm, (!perm)?SEED_IDENTITY:SEED_RANDOM);
+            for(int p=0; p<P; p++) partners[p] = predictors[p]->fields[f];
+            //One gather per field, shared by every predictor's dot product
+            gatherPermutedField(gathered, Y, Y->perm, triangle[f]);
+            augmentDoubleTotalsByGatheredField(Xty, P, partners, gathered, triangle[f]);
+        }
+        solveCholesky(XtX, P, Xty, beta);
+        
+        fit = 0;
+        for(int p=0; p<P; p++) fit += beta[p]*Xty[p];
+        currentR2 = fit/yty;
+        
+        //Store the first result specially
+        if(!perm)
+        {
+            theResults->rSquared = currentR2;
+            for(int p=0; p<P; p++)
+            {
+                theResults->coefficient[p] = beta[p];
+                atLeast[p] = 0;
+            }
+        }
+        if(currentR2 >= theResults->rSquared) r2AtLeast++;
+        //Coefficients can matter in either direction, so compare sizes
+        for(int p=0; p<P; p++)
+            if(fabs(beta[p]) >= fabsf(theResults->coefficient[p])) atLeast[p]++;
+    }
+    
+    theResults->rSquaredP = (double)r2AtLeast/trials;
+    theResults->intercept = responseMean;
+    for(int p=0; p<P; p++)
+    {
+        theResults->pValue[p] = (double)atLeast[p]/trials;
+        theResults->intercept -= theResults->coefficient[p]*predictorMean[p];
+    }
+    free(gathered);
+    return theResults;
+}
+
+void saveRegressionData(RegressionData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.MRM.tdv", 
+            timestamp, dataToSave->correlationType);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "Term\tCoefficient\tp\n");
+    fprintf(output, "Intercept\t%f\t\n", dataToSave->intercept);
+    for(int p=0; p<dataToSave->numPredictors; p++)
+    {
+        fprintf(output, "X%d\t%f\t%f\n", p+1, dataToSave->coefficient[p], dataToSave->pValue[p]);
+    }
+    fprintf(output, "R^2\t%f\t%f\n", dataToSave->rSquared, dataToSave->rSquaredP);
+    fprintf(output, "Trials: %d\n", dataToSave->trials);
+    fclose(output);
+}
+
+void processRegression(int trials, int filesets, const char* argv[], int timestamp,
+                       RunOptions* options)
+{
+    assert(options!=NULL);
+    assert(options->regression>0);
+    
+    int numPredictors = options->regression;
+    int groupSize = numPredictors+1;
+    int firstFile = 2;
+    const char* names[filesets];
+    Landscape* predictors[numPredictors];
+    
+    if(options->storage!=FIELD_STORAGE_FLOAT)
+        printf("Note: compact storage isn't used in regression mode.\n");
+    
+    //Load data: each field's files are the response, then the predictors
+    for(int i=0; i<filesets; i++) names[i] = argv[groupSize*i+firstFile];
+    Landscape* lResponse = makeLandscapeFromTDVs(filesets, names);
+    for(int p=0; p<numPredictors; p++)
+    {
+        for(int i=0; i<filesets; i++) names[i] = argv[groupSize*i+firstFile+1+p];
+        predictors[p] = makeLandscapeFromTDVs(filesets, names);
+    }
+    
+    RegressionData* theFit = NULL;
+    
+    //Linear regression, then regression on ranks
+    for(int ranked=0; ranked<2; ranked++)
+    {
+        if(ranked)
+        {
+            modifyLandscapeRankify(lResponse);
+            for(int p=0; p<numPredictors; p++) modifyLandscapeRankify(predictors[p]);
+        }
+        theFit = regressAndFindP(lResponse, numPredictors, predictors, trials);
+        //Collinear predictors: nothing to save
+        if(theFit==NULL) break;
+        theFit->correlationType = ranked ? "Spearman" : "Pearson";
+        saveRegressionData(theFit, timestamp);
+        freeRegressionData(theFit);
+    }
+    
+    freeLandscape(lResponse);
+    for(int p=0; p<numPredictors; p++) freeLandscape(predictors[p]);
+}
+
+
+#pragma mark Moments
+MomentData* allocateMomentData(void)
+{
+    return malloc(sizeof(MomentData));
+}
+
+/**
+ * @brief Sums over one field that the permutation moments are built from
+ *
+ * Each is a sum over distinct samples of the product of the comparisons
+ * along the edges of a small graph, e.g. triangle = sum a_ij a_jk a_ki.
+ * Under a random relabeling, the expected product for a graph on v samples
+ * is its sum for the other field over v falling factorial of samples.
+ */
+typedef struct {
+    double pair;       /**< Two samples, one edge: sum a_ij^2 (second moment) */
+    double sharing;    /**< Three samples, two edges: sum a_ij a_ik */
+    double apart;      /**< Four samples, two edges: sum a_ij a_kl */
+    double triple;     /**< Two samples, three times: sum a_ij^3 */
+    double doubled;    /**< Doubled edge plus one sharing a sample: sum a_ij^2 a_ik */
+    double triangle;   /**< sum a_ij a_jk a_ki */
+    double doubledApart; /**< Doubled edge plus one apart: sum a_ij^2 a_kl */
+    double star;       /**< sum a_ij a_ik a_il */
+    double path;       /**< sum a_ij a_jk a_kl */
+    double pathApart;  /**< Two-edge path plus one apart: sum a_ij a_jk a_lm */
+    double disjoint;   /**< Three edges apart: sum a_ij a_kl a_mn */
+} GraphSums;
+
+//Sums for a symmetric field with its own mean taken out. Shifting a field
+//by a constant shifts every trial's statistic by the same amount, so this
+//leaves the variance and third moment alone, and most of the sums vanish.
+void fillGraphSums(GraphSums* theSums, Field* theField, bool withTriangle);
+void fillGraphSums(GraphSums* theSums, Field* theField, bool withTriangle)
+{
+    int n = theField->samples;
+    float** a = theField->element;
+    double mean = 0;
+    for(int i=0; i<n; i++)
+        for(int j=0; j<n; j++)
+            if(i!=j) mean += a[i][j];
+    mean /= (double)n*(n-1);
+    
+    //Row sums of the centered comparisons and their powers
+    double r[n], q[n], c[n], value;
+    double total = 0, squares = 0, rowSquares = 0, cubes = 0, qr = 0, rSquared;
+    for(int i=0; i<n; i++)
+    {
+        r[i] = q[i] = c[i] = 0;
+        for(int j=0; j<n; j++)
+        {
+            //Caveat: Skip main diagonal
+            if(i==j) continue;
+            value = a[i][j]-mean;
+            r[i] += value;
+            q[i] += value*value;
+            c[i] += value*value*value;
+        }
+        total += r[i];
+        squares += q[i];
+        rowSquares += r[i]*r[i];
+        cubes += c[i];
+        qr += q[i]*r[i];
+    }
+    double arr = 0, star = 0, rCubes = 0;
+    for(int i=0; i<n; i++)
+    {
+        double weighted = 0;
+        for(int j=0; j<n; j++) if(i!=j) weighted += (a[i][j]-mean)*r[j];
+        arr += r[i]*weighted;
+        rSquared = r[i]*r[i];
+        rCubes += rSquared*r[i];
+        star += rSquared*r[i] - 3*r[i]*q[i] + 2*c[i];
+    }
+    
+    //The one O(samples^3) sum: each triangle once, six ways round
+    double triangle = 0;
+    if(withTriangle)
+    {
+        //Centered once, padded so the lanes below never run past a row
+        int width = (n+MOMENT_LANES-1)/MOMENT_LANES*MOMENT_LANES;
+        float* centered = calloc((size_t)n*width, sizeof(float));
+        assert(centered!=NULL);
+        for(int i=0; i<n; i++)
+            for(int j=0; j<n; j++)
+                centered[(size_t)i*width+j] = a[i][j]-mean;
+        
+        for(int i=0; i<n; i++)
+        {
+            float* rowI = centered+(size_t)i*width;
+            for(int j=i+1; j<n; j++)
+            {
+                float* rowJ = centered+(size_t)j*width;
+                //Separate partial sums so the products vectorize
+                float lane[MOMENT_LANES] = {0};
+                int k = j+1;
+                for(; k<n && k%MOMENT_LANES; k++) lane[0] += rowI[k]*rowJ[k];
+                for(; k<n; k+=MOMENT_LANES)
+                    for(int l=0; l<MOMENT_LANES; l++) lane[l] += rowI[k+l]*rowJ[k+l];
+                double shared = 0;
+                for(int l=0; l<MOMENT_LANES; l++) shared += lane[l];
+                triangle += 6*rowI[j]*shared;
+            }
+        }
+        free(centered);
+    }
+    
+    theSums->pair = squares;
+    theSums->sharing = rowSquares - squares;
+    theSums->apart = total*total - 4*rowSquares + 2*squares;
+    theSums->triple = cubes;
+    theSums->doubled = qr - cubes;
+    theSums->triangle = triangle;
+    theSums->doubledApart = total*squares - 4*qr + 2*cubes;
+    theSums->star = star;
+    theSums->path = arr - 2*qr + cubes - triangle;
+    double ends = rCubes - qr + 2*(arr-qr);
+    theSums->pathApart = theSums->sharing*total - 2*ends + 2*(2*theSums->doubled + triangle);
+    //Every way three ordered pairs can overlap, taken out of the unrestricted sum
+    theSums->disjoint = total*total*total - (4*theSums->triple + 24*theSums->doubled
+                        + 8*triangle + 6*theSums->doubledApart + 8*star + 24*theSums->path
+                        + 12*theSums->pathApart);
+}
+
+//n(n-1)...(n-count+1)
+double fallingFactorial(int n, int count);
+double fallingFactorial(int n, int count)
+{
+    double product = 1;
+    for(int t=0; t<count; t++) product *= n-t;
+    return product;
+}
+
+//Average of a sum over ordered selections of count samples (an empty sum when n<count)
+double perSelection(double sum, int n, int count);
+double perSelection(double sum, int n, int count)
+{
+    return (n<count) ? 0 : sum/fallingFactorial(n, count);
+}
+
+//Regularized lower incomplete gamma function P(a,x)
+double regularizedGammaP(double a, double x);
+double regularizedGammaP(double a, double x)
+{
+    if(x<=0) return 0;
+    double front = exp(a*log(x) - x - lgamma(a));
+    if(x < a+1)
+    {
+        //Series
+        double term = 1/a, sum = term;
+        for(int k=1; k<10000 && fabs(term)>1e-15*fabs(sum); k++)
+        {
+            term *= x/(a+k);
+            sum += term;
+        }
+        return front*sum;
+    }
+    //Continued fraction for the upper tail (modified Lentz)
+    double b = x+1-a, C = 1e300, D = 1/b, h = D, delta;
+    for(int k=1; k<10000; k++)
+    {
+        double an = -k*(k-a);
+        b += 2;
+        D = an*D + b;
+        if(fabs(D)<1e-300) D = 1e-300;
+        C = b + an/C;
+        if(fabs(C)<1e-300) C = 1e-300;
+        D = 1/D;
+        delta = D*C;
+        h *= delta;
+        if(fabs(delta-1)<1e-15) break;
+    }
+    return 1 - front*h;
+}
+
+MomentData* correlateAndApproximateP(Landscape* lPermuted, Landscape* lPreserved)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lPermuted->storage == FIELD_STORAGE_FLOAT);
+    assert(lPreserved->storage == FIELD_STORAGE_FLOAT);
+    //The closed forms count each comparison in both directions
+    assert(lPermuted->isSymmetric && lPreserved->isSymmetric);
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    MomentData* theResults = allocateMomentData();
+    theResults->correlationType = "Unset";
+    theResults->isSkewnessExact = true;
+    
+    //Unpermuted correlation, exactly as the permutation path finds it
+    for(int f=0; f<lPermuted->numFields; f++)
+        modifyPermPermutify(lPermuted->fields[f]->perm, SEED_IDENTITY);
+    theResults->correlationOfInterest = mantelR(lPreserved, lPermuted, NULL);
+    
+    //Fields are relabeled independently, so their cumulants add up
+    double mean = 0, variance = 0, third = 0;
+    double xSquares = 0, ySquares = 0;
+    GraphSums X, Y;
+    for(int f=0; f<lPermuted->numFields; f++)
+    {
+        Field* theX = lPreserved->fields[f];
+        Field* theY = lPermuted->fields[f];
+        int n = theX->samples;
+        assert(theY->samples == n);
+        if(n<2) continue;
+        
+        double xTotal = 0, yTotal = 0;
+        for(int i=0; i<n; i++)
+        {
+            for(int j=0; j<n; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i==j) continue;
+                xTotal += theX->element[i][j];
+                yTotal += theY->element[i][j];
+                xSquares += (double)theX->element[i][j]*theX->element[i][j];
+                ySquares += (double)theY->element[i][j]*theY->element[i][j];
+            }
+        }
+        mean += xTotal*yTotal/fallingFactorial(n, 2);
+        
+        bool withTriangle = (n<=MOMENT_SKEW_MAX_SAMPLES);
+        if(!withTriangle) theResults->isSkewnessExact = false;
+        fillGraphSums(&X, theX, withTriangle);
+        fillGraphSums(&Y, theY, withTriangle);
+        
+        variance += perSelection(2*X.pair*Y.pair, n, 2)
+                  + perSelection(4*X.sharing*Y.sharing, n, 3)
+                  + perSelection(X.apart*Y.apart, n, 4);
+        if(withTriangle)
+        {
+            third += perSelection(4*X.triple*Y.triple, n, 2)
+                   + perSelection(24*X.doubled*Y.doubled, n, 3)
+                   + perSelection(8*X.triangle*Y.triangle, n, 3)
+                   + perSelection(6*X.doubledApart*Y.doubledApart, n, 4)
+                   + perSelection(8*X.star*Y.star, n, 4)
+                   + perSelection(24*X.path*Y.path, n, 4)
+                   + perSelection(12*X.pathApart*Y.pathApart, n, 5)
+                   + perSelection(X.disjoint*Y.disjoint, n, 6);
+        }
+    }
+    if(!theResults->isSkewnessExact)
+        printf("Note: fields over %d samples are left out of the skewness.\n",
+               MOMENT_SKEW_MAX_SAMPLES);
+    
+    //r is the statistic over a fixed denominator
+    double denominator = sqrt(xSquares*ySquares);
+    theResults->mean = mean/denominator;
+    theResults->variance = variance/(denominator*denominator);
+    theResults->skewness = (variance>0) ? third/pow(variance, 1.5) : 0;
+    
+    //Pearson type III: a gamma distribution shifted and scaled to the three moments
+    double sd = sqrt(theResults->variance);
+    double t = (sd>0) ? (theResults->correlationOfInterest - theResults->mean)/sd : 0;
+    double skewness = theResults->skewness;
+    if(skewness == 0)
+    {
+        theResults->pValue = 0.5*erfc(t/sqrt(2));
+        return theResults;
+    }
+    //Gamma variate with that skewness, in the direction of its long tail
+    double shape = 4/(skewness*skewness);
+    double gamma = shape + ((skewness>0)?t:-t)*sqrt(shape);
+    double tail;
+    if(gamma<=0)
+        tail = 1;
+    else if(shape > MOMENT_GAMMA_MAX_SHAPE)
+    {
+        //Wilson-Hilferty: the gamma's cube root is very nearly normal
+        double z = 3*sqrt(shape)*(cbrt(gamma/shape) - 1 + 1/(9*shape));
+        tail = 0.5*erfc(z/sqrt(2));
+    }
+    else
+        tail = 1 - regularizedGammaP(shape, gamma);
+    theResults->pValue = (skewness>0) ? tail : 1-tail;
+    return theResults;
+}
+
+void saveMomentData(MomentData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.Moments.txt", 
+            timestamp, dataToSave->correlationType);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "%s correlation is %f\n", 
+            dataToSave->correlationType, dataToSave->correlationOfInterest);
+    fprintf(output, "Over every relabeling, r has mean %g, standard deviation %g, skewness %g%s\n",
+            dataToSave->mean, sqrt(dataToSave->variance), dataToSave->skewness,
+            dataToSave->isSkewnessExact ? "" : " (large fields left out)");
+    fprintf(output, "Pearson type III estimate: %f of relabelings would be >=\n", 
+            dataToSave->pValue);
+    fclose(output);
+}
+
+
+#pragma mark Tail sampling
+TailData* allocateTailData(void)
+{
+    return malloc(sizeof(TailData));
+}
+
+//Sum of preserved comparisons times relabeled permuted ones, over every field
+double crossProductOfLandscapes(Landscape* lPreserved, Landscape* lPermuted, int** labels);
+double crossProductOfLandscapes(Landscape* lPreserved, Landscape* lPermuted, int** labels)
+{
+    double total = 0;
+    for(int f=0; f<lPreserved->numFields; f++)
+    {
+        float** x = lPreserved->fields[f]->element;
+        float** y = lPermuted->fields[f]->element;
+        int* label = labels[f];
+        int n = lPreserved->fields[f]->samples;
+        for(int i=0; i<n; i++)
+        {
+            float* yRow = y[label[i]];
+            double rowTotal = 0;
+            for(int j=0; j<n; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i==j) continue;
+                rowTotal += x[i][j]*yRow[label[j]];
+            }
+            total += rowTotal;
+        }
+    }
+    return total;
+}
+
+//Change in one field's cross product if samples a and b traded labels: O(samples)
+double crossProductChangeBySwap(Field* theX, Field* theY, int* label, int a, int b);
+double crossProductChangeBySwap(Field* theX, Field* theY, int* label, int a, int b)
+{
+    float** x = theX->element;
+    float** y = theY->element;
+    float* yA = y[label[a]];
+    float* yB = y[label[b]];
+    double change = 0;
+    if(theX->isSymmetric && theY->isSymmetric)
+    {
+        //Columns a and b change just as rows a and b do
+        for(int k=0; k<theX->samples; k++)
+        {
+            if(k==a || k==b) continue;
+            change += (x[a][k]-x[b][k])*(yB[label[k]]-yA[label[k]]);
+        }
+        return 2*change;
+    }
+    for(int k=0; k<theX->samples; k++)
+    {
+        if(k==a || k==b) continue;
+        change += (x[a][k]-x[b][k])*(yB[label[k]]-yA[label[k]])
+                + (x[k][a]-x[k][b])*(y[label[k]][label[b]]-y[label[k]][label[a]]);
+    }
+    //The a,b comparisons themselves trade directions
+    change += (x[a][b]-x[b][a])*(yB[label[a]]-yA[label[b]]);
+    return change;
+}
+
+//Uniform on (0,1)
+double randUnitWithState(RandomState* theState);
+double randUnitWithState(RandomState* theState)
+{
+    return (randBelowWithState(theState, 1u<<30)+0.5)/(1u<<30);
+}
+
+TailData* correlateAndEstimateTailP(Landscape* lPermuted, Landscape* lPreserved, int trials)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lPermuted->storage == FIELD_STORAGE_FLOAT);
+    assert(lPreserved->storage == FIELD_STORAGE_FLOAT);
+    assert(trials>0);
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    
+    RandomState* theState = &sharedRandomState;
+    int numFields = lPermuted->numFields;
+    TailData* theResults = allocateTailData();
+    theResults->correlationType = "Unset";
+    
+    //r is the cross product over a denominator no relabeling changes
+    int totalSamples = 0;
+    double xSquares = 0, ySquares = 0;
+    for(int f=0; f<numFields; f++)
+    {
+        Field* theX = lPreserved->fields[f];
+        Field* theY = lPermuted->fields[f];
+        assert(theY->samples == theX->samples);
+        totalSamples += theX->samples;
+        for(int i=0; i<theX->samples; i++)
+        {
+            for(int j=0; j<theX->samples; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i==j) continue;
+                xSquares += (double)theX->element[i][j]*theX->element[i][j];
+                ySquares += (double)theY->element[i][j]*theY->element[i][j];
+            }
+        }
+        modifyPermPermutify(theY->perm, SEED_IDENTITY);
+    }
+    double denominator = sqrt(xSquares*ySquares);
+    theResults->correlationOfInterest = mantelR(lPreserved, lPermuted, NULL);
+    
+    int** labels = malloc(numFields*sizeof(int*));
+    for(int f=0; f<numFields; f++)
+    {
+        labels[f] = allocateArrayOfInts(lPermuted->fields[f]->samples);
+        for(int i=0; i<lPermuted->fields[f]->samples; i++) labels[f][i] = i;
+    }
+    double r0 = crossProductOfLandscapes(lPreserved, lPermuted, labels)/denominator;
+    
+    //A few uniform relabelings give the spread of r, which sets the ladder
+    double pilotTotal = 0, pilotSquares = 0, r;
+    for(int t=0; t<TAIL_PILOT_TRIALS; t++)
+    {
+        for(int f=0; f<numFields; f++)
+            for(int i=lPermuted->fields[f]->samples-1; i>0; i--)
+                swapI(&labels[f][i], &labels[f][randBelowWithState(theState, i+1)]);
+        r = crossProductOfLandscapes(lPreserved, lPermuted, labels)/denominator;
+        pilotTotal += r;
+        pilotSquares += r*r;
+    }
+    double pilotMean = pilotTotal/TAIL_PILOT_TRIALS;
+    double pilotSD = sqrt(fmax(pilotSquares/TAIL_PILOT_TRIALS - pilotMean*pilotMean, 0));
+    double z = (pilotSD>0) ? (r0-pilotMean)/pilotSD : 0;
+    for(int f=0; f<numFields; f++) free(labels[f]);
+    free(labels);
+    
+    //Tilting by exp(beta*r) moves the mean of r by about beta*variance;
+    //the top rung is centered on r0, and plain sampling will do when r0 isn't far out
+    int rungs = 1;
+    if(z>TAIL_RUNG_SPACING) rungs += (int)ceil(z/TAIL_RUNG_SPACING);
+    double beta[rungs];
+    for(int k=0; k<rungs; k++) beta[k] = (rungs>1) ? k*z/((rungs-1)*pilotSD) : 0;
+    
+    int sweeps = trials/rungs;
+    int burnIn = sweeps/8;
+    int perBatch = (sweeps-burnIn)/TAIL_BATCHES;
+    if(perBatch<1) perBatch = 1;
+    int moves = (totalSamples/2>0) ? totalSamples/2 : 1;
+    theResults->rungs = rungs;
+    theResults->trials = rungs*(burnIn + TAIL_BATCHES*perBatch);
+    
+    //Every chain starts unpermuted; the low rungs soon wander off
+    int** chain[rungs];
+    double rChain[rungs];
+    for(int k=0; k<rungs; k++)
+    {
+        chain[k] = malloc(numFields*sizeof(int*));
+        for(int f=0; f<numFields; f++)
+        {
+            chain[k][f] = allocateArrayOfInts(lPermuted->fields[f]->samples);
+            for(int i=0; i<lPermuted->fields[f]->samples; i++) chain[k][f][i] = i;
+        }
+        rChain[k] = r0;
+    }
+    
+    //Per batch and rung: the weights that link each rung to the next (or, on top, to the tail)
+    double weights[TAIL_BATCHES][rungs];
+    memset(weights, 0, sizeof(weights));
+    long long swapsTried = 0, swapsTaken = 0;
+    for(int sweep=0; sweep<burnIn+TAIL_BATCHES*perBatch; sweep++)
+    {
+        int batch = (sweep<burnIn) ? -1 : (sweep-burnIn)/perBatch;
+        //Changes are tracked incrementally; start each batch from exact values
+        if(sweep==burnIn || (batch>=0 && (sweep-burnIn)%perBatch==0))
+            for(int k=0; k<rungs; k++)
+                rChain[k] = crossProductOfLandscapes(lPreserved, lPermuted, chain[k])/denominator;
+        
+        //Metropolis transpositions, each field chosen in proportion to its samples
+        for(int k=0; k<rungs; k++)
+        {
+            for(int move=0; move<moves; move++)
+            {
+                int a = randBelowWithState(theState, totalSamples);
+                int f = 0;
+                while(a >= lPermuted->fields[f]->samples) a -= lPermuted->fields[f++]->samples;
+                int n = lPermuted->fields[f]->samples;
+                if(n<2) continue;
+                int b = randBelowWithState(theState, n-1);
+                if(b>=a) b++;
+                double change = crossProductChangeBySwap(lPreserved->fields[f], lPermuted->fields[f],
+                                                         chain[k][f], a, b)/denominator;
+                if(change>=0 || randUnitWithState(theState) < exp(beta[k]*change))
+                {
+                    swapI(&chain[k][f][a], &chain[k][f][b]);
+                    rChain[k] += change;
+                }
+            }
+        }
+        
+        //Neighboring rungs offer to trade states
+        for(int k=0; k+1<rungs; k++)
+        {
+            double logOdds = (beta[k+1]-beta[k])*(rChain[k]-rChain[k+1]);
+            swapsTried++;
+            if(logOdds>=0 || randUnitWithState(theState) < exp(logOdds))
+            {
+                int** held = chain[k];
+                chain[k] = chain[k+1];
+                chain[k+1] = held;
+                double heldR = rChain[k];
+                rChain[k] = rChain[k+1];
+                rChain[k+1] = heldR;
+                swapsTaken++;
+            }
+        }
+        if(batch<0) continue;
+        
+        //Shifted by r0 to stay in range; the shifts cancel in the product
+        for(int k=0; k+1<rungs; k++)
+            weights[batch][k] += exp((beta[k+1]-beta[k])*(rChain[k]-r0));
+        //Ties count, as in fractionAtLeast
+        if(rChain[rungs-1] >= r0-1e-9)
+            weights[batch][rungs-1] += exp(-beta[rungs-1]*(rChain[rungs-1]-r0));
+    }
+    
+    //p = the product of mean weights over the rungs; batches give its spread
+    double estimate[TAIL_BATCHES], pooled = 1, mean = 0, squares = 0;
+    for(int k=0; k<rungs; k++)
+    {
+        double total = 0;
+        for(int batch=0; batch<TAIL_BATCHES; batch++) total += weights[batch][k];
+        pooled *= total/(TAIL_BATCHES*perBatch);
+    }
+    for(int batch=0; batch<TAIL_BATCHES; batch++)
+    {
+        estimate[batch] = 1;
+        for(int k=0; k<rungs; k++) estimate[batch] *= weights[batch][k]/perBatch;
+        mean += estimate[batch];
+    }
+    mean /= TAIL_BATCHES;
+    for(int batch=0; batch<TAIL_BATCHES; batch++)
+        squares += (estimate[batch]-mean)*(estimate[batch]-mean);
+    theResults->pValue = pooled;
+    theResults->standardError = sqrt(squares/(TAIL_BATCHES-1)/TAIL_BATCHES);
+    theResults->swapRate = (swapsTried>0) ? swapsTaken/(FLOATIFY*swapsTried) : 0;
+    
+    for(int k=0; k<rungs; k++)
+    {
+        for(int f=0; f<numFields; f++) free(chain[k][f]);
+        free(chain[k]);
+    }
+    return theResults;
+}
+
+void saveTailData(TailData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.Tail.txt", 
+            timestamp, dataToSave->correlationType);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "%s correlation is %f\n", 
+            dataToSave->correlationType, dataToSave->correlationOfInterest);
+    fprintf(output, "Tempered sampling: %d sweeps over %d rung(s), %.0f%% of exchanges taken\n",
+            dataToSave->trials, dataToSave->rungs, 100*dataToSave->swapRate);
+    fprintf(output, "Estimated %g of relabelings would be >= (standard error %g)\n", 
+            dataToSave->pValue, dataToSave->standardError);
+    if(dataToSave->standardError>0)
+        fprintf(output, "Uniform permutations would need about %.0f trials for that precision\n",
+                dataToSave->pValue*(1-dataToSave->pValue)
+                /(dataToSave->standardError*dataToSave->standardError));
+    fclose(output);
+}
+
+
+#pragma mark Bootstrap
+BootstrapData* allocateBootstrapData(void)
+{
+    return malloc(sizeof(BootstrapData));
+}
+
+void freeBootstrapData(BootstrapData* theData)
+{
+    assert(theData!=NULL);
+    free(theData->listOfCorrelations->data);
+    free(theData->listOfCorrelations);
+    free(theData);
+}
+
+/**
+ * @brief Sums over comparisons, each counted by its weight, for a Pearson correlation
+ */
+typedef struct {
+    double pairs, x, y, xx, yy, xy;
+} BootstrapSums;
+
+/**
+ * @brief One thread's share of the bootstrap replicates
+ */
+typedef struct {
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    int first;           /**< First replicate */
+    int step;            /**< Replicates between this thread's */
+    int replicates;
+    unsigned int seed;
+    float* correlations; /**< Shared; each replicate's slot */
+} BootstrapWorker;
+
+//A resampled pair of distinct samples a,b turns up count[a]*count[b] times;
+//copies of one sample would only compare diagonal entries, so those never count
+void augmentBootstrapSumsByFields(BootstrapSums* theSums, Field* theX, Field* theY, float* count);
+void augmentBootstrapSumsByFields(BootstrapSums* theSums, Field* theX, Field* theY, float* count)
+{
+    int n = theX->samples;
+    bool isSymmetric = theX->isSymmetric && theY->isSymmetric;
+    for(int a=0; a<n; a++)
+    {
+        if(count[a]==0) continue;
+        float* xRow = theX->element[a];
+        float* yRow = theY->element[a];
+        double pairs = 0, x = 0, y = 0, xx = 0, yy = 0, xy = 0;
+        //Symmetric pairs: the upper triangle, twice
+        for(int b=isSymmetric?a+1:0; b<n; b++)
+        {
+            //Caveat: Skip main diagonal
+            if(b==a) continue;
+            double weight = count[b];
+            pairs += weight;
+            x += weight*xRow[b];
+            y += weight*yRow[b];
+            xx += weight*xRow[b]*xRow[b];
+            yy += weight*yRow[b]*yRow[b];
+            xy += weight*xRow[b]*yRow[b];
+        }
+        double weight = (isSymmetric?2:1)*count[a];
+        theSums->pairs += weight*pairs;
+        theSums->x += weight*x;
+        theSums->y += weight*y;
+        theSums->xx += weight*xx;
+        theSums->yy += weight*yy;
+        theSums->xy += weight*xy;
+    }
+}
+
+//Pearson correlation about the weighted means
+float finishBootstrapSums(BootstrapSums* theSums);
+float finishBootstrapSums(BootstrapSums* theSums)
+{
+    CorrelationAggregate theCA;
+    theCA.numerator = theSums->xy - theSums->x*theSums->y/theSums->pairs;
+    theCA.denominatorL = theSums->xx - theSums->x*theSums->x/theSums->pairs;
+    theCA.denominatorR = theSums->yy - theSums->y*theSums->y/theSums->pairs;
+    return finishCorrelation(&theCA);
+}
+
+void* runBootstrapWorker(void* theWorker);
+void* runBootstrapWorker(void* theWorker)
+{
+    BootstrapWorker* me = theWorker;
+    int numFields = me->lPreserved->numFields;
+    float* count[numFields];
+    for(int f=0; f<numFields; f++)
+        count[f] = allocateArrayOfFloats(me->lPreserved->fields[f]->samples);
+    RandomState theState;
+    
+    for(int b=me->first; b<me->replicates; b+=me->step)
+    {
+        //Seeded per replicate, so results don't depend on the thread count
+        seedRandomState(&theState, me->seed + 2654435761u*(unsigned int)b);
+        BootstrapSums theSums = {0, 0, 0, 0, 0, 0};
+        for(int f=0; f<numFields; f++)
+        {
+            int n = me->lPreserved->fields[f]->samples;
+            memset(count[f], 0, n*sizeof(float));
+            for(int i=0; i<n; i++) count[f][randBelowWithState(&theState, n)]++;
+            augmentBootstrapSumsByFields(&theSums, me->lPreserved->fields[f],
+                                         me->lPermuted->fields[f], count[f]);
+        }
+        me->correlations[b] = finishBootstrapSums(&theSums);
+    }
+    for(int f=0; f<numFields; f++) free(count[f]);
+    return NULL;
+}
+
+//Standard normal distribution function, and its inverse (by bisection)
+double normalCDF(double z);
+double normalCDF(double z)
+{
+    return 0.5*erfc(-z/sqrt(2));
+}
+
+double normalQuantile(double level);
+double normalQuantile(double level)
+{
+    double lo = -40, hi = 40;
+    for(int step=0; step<100; step++)
+    {
+        double mid = (lo+hi)/2;
+        if(normalCDF(mid) < level) lo = mid;
+        else hi = mid;
+    }
+    return (lo+hi)/2;
+}
+
+//Linear interpolation between the order statistics of a sorted list
+float quantileOfSortedList(List* theData, double level);
+float quantileOfSortedList(List* theData, double level)
+{
+    assert(theData->isSorted);
+    double position = level*(theData->count-1);
+    if(position<=0) return theData->data[0];
+    if(position>=theData->count-1) return theData->data[theData->count-1];
+    int below = (int)position;
+    double above = position-below;
+    return (1-above)*theData->data[below] + above*theData->data[below+1];
+}
+
+BootstrapData* correlateAndBootstrapR(Landscape* lPermuted, Landscape* lPreserved,
+                                      int replicates, int threads, unsigned int seed)
+{
+    assert(lPermuted!=NULL);
+    assert(lPreserved!=NULL);
+    assert(lPermuted->numFields == lPreserved->numFields);
+    assert(lPermuted->storage == FIELD_STORAGE_FLOAT);
+    assert(lPreserved->storage == FIELD_STORAGE_FLOAT);
+    assert(replicates>1);
+    assert(threads>0);
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    int numFields = lPermuted->numFields;
+    
+    BootstrapData* theResults = allocateBootstrapData();
+    theResults->correlationType = "Unset";
+    for(int f=0; f<numFields; f++)
+    {
+        assert(lPermuted->fields[f]->samples == lPreserved->fields[f]->samples);
+        modifyPermPermutify(lPermuted->fields[f]->perm, SEED_IDENTITY);
+    }
+    theResults->correlationOfInterest = mantelR(lPreserved, lPermuted, NULL);
+    
+    List* theList = allocateList();
+    theList->count = replicates;
+    theList->data = allocateArrayOfFloats(replicates);
+    theList->isSorted = false;
+    theList->isMeanValid = false;
+    theResults->listOfCorrelations = theList;
+    
+    //Interleaved replicates; the calling thread takes the first share
+    if(threads>replicates) threads = replicates;
+    BootstrapWorker workers[threads];
+    pthread_t ids[threads];
+    for(int t=0; t<threads; t++)
+    {
+        workers[t].lPreserved = lPreserved;
+        workers[t].lPermuted = lPermuted;
+        workers[t].first = t;
+        workers[t].step = threads;
+        workers[t].replicates = replicates;
+        workers[t].seed = seed;
+        workers[t].correlations = theList->data;
+        if(t) pthread_create(&ids[t], NULL, runBootstrapWorker, &workers[t]);
+    }
+    runBootstrapWorker(&workers[0]);
+    for(int t=1; t<threads; t++) pthread_join(ids[t], NULL);
+    
+    modifyListSortify(theList);
+    double alpha = 1-BOOTSTRAP_CONFIDENCE;
+    theResults->percentileLow = quantileOfSortedList(theList, alpha/2);
+    theResults->percentileHigh = quantileOfSortedList(theList, 1-alpha/2);
+    
+    //Bias: how far the replicates sit below the estimate (ties split), kept off 0 and 1
+    double below = 0;
+    for(int b=0; b<replicates; b++)
+    {
+        if(theList->data[b] < theResults->correlationOfInterest) below++;
+        else if(theList->data[b] == theResults->correlationOfInterest) below += 0.5;
+    }
+    below = fmin(fmax(below, 0.5), replicates-0.5);
+    theResults->bias = normalQuantile(below/replicates);
+    
+    //Acceleration: leave out each sample in turn. Its comparisons are its row and column,
+    //so every jackknife correlation comes from the full sums less that sample's share.
+    BootstrapSums all = {0, 0, 0, 0, 0, 0};
+    int totalSamples = 0;
+    for(int f=0; f<numFields; f++) totalSamples += lPreserved->fields[f]->samples;
+    BootstrapSums* share = calloc(totalSamples, sizeof(BootstrapSums));
+    assert(share!=NULL);
+    int offset = 0;
+    for(int f=0; f<numFields; f++)
+    {
+        Field* theX = lPreserved->fields[f];
+        Field* theY = lPermuted->fields[f];
+        for(int i=0; i<theX->samples; i++)
+        {
+            for(int j=0; j<theX->samples; j++)
+            {
+                //Caveat: Skip main diagonal
+                if(i==j) continue;
+                double x = theX->element[i][j], y = theY->element[i][j];
+                BootstrapSums pair = {1, x, y, x*x, y*y, x*y};
+                for(int end=0; end<2; end++)
+                {
+                    BootstrapSums* theShare = &share[offset + (end?j:i)];
+                    theShare->pairs += pair.pairs;
+                    theShare->x += pair.x;
+                    theShare->y += pair.y;
+                    theShare->xx += pair.xx;
+                    theShare->yy += pair.yy;
+                    theShare->xy += pair.xy;
+                }
+                all.pairs += pair.pairs;
+                all.x += pair.x;
+                all.y += pair.y;
+                all.xx += pair.xx;
+                all.yy += pair.yy;
+                all.xy += pair.xy;
+            }
+        }
+        offset += theX->samples;
+    }
+    double* jackknife = malloc(totalSamples*sizeof(double));
+    assert(jackknife!=NULL);
+    double jackknifeMean = 0;
+    for(int k=0; k<totalSamples; k++)
+    {
+        BootstrapSums rest = {all.pairs-share[k].pairs, all.x-share[k].x, all.y-share[k].y,
+                              all.xx-share[k].xx, all.yy-share[k].yy, all.xy-share[k].xy};
+        jackknife[k] = finishBootstrapSums(&rest);
+        jackknifeMean += jackknife[k];
+    }
+    jackknifeMean /= totalSamples;
+    double squares = 0, cubes = 0, d;
+    for(int k=0; k<totalSamples; k++)
+    {
+        d = jackknifeMean-jackknife[k];
+        squares += d*d;
+        cubes += d*d*d;
+    }
+    theResults->acceleration = (squares>0) ? cubes/(6*pow(squares, 1.5)) : 0;
+    free(share);
+    free(jackknife);
+    
+    //BCa: the percentile interval's levels, shifted for bias and skewness
+    double z0 = theResults->bias, a = theResults->acceleration;
+    double zLow = z0 + normalQuantile(alpha/2);
+    double zHigh = z0 + normalQuantile(1-alpha/2);
+    theResults->bcaLow = quantileOfSortedList(theList, normalCDF(z0 + zLow/(1-a*zLow)));
+    theResults->bcaHigh = quantileOfSortedList(theList, normalCDF(z0 + zHigh/(1-a*zHigh)));
+    return theResults;
+}
+
+void saveBootstrapData(BootstrapData* dataToSave, int timestamp)
+{
+    assert(dataToSave!=NULL);
+    
+    char fname[100];
+    sprintf(fname, "testinfo.%d.%s.Bootstrap.txt", 
+            timestamp, dataToSave->correlationType);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "%s correlation is %f\n", 
+            dataToSave->correlationType, dataToSave->correlationOfInterest);
+    fprintf(output, "Over %d bootstrap replicates, %.0f%% intervals on r:\n",
+            dataToSave->listOfCorrelations->count, 100*BOOTSTRAP_CONFIDENCE);
+    fprintf(output, "Percentile [%f, %f]\n", 
+            dataToSave->percentileLow, dataToSave->percentileHigh);
+    fprintf(output, "BCa [%f, %f] (bias %g, acceleration %g)\n", 
+            dataToSave->bcaLow, dataToSave->bcaHigh, dataToSave->bias, dataToSave->acceleration);
+    fclose(output);
+    
+    sprintf(fname, "testinfo.%d.%s.Bootstrap.tdv", 
+            timestamp, dataToSave->correlationType);
+    saveListToTDV(fname, dataToSave->listOfCorrelations);
+}
+
+
+#pragma mark Permutation bank
+
+size_t bankDataOffset(uint32_t numStreams);
+size_t bankDataOffset(uint32_t numStreams)
+{
+    //Header and stream directory, rounded up so permutations start cache-aligned
+    size_t offset = sizeof(BankFileHeader) + numStreams*sizeof(BankStreamEntry);
+    return (offset+63) & ~(size_t)63;
+}
+
+//Bytes of one stream, padded so the next starts cache-aligned
+size_t bankStreamBytes(uint32_t samples, uint32_t trials);
+size_t bankStreamBytes(uint32_t samples, uint32_t trials)
+{
+    size_t width = (samples<=BANK_MAX_NARROW) ? sizeof(uint16_t) : sizeof(uint32_t);
+    return ((size_t)trials*samples*width + 63) & ~(size_t)63;
+}
+
+bool savePermutationBank(const char* filename, int numStreams, int sizes[], int trials,
+                         unsigned int seed)
+{
+    assert(filename!=NULL);
+    assert(numStreams>0);
+    assert(sizes!=NULL);
+    assert(trials>0);
+    
+    FILE* theFile = fopen(filename, "wb");
+    if(theFile==NULL) return false;
+    
+    BankFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BANK_MAGIC, sizeof(header.magic));
+    header.version = BANK_VERSION;
+    header.numStreams = numStreams;
+    header.trials = trials;
+    header.seed = seed;
+    bool good = (fwrite(&header, sizeof(header), 1, theFile) == 1);
+    
+    BankStreamEntry entry;
+    size_t offset = bankDataOffset(numStreams);
+    for(int s=0; s<numStreams && good; s++)
+    {
+        assert(sizes[s]>0);
+        entry.samples = sizes[s];
+        entry.width = (sizes[s]<=BANK_MAX_NARROW) ? sizeof(uint16_t) : sizeof(uint32_t);
+        entry.offset = offset;
+        offset += bankStreamBytes(sizes[s], trials);
+        good = (fwrite(&entry, sizeof(entry), 1, theFile) == 1);
+    }
+    
+    char padding[64];
+    memset(padding, 0, sizeof(padding));
+    size_t written = sizeof(header) + numStreams*sizeof(BankStreamEntry);
+    size_t needed = bankDataOffset(numStreams) - written;
+    if(good && needed) good = (fwrite(padding, 1, needed, theFile) == needed);
+    
+    //Each stream shuffles on from its last permutation, one trial written at a time
+    RandomState theState;
+    for(int s=0; s<numStreams && good; s++)
+    {
+        int n = sizes[s];
+        Perm* thePerm = makePerm(n, SEED_IDENTITY);
+        uint16_t* narrow = (n<=BANK_MAX_NARROW) ? malloc(n*sizeof(uint16_t)) : NULL;
+        uint32_t* wide = (n>BANK_MAX_NARROW) ? malloc(n*sizeof(uint32_t)) : NULL;
+        seedRandomState(&theState, seed + 2654435761u*(unsigned int)s);
+        for(int t=0; t<trials && good; t++)
+        {
+            if(t) modifyPermPermutifyWithState(thePerm, &theState);
+            if(narrow!=NULL)
+            {
+                for(int i=0; i<n; i++) narrow[i] = (uint16_t)thePerm->index[i];
+                good = (fwrite(narrow, sizeof(uint16_t), n, theFile) == (size_t)n);
+            } else {
+                for(int i=0; i<n; i++) wide[i] = (uint32_t)thePerm->index[i];
+                good = (fwrite(wide, sizeof(uint32_t), n, theFile) == (size_t)n);
+            }
+        }
+        needed = bankStreamBytes(n, trials) - (size_t)trials*n*(narrow!=NULL ? 2 : 4);
+        if(good && needed) good = (fwrite(padding, 1, needed, theFile) == needed);
+        free(narrow);
+        free(wide);
+        free(thePerm->index);
+        free(thePerm);
+    }
+    if(fclose(theFile)!=0) good = false;
+    return good;
+}
+
+PermBank* openPermutationBank(const char* filename)
+{
+    assert(filename!=NULL);
+    
+    int fd = open(filename, O_RDONLY);
+    if(fd<0) return NULL;
+    struct stat info;
+    if(fstat(fd, &info)!=0 || (size_t)info.st_size < sizeof(BankFileHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    
+    //Shared read-only mapping: every analysis reading the bank uses the same pages
+    size_t mappingSize = info.st_size;
+    void* mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping==MAP_FAILED) return NULL;
+    
+    BankFileHeader* header = mapping;
+    bool good = !memcmp(header->magic, BANK_MAGIC, sizeof(header->magic)) &&
+                header->version == BANK_VERSION &&
+                header->numStreams > 0 && header->trials > 0 && header->trials <= INT_MAX &&
+                bankDataOffset(header->numStreams) <= mappingSize;
+    
+    //Streams must follow one another exactly as savePermutationBank lays them out
+    BankStreamEntry* streams = (BankStreamEntry*)(header+1);
+    size_t expected = good ? bankDataOffset(header->numStreams) : 0;
+    for(uint32_t s=0; good && s<header->numStreams; s++)
+    {
+        uint32_t samples = streams[s].samples;
+        good = samples>0 && samples<=INT_MAX && streams[s].offset==expected &&
+               streams[s].width==((samples<=BANK_MAX_NARROW) ? 2 : 4);
+        if(good) expected += bankStreamBytes(samples, header->trials);
+        if(good) good = expected<=mappingSize;
+    }
+    
+    //Every trial must be a permutation of its stream's samples, starting from the identity;
+    //kernels index rows with these, so this is checked once here rather than per read.
+    //Stamping seen[index] with the trial number saves clearing it between trials.
+    for(uint32_t s=0; good && s<header->numStreams; s++)
+    {
+        uint32_t samples = streams[s].samples;
+        uint32_t* seen = calloc(samples, sizeof(uint32_t));
+        assert(seen!=NULL);
+        char* row = (char*)mapping + streams[s].offset;
+        uint32_t index;
+        for(uint32_t t=0; good && t<header->trials; t++)
+        {
+            for(uint32_t i=0; good && i<samples; i++)
+            {
+                index = (samples<=BANK_MAX_NARROW) ? ((uint16_t*)row)[i] : ((uint32_t*)row)[i];
+                good = index<samples && seen[index]!=t+1 && (t || index==i);
+                if(good) seen[index] = t+1;
+            }
+            row += (size_t)samples*streams[s].width;
+        }
+        free(seen);
+    }
+    if(!good || expected != mappingSize)
+    {
+        printf("Note: ignoring damaged permutation bank <%s>.\n", filename);
+        munmap(mapping, mappingSize);
+        return NULL;
+    }
+    
+    PermBank* theBank = malloc(sizeof(PermBank));
+    theBank->numStreams = header->numStreams;
+    theBank->trials = header->trials;
+    theBank->seed = header->seed;
+    theBank->streams = streams;
+    theBank->mapping = mapping;
+    theBank->mappingSize = mappingSize;
+    return theBank;
+}
+
+void closePermutationBank(PermBank* theBank)
+{
+    if(theBank==NULL) return;
+    munmap(theBank->mapping, theBank->mappingSize);
+    free(theBank);
+}
+
+int* makeBankStreamsForLandscape(PermBank* theBank, Landscape* theData)
+{
+    assert(theBank!=NULL);
+    assert(theData!=NULL);
+    
+    int* streams = allocateArrayOfInts(theData->numFields);
+    for(int f=0; f<theData->numFields; f++)
+    {
+        //Fields of this size already matched to earlier streams
+        int samples = theData->fields[f]->samples;
+        int skip = 0;
+        for(int g=0; g<f; g++) if(theData->fields[g]->samples==samples) skip++;
+        
+        streams[f] = -1;
+        for(int s=0; s<theBank->numStreams && streams[f]<0; s++)
+        {
+            if((int)theBank->streams[s].samples!=samples) continue;
+            if(skip) skip--;
+            else streams[f] = s;
+        }
+        if(streams[f]<0)
+        {
+            free(streams);
+            return NULL;
+        }
+    }
+    return streams;
+}
+
+void modifyPermFromBank(Perm* thePerm, PermBank* theBank, int stream, int trial)
+{
+    assert(thePerm!=NULL);
+    assert(theBank!=NULL);
+    assert(stream>=0 && stream<theBank->numStreams);
+    assert(trial>=0 && trial<theBank->trials);
+    
+    BankStreamEntry* entry = &theBank->streams[stream];
+    int n = thePerm->size;
+    assert((int)entry->samples == n);
+    char* row = (char*)theBank->mapping + entry->offset + (size_t)trial*n*entry->width;
+    int* index = thePerm->index;
+    if(entry->width==sizeof(uint16_t))
+    {
+        uint16_t* narrow = (uint16_t*)row;
+        for(int i=0; i<n; i++) index[i] = narrow[i];
+    } else {
+        uint32_t* wide = (uint32_t*)row;
+        for(int i=0; i<n; i++) index[i] = wide[i];
+    }
+    thePerm->isIdentity = (!trial || n<2);
 }
 
-StatisticalData* allocateStatData(void)
+/**
+ * @brief One thread's share of a banked permutation test
+ */
+typedef struct {
+    Landscape* lPreserved;
+    Landscape* lPermuted;
+    PermBank* bank;
+    int* streams;        /**< Bank stream for each field */
+    int first;           /**< First trial */
+    int last;            /**< One past the last trial */
+    float* correlations; /**< Shared; each trial's slot */
+} BankWorker;
+
+void* runBankWorker(void* theWorker);
+void* runBankWorker(void* theWorker)
 {
-    return malloc(sizeof(StatisticalData));
+    BankWorker* me = theWorker;
+    
+    //Own permutations over shared elements; a run of trials reads the bank in order
+    Landscape* lPermuted = makeLandscapeViewOfLandscape(me->lPermuted);
+    CorrelationAggregate* aCA = allocateCA();
+    for(int perm=me->first; perm<me->last; perm++)
+    {
+        for(int f=0; f<lPermuted->numFields; f++)
+            modifyPermFromBank(lPermuted->fields[f]->perm, me->bank, me->streams[f], perm);
+        me->correlations[perm] = mantelR(me->lPreserved, lPermuted, aCA);
+    }
+    free(aCA);
+    freeLandscape(lPermuted);
+    return NULL;
 }
 
-StatisticalData* correlateAndFindP(Landscape* lPermuted, 
-                                   Landscape* lPreserved, 
-                                   int trials)
+StatisticalData* correlateAndFindPFromBank(Landscape* lPermuted, Landscape* lPreserved,
+                                           int trials, int threads, PermBank* theBank)
 {
     assert(lPermuted!=NULL);
     assert(lPreserved!=NULL);
     assert(lPermuted->numFields == lPreserved->numFields);
+    assert(theBank!=NULL);
+    assert(trials>0 && trials<=theBank->trials);
+    assert(threads>0);
+    
+    int* streams = makeBankStreamsForLandscape(theBank, lPermuted);
+    assert(streams!=NULL);
+    
     StatisticalData* theResults=allocateStatData();
     theResults->listOfCorrelations = allocateList();
     theResults->listOfCorrelations->count = trials;
     theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
-    float currentCor;
-    CorrelationAggregate* aCA = allocateCA();
-
+    theResults->listOfCorrelations->isSorted = false;
+    theResults->listOfCorrelations->isMeanValid = false;
     theResults->correlationType = "Unset";
-
+    
     modifyLandscapeMeanify(lPreserved);
     modifyLandscapeMeanify(lPermuted);
-
-    for(int perm=0; perm<trials; perm++)
+    
+    theResults->storageErrorBound = -1.0;
+    if(lPreserved->storage!=FIELD_STORAGE_FLOAT || lPermuted->storage!=FIELD_STORAGE_FLOAT)
     {
-        //Make new random permutations
-        for(int f=0; f<lPreserved->numFields; f++)
-        {
-            //Identity permutation the first time through, random the rest
-            modifyPermPermutify(lPermuted->fields[f]->perm,
-                                (!perm)?SEED_IDENTITY:SEED_RANDOM);
-        }
-        
-        currentCor=mantelR(lPreserved, lPermuted, aCA);
-        theResults->listOfCorrelations->data[perm] = currentCor;
-        //Store the first result specially
-        if(!perm) theResults->correlationOfInterest = currentCor;
+        theResults->storageErrorBound = fmaxf(lPreserved->storageErrorBound,
+                                              lPermuted->storageErrorBound);
     }
+    
+    //Contiguous shares; the calling thread takes the first
+    if(threads>trials) threads = trials;
+    BankWorker workers[threads];
+    pthread_t ids[threads];
+    for(int t=0; t<threads; t++)
+    {
+        workers[t].lPreserved = lPreserved;
+        workers[t].lPermuted = lPermuted;
+        workers[t].bank = theBank;
+        workers[t].streams = streams;
+        workers[t].first = (int)((long long)t*trials/threads);
+        workers[t].last = (int)((long long)(t+1)*trials/threads);
+        workers[t].correlations = theResults->listOfCorrelations->data;
+        if(t) pthread_create(&ids[t], NULL, runBankWorker, &workers[t]);
+    }
+    runBankWorker(&workers[0]);
+    for(int t=1; t<threads; t++) pthread_join(ids[t], NULL);
+    free(streams);
+    
+    //Trial 0 is the identity throughout
+    theResults->correlationOfInterest = theResults->listOfCorrelations->data[0];
     modifyListSortify(theResults->listOfCorrelations);
     theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
                                              theResults->listOfCorrelations, 
@@ -640,151 +6319,490 @@ StatisticalData* correlateAndFindP(Landscape* lPermuted,
     return theResults;
 }
 
-StatisticalData* correlatePartialAndFindP(Landscape* lPermuted, 
-                                          Landscape* lPreserved, 
-                                          Landscape* lGiven, 
-                                          int trials)
+
+#pragma mark Batch
+FieldCache* allocateFieldCache(void)
 {
-    assert(lPermuted!=NULL);
-    assert(lPreserved!=NULL);
-    assert(lGiven!=NULL);
-    
-    assert(lPermuted->numFields == lPreserved->numFields);
-    assert(lGiven->numFields == lPreserved->numFields);
+    return malloc(sizeof(FieldCache));
+}
+
+void initializeFieldCache(FieldCache* theCache)
+{
+    assert(theCache!=NULL);
     
-    StatisticalData* theResults=allocateStatData();
-    theResults->listOfCorrelations = allocateList();
-    theResults->listOfCorrelations->count = trials;
-    theResults->listOfCorrelations->data = allocateArrayOfFloats(trials);
-    float currentCor;
-    CorrelationAggregate* aCA = allocateCA();
+    theCache->entries = NULL;
+    theCache->count = 0;
+    theCache->capacity = 0;
+    pthread_mutex_init(&theCache->lock, NULL);
+    pthread_cond_init(&theCache->filled, NULL);
+    theCache->cacheDir = NULL;
+    theCache->cacheLimit = 0;
+}
+
+char* makeCacheKey(const char* kind, int files, char* filenames[]);
+char* makeCacheKey(const char* kind, int files, char* filenames[])
+{
+    size_t length = strlen(kind)+2;
+    for(int i=0; i<files; i++) length += strlen(filenames[i])+1;
     
-    theResults->correlationType = "Unset";
+    char* key = malloc(length);
+    strcpy(key, kind);
+    strcat(key, ":");
+    for(int i=0; i<files; i++)
+    {
+        if(i) strcat(key, "\t");
+        strcat(key, filenames[i]);
+    }
+    return key;
+}
+
+//Caller must hold theCache->lock
+CacheEntry* findCacheEntry(FieldCache* theCache, const char* key);
+CacheEntry* findCacheEntry(FieldCache* theCache, const char* key)
+{
+    for(int i=0; i<theCache->count; i++)
+    {
+        if(!strcmp(theCache->entries[i]->key, key)) return theCache->entries[i];
+    }
+    return NULL;
+}
+
+//Caller must hold theCache->lock. Takes ownership of key.
+//Returns TRUE if this is the first registration for key.
+bool registerCacheKey(FieldCache* theCache, char* key);
+bool registerCacheKey(FieldCache* theCache, char* key)
+{
+    CacheEntry* theEntry = findCacheEntry(theCache, key);
+    if(theEntry!=NULL)
+    {
+        theEntry->references++;
+        free(key);
+        return false;
+    }
     
-    modifyLandscapeMeanify(lPreserved);
-    modifyLandscapeMeanify(lPermuted);
-    modifyLandscapeMeanify(lGiven);
+    if(theCache->count == theCache->capacity)
+    {
+        theCache->capacity = theCache->capacity ? 2*theCache->capacity : 16;
+        theCache->entries = realloc(theCache->entries, 
+                                    theCache->capacity*sizeof(CacheEntry*));
+        assert(theCache->entries!=NULL);
+    }
+    theEntry = malloc(sizeof(CacheEntry));
+    theEntry->key = key;
+    theEntry->field = NULL;
+    theEntry->landscape = NULL;
+    theEntry->references = 1;
+    theEntry->isLoading = false;
+    theEntry->isReady = false;
+    theCache->entries[theCache->count++] = theEntry;
+    return true;
+}
+
+void registerCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked)
+{
+    assert(theCache!=NULL);
+    assert(filenames!=NULL);
     
-    for(int perm=0; perm<trials; perm++)
+    pthread_mutex_lock(&theCache->lock);
+    char* key = makeCacheKey(isRanked ? "spearman" : "pearson", files, filenames);
+    if(registerCacheKey(theCache, key))
     {
-        //Make new random permutations
-        for(int f=0; f<lPreserved->numFields; f++)
+        //Landscape gets built once, reading each raw field once
+        for(int i=0; i<files; i++)
         {
-            //Identity permutation the first time through, random the rest
-            modifyPermPermutify(lPermuted->fields[f]->perm,
-                                (!perm)?SEED_IDENTITY:SEED_RANDOM);
+            registerCacheKey(theCache, makeCacheKey("raw", 1, &filenames[i]));
         }
-        
-        currentCor=mantelRPartial(lPermuted, lPreserved, lGiven, aCA);
-        theResults->listOfCorrelations->data[perm] = currentCor;
-        //Store the first result specially
-        if(!perm) theResults->correlationOfInterest = currentCor;
     }
-    modifyListSortify(theResults->listOfCorrelations);
-    theResults->rankInfo = computeRankInList(theResults->correlationOfInterest, 
-                                             theResults->listOfCorrelations, 
-                                             NULL);
-    return theResults;
+    pthread_mutex_unlock(&theCache->lock);
 }
 
+//Returns an entry whose contents this thread must fill in, or NULL if it's
+//already been filled. Caller must hold theCache->lock.
+CacheEntry* waitForCacheEntry(FieldCache* theCache, CacheEntry* theEntry);
+CacheEntry* waitForCacheEntry(FieldCache* theCache, CacheEntry* theEntry)
+{
+    if(!theEntry->isLoading)
+    {
+        theEntry->isLoading = true;
+        return theEntry;
+    }
+    while(!theEntry->isReady) pthread_cond_wait(&theCache->filled, &theCache->lock);
+    return NULL;
+}
 
-void saveData(StatisticalData* dataToSave, int timestamp)
+//Caller must hold theCache->lock
+void finishCacheEntry(FieldCache* theCache, CacheEntry* theEntry);
+void finishCacheEntry(FieldCache* theCache, CacheEntry* theEntry)
 {
-    assert(dataToSave!=NULL);
+    theEntry->isReady = true;
+    pthread_cond_broadcast(&theCache->filled);
+}
+
+//Caller must hold theCache->lock
+void releaseCacheEntry(CacheEntry* theEntry);
+void releaseCacheEntry(CacheEntry* theEntry)
+{
+    assert(theEntry->references>0);
+    theEntry->references--;
+    if(theEntry->references) return;
     
-    FILE* output = NULL;
-    char fname[100];
+    freeField(theEntry->field);
+    freeLandscape(theEntry->landscape);
+    theEntry->field = NULL;
+    theEntry->landscape = NULL;
+}
+
+Field* acquireCachedField(FieldCache* theCache, char* filename);
+Field* acquireCachedField(FieldCache* theCache, char* filename)
+{
+    char* key = makeCacheKey("raw", 1, &filename);
+    pthread_mutex_lock(&theCache->lock);
+    CacheEntry* theEntry = findCacheEntry(theCache, key);
+    assert(theEntry!=NULL); //Should have been registered
+    free(key);
     
-    int trials = dataToSave->listOfCorrelations->count;
-    float rank = dataToSave->rankInfo->rank+1;
+    if(waitForCacheEntry(theCache, theEntry)!=NULL)
+    {
+        //Parse without holding up everyone else
+        pthread_mutex_unlock(&theCache->lock);
+        Field* theField = makeFieldFromTDV(filename);
+        pthread_mutex_lock(&theCache->lock);
+        theEntry->field = theField;
+        finishCacheEntry(theCache, theEntry);
+    }
+    Field* theField = theEntry->field;
+    pthread_mutex_unlock(&theCache->lock);
+    return theField;
+}
+
+void releaseCachedField(FieldCache* theCache, char* filename);
+void releaseCachedField(FieldCache* theCache, char* filename)
+{
+    char* key = makeCacheKey("raw", 1, &filename);
+    pthread_mutex_lock(&theCache->lock);
+    CacheEntry* theEntry = findCacheEntry(theCache, key);
+    assert(theEntry!=NULL);
+    free(key);
+    releaseCacheEntry(theEntry);
+    pthread_mutex_unlock(&theCache->lock);
+}
+
+Landscape* acquireCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked)
+{
+    assert(theCache!=NULL);
+    assert(filenames!=NULL);
     
-    sprintf(fname, "testinfo.%d.%s.%s", 
-            timestamp, dataToSave->correlationType, "txt");
-    output = fopen(fname, "w");
-    fprintf(output, "%s correlation is %f\n", 
-            dataToSave->correlationType,
-            dataToSave->correlationOfInterest);
-    fprintf(output, "In %d trials, %d matches had average rank %f\n", 
-            trials, dataToSave->rankInfo->count, rank);
-    fprintf(output, "Assuming uniqueness, %f of the trials were >=\n", 
-            (trials - rank)/(FLOATIFY*trials));
-    fprintf(output, "Assuming uniqueness, %f of the trials were <=\n", 
-            (rank)/(FLOATIFY*trials));
-    fclose(output);
+    char* key = makeCacheKey(isRanked ? "spearman" : "pearson", files, filenames);
+    pthread_mutex_lock(&theCache->lock);
+    CacheEntry* theEntry = findCacheEntry(theCache, key);
+    assert(theEntry!=NULL); //Should have been registered
+    free(key);
     
-    sprintf(fname, "testinfo.%d.%s.%s", 
-            timestamp, dataToSave->correlationType, "tdv");
-    saveListToTDV(fname, dataToSave->listOfCorrelations);
+    if(waitForCacheEntry(theCache, theEntry)!=NULL)
+    {
+        pthread_mutex_unlock(&theCache->lock);
+        
+        Landscape* theScape;
+        Field* fields[files];
+        if(theCache->cacheDir!=NULL)
+        {
+            //Preprocessed on disk, perhaps by an earlier run
+            theScape = makeLandscapeFromCache(theCache->cacheDir, theCache->cacheLimit, 
+                                              files, (const char**)filenames, isRanked);
+            //Raw fields aren't needed after all
+            for(int i=0; i<files; i++) releaseCachedField(theCache, filenames[i]);
+        } else {
+            //Work on copies, since raw fields may be wanted by other landscapes
+            for(int i=0; i<files; i++)
+            {
+                fields[i] = makeFieldFromField(acquireCachedField(theCache, filenames[i]));
+                releaseCachedField(theCache, filenames[i]);
+            }
+            theScape = makeLandscapeFromFields(files, fields);
+            if(isRanked) modifyLandscapeRankify(theScape);
+            modifyLandscapeMeanify(theScape);
+        }
+        
+        pthread_mutex_lock(&theCache->lock);
+        theEntry->landscape = theScape;
+        finishCacheEntry(theCache, theEntry);
+    }
+    Landscape* theScape = theEntry->landscape;
+    pthread_mutex_unlock(&theCache->lock);
+    return theScape;
 }
 
-void processFilePairs(int trials, int filesets, const char* argv[], int timestamp)
+void releaseCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked)
 {
-    const char* s[filesets]; //static: distances
-    const char* p[filesets]; //permuted: differences
-    int groupSize=2;
-    int firstFile=2;
-    for(int i=0; i<filesets; i++)
+    assert(theCache!=NULL);
+    assert(filenames!=NULL);
+    
+    char* key = makeCacheKey(isRanked ? "spearman" : "pearson", files, filenames);
+    pthread_mutex_lock(&theCache->lock);
+    CacheEntry* theEntry = findCacheEntry(theCache, key);
+    assert(theEntry!=NULL);
+    free(key);
+    releaseCacheEntry(theEntry);
+    pthread_mutex_unlock(&theCache->lock);
+}
+
+int readManifest(const char* manifest, BatchJob** jobs);
+int readManifest(const char* manifest, BatchJob** jobs)
+{
+    FILE* theFile = fopen(manifest, "r");
+    if(theFile==NULL)
     {
-        s[i] = argv[groupSize*i+firstFile];
-        p[i] = argv[groupSize*i+firstFile+1];
+        printf("ERROR: Can't open manifest <%s>.\n", manifest);
+        return -1;
     }
     
-    //Load data
-    Landscape* lPreserved = makeLandscapeFromTDVs(filesets, s);
-    Landscape* lPermuted = makeLandscapeFromTDVs(filesets, p);
-    
-    StatisticalData* theStats = NULL;
+    int numJobs = 0, capacity = 0, lineNumber = 0;
+    int files;
+    char* line = NULL;
+    size_t lineSize = 0;
+    char* token;
+    BatchJob* theJob;
+    *jobs = NULL;
     
-    //Pearson correlation
-    theStats = correlateAndFindP(lPermuted, lPreserved, trials);
-    theStats->correlationType = "Pearson";
-    saveData(theStats, timestamp);
+    while(getline(&line, &lineSize, theFile) != -1)
+    {
+        lineNumber++;
+        token = strtok(line, " \t\r\n");
+        //Skip blank lines and comments
+        if(token==NULL || token[0]=='#') continue;
+        
+        if(numJobs == capacity)
+        {
+            capacity = capacity ? 2*capacity : 16;
+            *jobs = realloc(*jobs, capacity*sizeof(BatchJob));
+            assert(*jobs!=NULL);
+        }
+        theJob = &(*jobs)[numJobs];
+        if(!strcmp(token, "pair")) theJob->groupSize = 2;
+        else if(!strcmp(token, "triple")) theJob->groupSize = 3;
+        else
+        {
+            printf("ERROR: Manifest line %d: expected pair or triple, not <%s>.\n", 
+                   lineNumber, token);
+            numJobs = -1;
+            break;
+        }
+        
+        token = strtok(NULL, " \t\r\n");
+        theJob->trials = (token==NULL) ? 0 : atoi(token);
+        theJob->filenames = NULL;
+        files = 0;
+        while((token = strtok(NULL, " \t\r\n")) != NULL)
+        {
+            theJob->filenames = realloc(theJob->filenames, (files+1)*sizeof(char*));
+            theJob->filenames[files++] = strdup(token);
+        }
+        if(theJob->trials<=0 || files==0 || files%theJob->groupSize!=0)
+        {
+            printf("ERROR: Manifest line %d: need {trials} and files in groups of %d.\n", 
+                   lineNumber, theJob->groupSize);
+            numJobs = -1;
+            break;
+        }
+        theJob->filesets = files/theJob->groupSize;
+        numJobs++;
+    }
+    free(line);
+    fclose(theFile);
+    return numJobs;
+}
+
+/**
+ * @brief Shared state for the batch worker threads
+ */
+typedef struct {
+    FieldCache* cache;     /**< Landscapes shared by all jobs */
+    BatchJob* jobs;        /**< Every job in the manifest */
+    int numJobs;           /**< Number of jobs */
+    int nextJob;           /**< First job nobody has claimed */
+    int timestamp;         /**< Seeds each job's random stream */
+    bool residual;         /**< Triples permute residuals (Freedman-Lane) */
+    PermBank* bank;        /**< Pairs it covers draw their trials from it (NULL for off) */
+    pthread_mutex_t lock;  /**< Guards nextJob */
+} BatchQueue;
+
+void runBatchJob(FieldCache* theCache, BatchJob* theJob, unsigned int seed, bool residual,
+                 PermBank* theBank);
+void runBatchJob(FieldCache* theCache, BatchJob* theJob, unsigned int seed, bool residual,
+                 PermBank* theBank)
+{
+    int n = theJob->filesets;
+    char* names[3][n];
+    Landscape* scapes[3];
+    Landscape* lPermuted;
+    StatisticalData* theStats;
+    RandomState theState;
+    int* streams;
+    bool isBanked = false;
     
-    //Rank data
-    modifyLandscapeRankify(lPreserved);
-    modifyLandscapeRankify(lPermuted);
+    //Roles, as on the command line: preserved, permuted, given
+    for(int role=0; role<theJob->groupSize; role++)
+        for(int i=0; i<n; i++)
+            names[role][i] = theJob->filenames[theJob->groupSize*i+role];
     
-    //Spearman correlation
-    theStats = correlateAndFindP(lPermuted, lPreserved, trials);
-    theStats->correlationType = "Spearman";
-    saveData(theStats, timestamp);
+    //Pearson, then Spearman
+    for(int ranked=0; ranked<2; ranked++)
+    {
+        seedRandomState(&theState, 2*seed+ranked);
+        for(int role=0; role<theJob->groupSize; role++)
+            scapes[role] = acquireCachedLandscape(theCache, n, names[role], ranked);
+        
+        //Shared landscapes stay untouched; permute through a private view
+        lPermuted = makeLandscapeViewOfLandscape(scapes[1]);
+        //Pairs the bank covers use its trials, as many as it holds; the rest draw their own.
+        //Ranking keeps field sizes, so the first pass decides for both.
+        if(!ranked && theJob->groupSize==2 && theBank!=NULL)
+        {
+            streams = makeBankStreamsForLandscape(theBank, lPermuted);
+            isBanked = (streams!=NULL);
+            free(streams);
+            if(!isBanked)
+                printf("Note: bank lacks streams for the job on <%s>; drawing permutations instead.\n",
+                       theJob->filenames[0]);
+            else if(theJob->trials > theBank->trials)
+            {
+                printf("Note: bank holds %d trials; the job on <%s> runs that many.\n",
+                       theBank->trials, theJob->filenames[0]);
+                theJob->trials = theBank->trials;
+            }
+        }
+        if(isBanked)
+            theStats = correlateAndFindPFromBank(lPermuted, scapes[0], theJob->trials, 1, theBank);
+        else if(theJob->groupSize==2)
+            theStats = correlateAndFindPWithState(lPermuted, scapes[0], 
+                                                  theJob->trials, &theState);
+        else if(residual)
+            theStats = correlateResidualsAndFindPWithState(lPermuted, scapes[0], scapes[2],
+                                                           theJob->trials, &theState);
+        else
+            theStats = correlatePartialAndFindPWithState(lPermuted, scapes[0], scapes[2],
+                                                         theJob->trials, &theState);
+        theJob->correlation[ranked] = theStats->correlationOfInterest;
+        theJob->pValue[ranked] = fractionAtLeast(theStats->listOfCorrelations,
+                                                 theStats->correlationOfInterest);
+        
+        free(theStats->listOfCorrelations->data);
+        free(theStats->listOfCorrelations);
+        free(theStats->rankInfo);
+        free(theStats);
+        freeLandscape(lPermuted);
+        for(int role=0; role<theJob->groupSize; role++)
+            releaseCachedLandscape(theCache, n, names[role], ranked);
+    }
 }
 
-void processFileTriples(int trials, int filesets, const char* argv[], int timestamp)
+void* runBatchWorker(void* theQueue);
+void* runBatchWorker(void* theQueue)
 {
-    const char* s[filesets]; //static: distances
-    const char* p[filesets]; //permuted: differences
-    const char* g[filesets]; //given: differences to relativize by
-    int groupSize = 3;
-    int firstFile = 2;
-    for(int i=0; i<filesets; i++)
+    BatchQueue* queue = theQueue;
+    int current;
+    while(true)
     {
-        s[i] = argv[groupSize*i+firstFile];
-        p[i] = argv[groupSize*i+firstFile+1];
-        g[i] = argv[groupSize*i+firstFile+2];
+        pthread_mutex_lock(&queue->lock);
+        current = queue->nextJob++;
+        pthread_mutex_unlock(&queue->lock);
+        if(current >= queue->numJobs) break;
+        
+        //Seed by job, so results don't depend on which thread ran what
+        runBatchJob(queue->cache, &queue->jobs[current], queue->timestamp+current,
+                    queue->residual, queue->bank);
     }
+    return NULL;
+}
+
+int processManifest(const char* manifest, int timestamp, RunOptions* options)
+{
+    assert(manifest!=NULL);
+    assert(options!=NULL);
     
-    //Load data
-    Landscape* lPreserved = makeLandscapeFromTDVs(filesets, s);
-    Landscape* lPermuted = makeLandscapeFromTDVs(filesets, p);
-    Landscape* lGiven = makeLandscapeFromTDVs(filesets, g);
+    BatchJob* jobs = NULL;
+    int numJobs = readManifest(manifest, &jobs);
+    if(numJobs<0) return -1;
     
-    StatisticalData* theStats = NULL;
+    FieldCache* theCache = allocateFieldCache();
+    initializeFieldCache(theCache);
+    theCache->cacheDir = options->cacheDir;
+    theCache->cacheLimit = options->cacheLimit;
     
-    //Pearson correlation
-    theStats = correlatePartialAndFindP(lPermuted, lPreserved, lGiven, trials);
-    theStats->correlationType = "Pearson (Partial)";
-    saveData(theStats, timestamp);
+    //Count every use up front, so entries can be freed after their last job
+    int n;
+    for(int j=0; j<numJobs; j++)
+    {
+        n = jobs[j].filesets;
+        char* names[n];
+        for(int role=0; role<jobs[j].groupSize; role++)
+        {
+            for(int i=0; i<n; i++) names[i] = jobs[j].filenames[jobs[j].groupSize*i+role];
+            registerCachedLandscape(theCache, n, names, false);
+            registerCachedLandscape(theCache, n, names, true);
+        }
+    }
     
-    //Rank data
-    modifyLandscapeRankify(lPreserved);
-    modifyLandscapeRankify(lPermuted);
-    modifyLandscapeRankify(lGiven);
+    BatchQueue queue;
+    queue.cache = theCache;
+    queue.jobs = jobs;
+    queue.numJobs = numJobs;
+    queue.nextJob = 0;
+    queue.timestamp = timestamp;
+    queue.residual = options->residual;
+    queue.bank = (options->bankFile!=NULL) ? openPermutationBank(options->bankFile) : NULL;
+    pthread_mutex_init(&queue.lock, NULL);
     
-    //Spearman correlation
-    theStats = correlatePartialAndFindP(lPermuted, lPreserved, lGiven, trials);
-    theStats->correlationType = "Spearman (Partial)";
-    saveData(theStats, timestamp);
+    int numThreads = (options->threads>0) ? options->threads : 1;
+    pthread_t workers[numThreads];
+    for(int t=0; t<numThreads; t++)
+    {
+        pthread_create(&workers[t], NULL, runBatchWorker, &queue);
+    }
+    for(int t=0; t<numThreads; t++)
+    {
+        pthread_join(workers[t], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    closePermutationBank(queue.bank);
+    
+    //One consolidated file, in manifest order
+    char fname[100];
+    sprintf(fname, "testinfo.%d.Batch.tdv", timestamp);
+    FILE* output = fopen(fname, "w");
+    assert(output!=NULL);
+    fprintf(output, "Job\tType\tTrials\tFiles\tPearson\tPearson p\tSpearman\tSpearman p\n");
+    int files;
+    for(int j=0; j<numJobs; j++)
+    {
+        fprintf(output, "%d\t%s\t%d\t", j+1, (jobs[j].groupSize==2) ? "pair" : "triple",
+                jobs[j].trials);
+        files = jobs[j].filesets*jobs[j].groupSize;
+        for(int i=0; i<files; i++)
+        {
+            fprintf(output, "%s%s", i ? "," : "", jobs[j].filenames[i]);
+            free(jobs[j].filenames[i]);
+        }
+        fprintf(output, "\t%f\t%f\t%f\t%f\n", 
+                jobs[j].correlation[0], jobs[j].pValue[0],
+                jobs[j].correlation[1], jobs[j].pValue[1]);
+        free(jobs[j].filenames);
+    }
+    fclose(output);
+    free(jobs);
+    
+    for(int i=0; i<theCache->count; i++)
+    {
+        assert(theCache->entries[i]->references==0);
+        free(theCache->entries[i]->key);
+        free(theCache->entries[i]);
+    }
+    free(theCache->entries);
+    pthread_mutex_destroy(&theCache->lock);
+    pthread_cond_destroy(&theCache->filled);
+    free(theCache);
+    
+    return numJobs;
 }
 
 
@@ -959,8 +6977,8 @@ rankAndCount* computeRankInList(float datum, List* theData,
     }
     
     ilo=ihi=iguess; //Expand match to range
-    while(theData->data[ilo]==datum && ilo>=0) ilo--; //find pre-firt-match
-    while(theData->data[ihi]==datum && ihi<theData->count) ihi++; //find post-last-match
+    while(ilo>=0 && theData->data[ilo]==datum) ilo--; //find pre-firt-match
+    while(ihi<theData->count && theData->data[ihi]==datum) ihi++; //find post-last-match
     
     //Construct answer
     theRank->count = ((ihi-1)-ilo); //Elements between low and high
@@ -979,10 +6997,11 @@ List*  makeListFromLandscape(Landscape* theData)
 {
     assert(theData!=NULL);
     if(theData->hasFlatVersion) return theData->flatVersion;
+    assert(theData->storage==FIELD_STORAGE_FLOAT);
     
-    //Create a list of the appropriate size
+    //Create a list of the appropriate size; symmetric data needs one triangle
     List* theList = allocateList();
-    theList->count = theData->numNonDiagElts;
+    theList->count = theData->isSymmetric ? theData->numNonDiagElts/2 : theData->numNonDiagElts;
     theList->data = allocateArrayOfFloats(theList->count);
     theList->isSorted = false;
     
@@ -998,15 +7017,15 @@ List*  makeListFromLandscape(Landscape* theData)
         
         for(int x=0; x<theField->samples; x++)
         {
-            for(int y=0; y<theField->samples; y++)
+            for(int y=(theData->isSymmetric ? x+1 : 0); y<theField->samples; y++)
             {
                 //Caveat: Skip main diagonal
                 if(x!=y) 
                 {
-                    index++;
                     currentElement = theField->element[x][y];
                     theList->data[index] = currentElement;
                     runningTotal += currentElement;
+                    index++;
                 }
             }
         }
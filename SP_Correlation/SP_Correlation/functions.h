@@ -9,6 +9,8 @@
 
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "defines.h"
 
 #pragma mark Utility
@@ -18,13 +20,63 @@ float** allocateArrayOfArraysOfFloats(int howmany);
 int* allocateArrayOfInts(int howmany);
 
 /**
- * @brief Generate random number in a given range
+ * @brief Generate random number in a given range from the shared stream
  * @param lo Smallest number allowable for output
  * @param hi Largest number allowable for output
  * @returns integer n, lo<=n<=hi
  */
 int randInRange(int lo, int hi);
 
+/**
+ * @brief Read the monotonic clock
+ * @returns Seconds since some fixed point in the past
+ */
+double secondsNow(void);
+
+/**
+ * @brief Stream of random numbers: RANDOM_LANES interleaved xoshiro256** generators,
+ * drawn ahead in batches
+ */
+typedef struct {
+    uint64_t lane[4][RANDOM_LANES]; /**< Generator state, one column per lane */
+    uint32_t batch[RANDOM_BATCH];   /**< Numbers drawn ahead, handed out in order */
+    int used;                       /**< Entries of batch already handed out */
+    bool isSeeded;                  /**< FALSE for a zeroed state; it seeds itself with 1 */
+} RandomState;
+
+/**
+ * @brief Start a private random number stream
+ * @param theState RandomState to initialize
+ * @param seed Any value; equal seeds give equal streams
+ * @sideeffect Sets the state of theState
+ */
+void seedRandomState(RandomState* theState, unsigned int seed);
+
+/**
+ * @brief Restart the shared stream used by randInRange and modifyPermPermutify
+ * @param seed Any value; equal seeds give equal streams
+ */
+void seedRandom(unsigned int seed);
+
+/**
+ * @brief Unbiased random number below a bound (Lemire's multiply-shift method)
+ * @param theState Stream to draw from
+ * @param range Number of possible outputs, at least 1
+ * @returns integer n, 0<=n<range
+ * @sideeffect Advances theState
+ */
+uint32_t randBelowWithState(RandomState* theState, uint32_t range);
+
+/**
+ * @brief Generate random number in a given range from a private stream
+ * @param theState Stream to draw from
+ * @param lo Smallest number allowable for output
+ * @param hi Largest number allowable for output
+ * @returns integer n, lo<=n<=hi
+ * @sideeffect Advances theState
+ */
+int randInRangeWithState(RandomState* theState, int lo, int hi);
+
 /**
  * @brief Check if inputs are in desired order
  * @param l Allegedly first element
@@ -91,6 +143,7 @@ float finishCorrelation(CorrelationAggregate* theCA);
 typedef struct {
     int * index; /**< Array of indices */
     int size;    /**< Number of indices */
+    bool isIdentity; /**< TRUE while index[i]==i throughout, so kernels can read rows directly */
 } Perm;
 
 Perm* allocatePermutation(void);
@@ -111,6 +164,14 @@ Perm* makePerm(int size, int seed); //0 id, -1 no seed
  */
 void modifyPermPermutify(Perm* thePerm, int seed);
 
+/**
+ * @brief Randomly permute a permutation using a private stream
+ * @param thePerm Permutation to permute
+ * @param theState Stream to draw from
+ * @sideeffect Permutes thePerm, advances theState
+ */
+void modifyPermPermutifyWithState(Perm* thePerm, RandomState* theState);
+
 #pragma mark Lists
 /**
  * @brief Represents a vector of floats, tracking mean and sortedness.
@@ -200,10 +261,30 @@ typedef struct {
     bool hasFlatVersion; /**< FALSE unless a flattened version has been generated */
     List* flatVersion;   /**< All elements arranged into a 1D array */
     Perm* perm;
+    int storage;         /**< FIELD_STORAGE_* layout of the comparisons */
+    void* packed;        /**< Row-major compact comparisons (NULL for FIELD_STORAGE_FLOAT) */
+    float scale;         /**< Quantized comparisons widen to offset+scale*q */
+    float offset;        /**< Quantized comparisons widen to offset+scale*q */
+    float errorBound;    /**< Largest |full - widened| comparison seen when compacting */
+    bool sharesElements; /**< TRUE when element/packed belong to another field */
+    bool isSymmetric;    /**< TRUE when element[x][y]==element[y][x] throughout */
 } Field;
 
 Field* allocateField(void);
 
+/**
+ * @brief Create a Field by copying another field
+ * @param theField Field (FIELD_STORAGE_FLOAT) to copy
+ * @returns a deep copy of theField with an identity permutation
+ */
+Field* makeFieldFromField(Field* theField);
+
+/**
+ * @brief Release a field and everything it owns
+ * @param theField Field to free
+ */
+void   freeField(Field* theField);
+
 /**
  * @brief Create a symmetric Field with random data
  * @param samples Width (and height) of the comparison matrix
@@ -211,9 +292,16 @@ Field* allocateField(void);
  */
 Field* makeRandomField(int samples);
 
+/**
+ * @brief Check whether a field's comparisons are the same in both directions
+ * @param theField Field (FIELD_STORAGE_FLOAT) to check
+ * @returns TRUE if element[x][y]==element[y][x] for every x,y
+ */
+bool   isFieldSymmetric(Field* theField);
+
 /**
  * @brief Load a tab-delimited-value file into a Field
- * @param filename Filename for the TDV file.
+ * @param filename Filename for the TDV file (or a points file; see makePointSetFromFile)
  * @returns A Field with contents matching the TDV file.
  */
 Field* makeFieldFromTDV(const char* filename);
@@ -241,6 +329,23 @@ void   saveFieldToHTML(const char* filename, Field* theField);
  */
 void   displayField(Field* theField);
 
+/**
+ * @brief Read one comparison, widening compact storage to float
+ * @param theField Field to read from
+ * @param x Row (unpermuted)
+ * @param y Column (unpermuted)
+ * @returns element x,y of theField as a float
+ */
+float  fieldElement(Field* theField, int x, int y);
+
+/**
+ * @brief Move a field's comparisons into compact storage
+ * @param theField Field (FIELD_STORAGE_FLOAT) to compact
+ * @param storage FIELD_STORAGE_BF16, FIELD_STORAGE_Q16 or FIELD_STORAGE_Q8
+ * @sideeffect Frees theField->element and fills packed/scale/offset/errorBound
+ */
+void   modifyFieldCompactify(Field* theField, int storage);
+
 /**
  * @brief Augment a correlation aggregate with information from two fields
  * @param X First field to correlate
@@ -248,9 +353,106 @@ void   displayField(Field* theField);
  * @param theCA Correlation aggregate to store cumulative information
  * @returns the correlation so far, which may not be the final result
  * @sideeffect Adds correlation information from fields X and Permute(Y) to theCA
+ * @note When both fields are symmetric only the upper triangle is visited, and
+ * its sums are counted twice
  */
 void augmentCAByFields(CorrelationAggregate* theCA, Field* X, Field* Y);
 
+/**
+ * @brief Augment a correlation aggregate using a kernel specialized for the fields' size
+ * @param X First field to correlate
+ * @param Y Second field to correlate
+ * @param theCA Correlation aggregate to store cumulative information
+ * @returns false (leaving theCA untouched) if no specialized kernel covers X->samples
+ * @sideeffect Adds correlation information from fields X and Permute(Y) to theCA
+ */
+bool augmentCAByFixedSizeFields(CorrelationAggregate* theCA, Field* X, Field* Y);
+
+/**
+ * @brief Augment a correlation aggregate by walking the fields in cache-sized tiles
+ * @param X First field to correlate (full-precision storage)
+ * @param Y Second field to correlate (full-precision storage)
+ * @param theCA Correlation aggregate to store cumulative information
+ * @sideeffect Adds correlation information from fields X and Permute(Y) to theCA
+ */
+void augmentCAByTiledFields(CorrelationAggregate* theCA, Field* X, Field* Y);
+
+/**
+ * @brief Augment a correlation aggregate with some rows of two fields
+ * @param X First field to correlate
+ * @param Y Second field to correlate
+ * @param theCA Correlation aggregate to store cumulative information
+ * @param firstRow First (permuted) row to include
+ * @param lastRow Row to stop before
+ * @sideeffect Adds correlation information from those rows of X and Permute(Y) to theCA
+ */
+void augmentCAByFieldRows(CorrelationAggregate* theCA, Field* X, Field* Y,
+                          int firstRow, int lastRow);
+
+
+#pragma mark Points
+/**
+ * @brief Per-sample coordinates or features from which a Field's distances are computed
+ */
+typedef struct {
+    int fieldnum;    /**< User name for field. Not really used. */
+    int samples;     /**< Number of samples */
+    int dimensions;  /**< Values held per sample (3 for great-circle: unit vectors) */
+    int metric;      /**< DISTANCE_* to compute between samples */
+    float* coords;   /**< Dimension-major values: coords[d*samples+i] */
+    float* totals;   /**< Per-sample sum of features (Bray-Curtis only, else NULL) */
+} PointSet;
+
+/**
+ * @brief Look up a distance metric by name
+ * @param name euclidean, greatcircle, manhattan or braycurtis
+ * @returns DISTANCE_* constant, or -1 if name is unknown
+ */
+int    distanceMetricFromName(const char* name);
+
+/**
+ * @brief Load a points file: a <Points F:Samples S:Dimensions D:Distance M> header,
+ * then S rows of D values (latitude and longitude in degrees for greatcircle)
+ * @param filename Name of the points file
+ * @returns A PointSet ready for fillDistanceRow
+ */
+PointSet* makePointSetFromFile(const char* filename);
+
+void   freePointSet(PointSet* thePoints);
+
+/**
+ * @brief Compute one row of the distance matrix
+ * @param thePoints Samples to measure between
+ * @param i Sample whose distances are wanted
+ * @param row Array of thePoints->samples floats to fill
+ * @sideeffect row[j] becomes the distance from sample i to sample j (row[i] is 0)
+ */
+void   fillDistanceRow(PointSet* thePoints, int i, float* row);
+
+/**
+ * @brief Compute part of one row of the distance matrix
+ * @param thePoints Samples to measure between
+ * @param i Sample whose distances are wanted
+ * @param first First column wanted
+ * @param last Column to stop before
+ * @param span Array of last-first floats to fill
+ * @sideeffect span[j-first] becomes the distance from sample i to sample j
+ */
+void   fillDistanceSpan(PointSet* thePoints, int i, int first, int last, float* span);
+
+/**
+ * @brief Build a Field of distances between samples, rows computed in parallel
+ * @param thePoints Samples to measure between
+ * @returns a symmetric Field with identity permutation
+ */
+Field* makeFieldFromPointSet(PointSet* thePoints);
+
+/**
+ * @brief Load a points file straight into a Field (makeFieldFromTDV does this for points files)
+ * @param filename Name of the points file
+ * @returns a Field of distances between the file's samples
+ */
+Field* makeFieldFromPoints(const char* filename);
 
 #pragma mark Landscapes
 typedef struct {
@@ -262,17 +464,117 @@ typedef struct {
     bool isRankBased;       /**< TRUE if ranked or ranked-and-mean'd */
     bool isCentered;     /**< FALSE unless this has been centered about its mean */
     bool hasFlatVersion; /**< FALSE unless a flattened version has been generated */
-    List* flatVersion;   /**< All elements arranged into a 1D array */
+    List* flatVersion;   /**< All elements arranged into a 1D array (one triangle if symmetric) */
+    bool isSymmetric;    /**< TRUE when every field is symmetric */
+    int storage;         /**< FIELD_STORAGE_* layout shared by all fields */
+    float storageErrorBound; /**< Largest element error introduced by compact storage */
+    void* mapping;       /**< Memory-mapped cache file holding the elements (NULL if none) */
+    size_t mappingSize;  /**< Bytes in mapping */
 } Landscape;
 
 Landscape* allocateLandscape(void);
 
 Landscape* makeLandscapeFromTDVs(int files, const char* filename[]);
 
+/**
+ * @brief Create a Landscape from fields that are already loaded
+ * @param files Number of fields
+ * @param fields Fields to use; the landscape takes ownership of them
+ * @returns A raw (uncentered, unranked) landscape holding the fields
+ */
+Landscape* makeLandscapeFromFields(int files, Field* fields[]);
+
+/**
+ * @brief Create a Landscape by copying another landscape
+ * @param theData Landscape to copy
+ * @returns a deep copy of theData, including its centered/ranked state
+ */
+Landscape* makeLandscapeFromLandscape(Landscape* theData);
+
+/**
+ * @brief Release a landscape and all of its fields
+ * @param theData Landscape to free
+ */
+void freeLandscape(Landscape* theData);
+
+/**
+ * @brief Create a Landscape that reads another landscape's data through its own permutations
+ * @param theData Landscape whose comparisons will be shared
+ * @returns a landscape sharing theData's elements, with identity permutations of its own
+ */
+Landscape* makeLandscapeViewOfLandscape(Landscape* theData);
+
 void modifyLandscapeMeanify(Landscape* theData);
 
 void  modifyLandscapeRankify(Landscape* theData);
 
+/**
+ * @brief Move every field of a centered landscape into compact storage
+ * @param theData Centered landscape to compact
+ * @param storage FIELD_STORAGE_* to use
+ * @sideeffect Fields are compacted; storageErrorBound records the worst element error
+ */
+void  modifyLandscapeCompactify(Landscape* theData, int storage);
+
+#pragma mark Landscape cache
+/**
+ * @brief Start of a preprocessed landscape file; field sizes and elements follow
+ */
+typedef struct {
+    char magic[8];        /**< CACHE_MAGIC */
+    uint32_t version;     /**< CACHE_VERSION */
+    uint32_t numFields;   /**< Fields in the landscape */
+    uint64_t sourceHash;  /**< Hash of the input files and transform this came from */
+    uint32_t isRankBased; /**< Nonzero for ranked (Spearman) data */
+    uint32_t isSymmetric; /**< Nonzero when every field is symmetric */
+} CacheFileHeader;
+
+/**
+ * @brief Hash the contents of a file (FNV-1a, 64 bit)
+ * @param filename File to read
+ * @param hash Starting value, so several files can be chained
+ * @returns updated hash
+ */
+uint64_t hashFileContents(const char* filename, uint64_t hash);
+
+/**
+ * @brief Write a centered landscape in memory-mappable form
+ * @param filename File to create/overwrite
+ * @param theData Centered landscape (FIELD_STORAGE_FLOAT) to save
+ * @param sourceHash Identifies the inputs theData was built from
+ * @returns FALSE if the file couldn't be written
+ */
+bool saveLandscapeToCacheFile(const char* filename, Landscape* theData, uint64_t sourceHash);
+
+/**
+ * @brief Memory-map a landscape written by saveLandscapeToCacheFile
+ * @param filename File to read
+ * @param sourceHash Hash the file must have been built from
+ * @returns Centered landscape reading from the mapping, or NULL if the file is missing/stale/damaged
+ */
+Landscape* makeLandscapeFromCacheFile(const char* filename, uint64_t sourceHash);
+
+/**
+ * @brief Load a centered (optionally ranked) landscape, going through a cache directory
+ * @param cacheDir Directory holding preprocessed landscapes
+ * @param cacheLimit Bytes the directory may hold once this landscape is added
+ * @param files Number of TDV files
+ * @param filenames TDV files making up the landscape
+ * @param isRanked TRUE for the Spearman (ranked) version
+ * @returns Centered landscape, from the cache when the inputs are unchanged
+ * @sideeffect May add a file to cacheDir and evict old ones
+ */
+Landscape* makeLandscapeFromCache(const char* cacheDir, long long cacheLimit,
+                                  int files, const char* filenames[], bool isRanked);
+
+/**
+ * @brief Trim a cache directory to a size limit, oldest-used files first
+ * @param cacheDir Directory holding preprocessed landscapes
+ * @param cacheLimit Bytes the directory may hold
+ * @sideeffect Deletes cache files
+ */
+void modifyCacheEvict(const char* cacheDir, long long cacheLimit);
+
 #pragma mark Field->List
 /**
  * @brief Flatten a 2D field to a 1D list
@@ -309,6 +611,50 @@ float mantelRPartial(Landscape* mPermuted,
                         Landscape* mGiven,
                         CorrelationAggregate* theCA);
 
+#pragma mark Options
+/**
+ * @brief Settings gathered from the command line that alter how an analysis runs
+ */
+typedef struct {
+    int storage; /**< FIELD_STORAGE_* to use for the Pearson pass */
+    int allPairs; /**< Landscapes per field group for all-pairs mode (0 for off) */
+    int oneVsMany; /**< Candidate landscapes for one-vs-many mode (0 for off) */
+    int batchSize; /**< Candidates held in memory (and fused per trial) at once */
+    const char* manifest; /**< Job list for batch mode (NULL for off) */
+    int threads;   /**< Worker threads for batch mode */
+    const char* cacheDir; /**< Directory of preprocessed landscapes (NULL for off) */
+    long long cacheLimit; /**< Bytes the cache directory may hold */
+    long long memoryLimit; /**< Bytes for out-of-core landscapes (0 to load them whole) */
+    const char* scratchDir; /**< Where out-of-core landscapes are unpacked */
+    bool numa; /**< Replicate landscapes per NUMA node and pin threads when threaded */
+    bool steal; /**< Split each trial into field/row-block tasks shared by work stealing */
+    int generators; /**< Threads making permutations for the -threads consumers (0 for off) */
+    bool matrixFree; /**< Keep preserved points files as coordinates, recomputing distances per trial */
+    int numClasses; /**< Distance classes for a correlogram (0 for off) */
+    float* classBounds; /**< numClasses+1 increasing class edges */
+    int regression; /**< Predictor landscapes for multiple regression (0 for off) */
+    bool residual; /**< Partial tests permute residuals (Freedman-Lane) instead of raw data */
+    bool moments; /**< Approximate p from exact permutation moments instead of permuting */
+    bool tail; /**< Estimate small p by tempered sampling instead of uniform permutations */
+    float targetWidth; /**< Run trials until the p value's interval is this narrow (0 for off) */
+    int bootstrap; /**< Bootstrap replicates for an interval on r (0 for off) */
+    int progress; /**< PROGRESS_NONE, PROGRESS_STATUS or PROGRESS_NDJSON */
+    int progressTrials; /**< Report progress every this many trials (0 for never) */
+    double progressSeconds; /**< Report progress every this many seconds (0 for never) */
+    double timeBudget; /**< Seconds a run may take before stopping with what it has (0 for no limit) */
+    const char* bankFile; /**< Permutation bank pair tests draw their trials from (NULL for off) */
+    const char* makeBankFile; /**< Write a permutation bank here instead of analyzing (NULL for off) */
+} RunOptions;
+
+RunOptions* allocateRunOptions(void);
+
+/**
+ * @brief Initialize run options
+ * @param theOptions RunOptions to initialize
+ * @sideeffect Sets every option to its default
+ */
+void initializeRunOptions(RunOptions* theOptions);
+
 #pragma mark P value
 /**
  * @brief Holds a value, a list of values, and information on that value's place in the list
@@ -318,6 +664,9 @@ typedef struct {
     float correlationOfInterest; /**< The value being held */
     rankAndCount* rankInfo; /**< Information about the value's place in the list */
     List* listOfCorrelations; /**< The list of other sample values */
+    float storageErrorBound; /**< Worst element error from compact storage, <0 for full precision */
+    float targetWidth; /**< Interval width trials were run until (0 when trials were fixed) */
+    int trialsRequested; /**< Trials asked for, when a time budget cut the run short (0 otherwise) */
 } StatisticalData;
 
 StatisticalData* allocateStatData(void);
@@ -337,17 +686,176 @@ StatisticalData* correlatePartialAndFindP(Landscape* lPermuted,
                                    Landscape* lGiven, 
                                    int trials);
 
+/**
+ * @brief As correlateAndFindP, drawing permutations from a private stream
+ * @param theState Stream to draw from (NULL to use the shared stream)
+ */
+StatisticalData* correlateAndFindPWithState(Landscape* lPermuted, 
+                                            Landscape* lPreserved, 
+                                            int trials,
+                                            RandomState* theState);
+
+/**
+ * @brief As correlatePartialAndFindP, drawing permutations from a private stream
+ * @param theState Stream to draw from (NULL to use the shared stream)
+ */
+StatisticalData* correlatePartialAndFindPWithState(Landscape* lPermuted, 
+                                                   Landscape* lPreserved, 
+                                                   Landscape* lGiven, 
+                                                   int trials,
+                                                   RandomState* theState);
+
+/**
+ * @brief Regress one landscape on another and keep what's left over
+ * @param lData Landscape to regress (centered first, if it isn't already)
+ * @param lGiven Landscape to regress on (centered first, if it isn't already)
+ * @returns A new, centered landscape of lData minus its fit to lGiven
+ */
+Landscape* makeResidualLandscape(Landscape* lData, Landscape* lGiven);
+
+/**
+ * @brief Partial Mantel test permuting residuals: both landscapes are regressed on
+ * lGiven once, then each trial is one correlation between the residuals (Freedman-Lane)
+ * @param lPermuted Landscape whose residuals are permuted
+ * @param lPreserved Landscape whose residuals are held fixed
+ * @param lGiven Landscape to relativize by
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @returns StatisticalData on the rank of the first (partial) correlation among all the rest
+ */
+StatisticalData* correlateResidualsAndFindP(Landscape* lPermuted, 
+                                            Landscape* lPreserved, 
+                                            Landscape* lGiven, 
+                                            int trials);
+
+/**
+ * @brief As correlateResidualsAndFindP, drawing permutations from a private stream
+ * @param theState Stream to draw from (NULL to use the shared stream)
+ */
+StatisticalData* correlateResidualsAndFindPWithState(Landscape* lPermuted, 
+                                                     Landscape* lPreserved, 
+                                                     Landscape* lGiven, 
+                                                     int trials,
+                                                     RandomState* theState);
+
+/**
+ * @brief Find how much of a list is at least some value
+ * @param theData List to search
+ * @param datum Threshold value
+ * @returns fraction of entries in theData that are >= datum
+ */
+float fractionAtLeast(List* theData, float datum);
+
+/**
+ * @brief Exact (Clopper-Pearson) confidence interval on a binomial proportion
+ * @param successes Number of successes seen
+ * @param trials Number of trials run, at least 1
+ * @param low Where to put the interval's lower end
+ * @param high Where to put the interval's upper end
+ * @sideeffect Sets *low and *high to bound successes/trials at PRECISION_CONFIDENCE
+ */
+void computeClopperPearson(int successes, int trials, double* low, double* high);
+
+/**
+ * @brief As correlateAndFindP, but trials run in blocks until the Clopper-Pearson
+ * interval on the fraction of correlations >= the first is narrow enough
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param maxTrials Most permutations to correlate
+ * @param targetWidth Interval width to stop at
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ */
+StatisticalData* correlateAndFindPToWidth(Landscape* lPermuted, 
+                                          Landscape* lPreserved, 
+                                          int maxTrials,
+                                          float targetWidth);
+
+/**
+ * @brief Where a permutation test has got to, as handed to a progress callback
+ */
+typedef struct {
+    char* correlationType;       /**< The monitor's label */
+    float correlationOfInterest; /**< Unpermuted correlation */
+    int trials;                  /**< Trials done so far */
+    int trialsRequested;         /**< Most trials the run will do */
+    int atLeast;                 /**< Trials whose correlation was >= the first */
+    double pValue;               /**< Running estimate, atLeast/trials */
+    double low;                  /**< Clopper-Pearson interval on pValue */
+    double high;
+    double elapsed;              /**< Seconds since the trials started */
+    double trialsPerSecond;
+    bool isFinal;                /**< TRUE for a run's last report */
+} ProgressReport;
+
+/**
+ * @brief Called with each progress report
+ * @param theReport Progress so far (only valid during the call)
+ * @param context Whatever the monitor was given
+ */
+typedef void (*ProgressCallback)(ProgressReport* theReport, void* context);
+
+/**
+ * @brief How, and how often, a permutation test reports progress, and when it must stop
+ */
+typedef struct {
+    ProgressCallback callback; /**< Called with each report (NULL for none) */
+    void* context;             /**< Passed along to callback */
+    char* correlationType;     /**< Label for reports */
+    int everyTrials;           /**< Report after every this many trials (0 for never) */
+    double everySeconds;       /**< Report once this many seconds have passed (0 for never) */
+    double deadline;           /**< secondsNow() by which to stop (0 for none) */
+} ProgressMonitor;
+
+/**
+ * @brief Initialize a progress monitor
+ * @param theMonitor ProgressMonitor to initialize
+ * @sideeffect No callback, no reports, no deadline
+ */
+void initializeProgressMonitor(ProgressMonitor* theMonitor);
+
+/**
+ * @brief Progress callback keeping one status line up to date
+ * @param theReport Progress so far
+ * @param context FILE* to write to (a terminal, usually stderr)
+ */
+void reportProgressStatusLine(ProgressReport* theReport, void* context);
+
+/**
+ * @brief Progress callback writing each report as a line of JSON
+ * @param theReport Progress so far
+ * @param context FILE* to write to
+ */
+void reportProgressNDJSON(ProgressReport* theReport, void* context);
+
+/**
+ * @brief As correlateAndFindPToWidth, reporting progress as it goes, and stopping
+ * early, with the trials done so far, if the monitor's deadline passes
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param maxTrials Most permutations to correlate
+ * @param targetWidth Interval width to stop at (0 to run every trial)
+ * @param theMonitor Reporting and deadline (NULL for neither)
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ */
+StatisticalData* correlateAndFindPWithProgress(Landscape* lPermuted, 
+                                               Landscape* lPreserved, 
+                                               int maxTrials,
+                                               float targetWidth,
+                                               ProgressMonitor* theMonitor);
+
 /**
  * @brief Creates files containing data on Spearman and Person correlation of inputs
  * @param trials Number of permutations to correlate for each type
  * @param filepairs Number of substrata that will be supplied
  * @param argv Array of (original) command-line arguments.
  * @param timestamp Time used for random seed, and to put in filenames
+ * @param options Run options (NULL for defaults)
  * @sideeffect Creates testinfo.TIMESTAMP.[Pearson|Spearman].[txt|tdv] files.
  */
-void processFilePairs(int trials, int filesets, const char* argv[], int timestamp);
+void processFilePairs(int trials, int filesets, const char* argv[], int timestamp,
+                      RunOptions* options);
 
-void processFileTriples(int trials, int filesets, const char* argv[], int timestamp);
+void processFileTriples(int trials, int filesets, const char* argv[], int timestamp,
+                        RunOptions* options);
 
 /**
  * @brief Saves statistical data to file
@@ -357,6 +865,706 @@ void processFileTriples(int trials, int filesets, const char* argv[], int timest
  */
 void saveData(StatisticalData* dataToSave, int timestamp);
 
+#pragma mark Out of core
+/**
+ * @brief A field kept on disk as binary rows of floats, read a block at a time
+ */
+typedef struct {
+    int fieldnum;
+    int samples;
+    int descriptor; /**< Open (already unlinked) file of raw rows */
+} StreamedField;
+
+/**
+ * @brief A landscape too large to hold in memory; only its statistics stay resident
+ */
+typedef struct {
+    int numFields;
+    StreamedField** fields;
+    long long numNonDiagElts;
+    double mean;         /**< Off-diagonal mean over every field */
+    double sumOfSquares; /**< Off-diagonal sum of squared deviations from the mean */
+} StreamedLandscape;
+
+/**
+ * @brief Convert TDV files to binary rows on disk, one row at a time
+ * @param files Number of TDV files
+ * @param filenames TDV files making up the landscape
+ * @param scratchDir Directory for the (unlinked) binary row files
+ * @returns Streamed landscape with its mean and sum of squares filled in
+ */
+StreamedLandscape* makeStreamedLandscapeFromTDVs(int files, const char* filenames[],
+                                                 const char* scratchDir);
+
+void freeStreamedLandscape(StreamedLandscape* theData);
+
+/**
+ * @brief Read consecutive rows of a streamed field, centered, with a zero diagonal
+ * @param theField Field to read from
+ * @param firstRow First row wanted
+ * @param rows Number of rows wanted
+ * @param buffer Space for rows*samples floats
+ * @param mean Value to subtract from every element
+ */
+void readStreamedRows(StreamedField* theField, int firstRow, int rows, float* buffer, double mean);
+
+/**
+ * @brief Pearson Mantel test over landscapes that stay on disk
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @param memoryLimit Bytes of row blocks and permutations to hold at once
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ */
+StatisticalData* correlateStreamedAndFindP(StreamedLandscape* lPermuted,
+                                           StreamedLandscape* lPreserved,
+                                           int trials, long long memoryLimit);
+
+#pragma mark Matrix free
+/**
+ * @brief A landscape of distances held only as sample coordinates, plus its statistics
+ */
+typedef struct {
+    int numFields;
+    PointSet** fields;
+    long long numNonDiagElts;
+    double mean;         /**< Off-diagonal mean distance over every field */
+    double sumOfSquares; /**< Off-diagonal sum of squared deviations from the mean */
+} PointLandscape;
+
+/**
+ * @brief Load points files, measuring the distances once for their statistics
+ * @param files Number of points files
+ * @param filenames Points files making up the landscape
+ * @returns Point landscape with its mean and sum of squares filled in
+ */
+PointLandscape* makePointLandscapeFromFiles(int files, const char* filenames[]);
+
+void freePointLandscape(PointLandscape* theData);
+
+/**
+ * @brief Pearson Mantel test against a landscape whose distances are never stored
+ * @param lPermuted Landscape to permute (FIELD_STORAGE_FLOAT)
+ * @param lPreserved Distances to hold fixed, recomputed from coordinates every trial
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ */
+StatisticalData* correlatePointsAndFindP(Landscape* lPermuted,
+                                         PointLandscape* lPreserved,
+                                         int trials);
+
+#pragma mark NUMA
+/**
+ * @brief Which cpus sit on which memory node
+ */
+typedef struct {
+    int numNodes;
+    int* numCPUs; /**< Cpus on each node */
+    int** cpus;   /**< Ids of the cpus on each node */
+} Topology;
+
+/**
+ * @brief Read the machine's NUMA layout (from /sys on Linux)
+ * @returns Topology; a single node holding every online cpu if no layout is available
+ */
+Topology* makeTopologyFromSystem(void);
+
+void freeTopology(Topology* theTopology);
+
+/**
+ * @brief Spread threads over nodes in contiguous runs
+ * @returns Node that thread (of threads) belongs to
+ */
+int nodeForThread(Topology* theTopology, int thread, int threads);
+
+/**
+ * @brief Restrict the calling thread to one node's cpus
+ * @returns FALSE if the platform can't pin threads
+ */
+bool pinThreadToNode(Topology* theTopology, int node);
+
+/**
+ * @brief Run input data through multiple correlations on several threads
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @param threads Worker threads; each takes a contiguous run of trials
+ * @param seed Trial t uses a stream derived from seed and t, whatever the thread count
+ * @param numa TRUE to pin threads to nodes and give each node its own copy of the landscapes
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ * @sideeffect Centers both landscapes; prints the topology used
+ */
+StatisticalData* correlateAndFindPThreaded(Landscape* lPermuted,
+                                           Landscape* lPreserved,
+                                           int trials, int threads,
+                                           unsigned int seed, bool numa);
+
+#pragma mark Work stealing
+/**
+ * @brief A share of one trial's work: whole small fields, or some rows of one large field
+ */
+typedef struct {
+    int firstField;
+    int lastField;  /**< Field to stop before */
+    int firstRow;   /**< Only used when the task holds a single field */
+    int lastRow;
+    long long weight; /**< Elements compared */
+} FieldTask;
+
+/**
+ * @brief Break a landscape into tasks of similar weight
+ * @param theData Landscape whose fields are divided up
+ * @param numTasks Set to the number of tasks made
+ * @returns Array of tasks of about STEAL_TASK_ELEMENTS each, in field and row order
+ */
+FieldTask* makeFieldTasksFromLandscape(Landscape* theData, int* numTasks);
+
+/**
+ * @brief Run input data through multiple correlations, sharing each trial's fields between threads
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @param threads Worker threads; idle ones steal tasks from the others
+ * @param seed Trial t uses a stream derived from seed and t, whatever the thread count
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ * @sideeffect Centers both landscapes; prints how the tasks were shared
+ */
+StatisticalData* correlateAndFindPStealing(Landscape* lPermuted,
+                                           Landscape* lPreserved,
+                                           int trials, int threads,
+                                           unsigned int seed);
+
+#pragma mark Pipeline
+/**
+ * @brief Single-producer, single-consumer ring of per-trial permutation sets
+ */
+typedef struct {
+    uint64_t head;     /**< Next slot to read; written only by the consumer */
+    char padding[56];  /**< Keeps head and tail on separate cache lines */
+    uint64_t tail;     /**< Next slot to write; written only by the producer */
+    int capacity;
+    int slotInts;      /**< One permutation per field, back to back */
+    int* slots;
+    int* trialOf;      /**< Trial each slot's permutations belong to */
+} PermRing;
+
+PermRing* makePermRing(int capacity, int slotInts);
+
+void freePermRing(PermRing* theRing);
+
+/**
+ * @brief Producer: find the next free slot
+ * @returns Slot to fill, or NULL if the ring is full
+ */
+int* reservePermSlot(PermRing* theRing);
+
+/**
+ * @brief Producer: hand the reserved slot to the consumer
+ * @param trial Trial the slot's permutations are for
+ */
+void publishPermSlot(PermRing* theRing, int trial);
+
+/**
+ * @brief Consumer: look at the oldest filled slot
+ * @param trial Set to the slot's trial
+ * @returns Slot, or NULL if the ring is empty
+ */
+int* peekPermSlot(PermRing* theRing, int* trial);
+
+/**
+ * @brief Consumer: give the slot from peekPermSlot back to the producer
+ */
+void releasePermSlot(PermRing* theRing);
+
+/**
+ * @brief Run input data through multiple correlations, with permutations made on other threads
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Landscape to hold fixed
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @param consumers Threads computing correlations
+ * @param generators Threads shuffling, each feeding its own consumers' rings
+ * @param seed Trial t uses a stream derived from seed and t, whatever the thread counts
+ * @returns StatisticalData on the rank of the first correlation among all the rest
+ * @sideeffect Centers both landscapes; prints how busy each side of the pipeline was
+ */
+StatisticalData* correlateAndFindPPipelined(Landscape* lPermuted,
+                                            Landscape* lPreserved,
+                                            int trials, int consumers, int generators,
+                                            unsigned int seed);
+
+#pragma mark All pairs
+/**
+ * @brief Correlations and p values for every pair among several landscapes
+ */
+typedef struct {
+    char* correlationType; /**< For when written to file (pearson or spearman) */
+    int numScapes;         /**< Number of landscapes compared */
+    int trials;            /**< Number of permutations used */
+    float** correlation;   /**< numScapes^2 unpermuted correlations */
+    float** pValue;        /**< numScapes^2 fractions of trials >= the unpermuted correlation */
+} PairwiseData;
+
+PairwiseData* allocatePairwiseData(void);
+
+void freePairwiseData(PairwiseData* theData);
+
+/**
+ * @brief Correlate every pair of landscapes against one shared stream of permutations
+ * @param numScapes Number of landscapes
+ * @param scapes Landscapes to compare (all with matching field sizes)
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @returns Matrices of correlations and p values; entry a,b permutes landscape b
+ * @sideeffect Centers every landscape
+ */
+PairwiseData* correlateAllPairsAndFindP(int numScapes, Landscape* scapes[], int trials);
+
+/**
+ * @brief Saves all-pairs results to file
+ * @param dataToSave Pairwise data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.AllPairs.[r|p].tdv matrix files.
+ */
+void savePairwiseData(PairwiseData* dataToSave, int timestamp);
+
+/**
+ * @brief Creates files containing all-pairs Spearman and Pearson correlations
+ * @param trials Number of permutations to correlate for each type
+ * @param filesets Number of substrata that will be supplied
+ * @param argv Array of command-line arguments, options removed; files grouped per field
+ * @param timestamp Time used to put in filenames
+ * @param options Run options; allPairs gives the number of landscapes
+ * @sideeffect Creates testinfo.TIMESTAMP.[Pearson|Spearman].AllPairs.[r|p].tdv files.
+ */
+void processAllPairs(int trials, int filesets, const char* argv[], int timestamp,
+                     RunOptions* options);
+
+#pragma mark One vs many
+/**
+ * @brief Correlations and p values of many candidate landscapes against one preserved landscape
+ */
+typedef struct {
+    char* correlationType; /**< For when written to file (pearson or spearman) */
+    int numCandidates;     /**< Number of candidate landscapes */
+    int trials;            /**< Number of permutations used */
+    float* correlation;    /**< Unpermuted correlation of each candidate */
+    float* pValue;         /**< Fraction of trials >= each unpermuted correlation */
+} CandidateData;
+
+CandidateData* allocateCandidateData(void);
+
+/**
+ * @brief Correlate several candidates with one preserved landscape in a single pass per trial
+ * @param lPreserved Landscape every candidate is compared with
+ * @param numCandidates Number of candidates
+ * @param candidates Landscapes to compare (field sizes matching lPreserved)
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @param seed >0 to restart the permutation stream, so separate batches see the same permutations
+ * @returns Correlations and p values for each candidate
+ * @sideeffect Centers lPreserved and every candidate
+ */
+CandidateData* correlateOneVsManyAndFindP(Landscape* lPreserved, int numCandidates,
+                                          Landscape* candidates[], int trials, int seed);
+
+/**
+ * @brief Creates a table of Pearson and Spearman results for many candidate landscapes
+ * @param trials Number of permutations to correlate for each type
+ * @param filesets Number of substrata that will be supplied
+ * @param argv Array of command-line arguments, options removed; per field, the
+ *        preserved file followed by one file for each candidate
+ * @param timestamp Time used for the permutation seed, and to put in filenames
+ * @param options Run options; oneVsMany gives the number of candidates
+ * @sideeffect Creates testinfo.TIMESTAMP.OneVsMany.tdv
+ */
+void processOneVsMany(int trials, int filesets, const char* argv[], int timestamp,
+                      RunOptions* options);
+
+#pragma mark Correlogram
+/**
+ * @brief Mantel correlations between membership of each distance class and another landscape
+ */
+typedef struct {
+    char* correlationType; /**< For when written to file (pearson or spearman) */
+    int numClasses;        /**< Number of distance classes */
+    int trials;            /**< Number of permutations used */
+    float* bounds;         /**< numClasses+1 edges; class k holds bounds[k] <= distance < bounds[k+1] */
+    long long* comparisons; /**< Off-diagonal elements falling in each class */
+    float* correlation;    /**< Unpermuted correlation of each class */
+    float* pValue;         /**< Fraction of trials with |r| >= each unpermuted |r| */
+    float* corrected;      /**< Progressive Bonferroni: class k's pValue times k+1, at most 1 */
+} CorrelogramData;
+
+CorrelogramData* allocateCorrelogramData(void);
+
+void freeCorrelogramData(CorrelogramData* theData);
+
+/**
+ * @brief Correlate every distance class with the permuted landscape in one pass per trial
+ * @param lPermuted Landscape to permute
+ * @param lPreserved Raw (uncentered, unranked) distances that define the classes
+ * @param numClasses Number of distance classes (at most CORRELOGRAM_MAX_CLASSES)
+ * @param bounds numClasses+1 increasing class edges
+ * @param trials Number of permutations to correlate (the first is the identity)
+ * @returns Correlations and p values for each class
+ * @sideeffect Centers lPermuted
+ */
+CorrelogramData* correlogramAndFindP(Landscape* lPermuted, Landscape* lPreserved,
+                                     int numClasses, float* bounds, int trials);
+
+/**
+ * @brief Saves correlogram results to file
+ * @param dataToSave Correlogram data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.Correlogram.tdv, one line per class
+ */
+void saveCorrelogramData(CorrelogramData* dataToSave, int timestamp);
+
+/**
+ * @brief Creates Pearson and Spearman correlograms
+ * @param trials Number of permutations to correlate for each type
+ * @param filesets Number of substrata that will be supplied
+ * @param argv Array of command-line arguments, options removed; files paired as for a Mantel test
+ * @param timestamp Time used to put in filenames
+ * @param options Run options; numClasses and classBounds give the distance classes
+ * @sideeffect Creates testinfo.TIMESTAMP.[Pearson|Spearman].Correlogram.tdv files.
+ */
+void processCorrelogram(int trials, int filesets, const char* argv[], int timestamp,
+                        RunOptions* options);
+
+#pragma mark Regression
+/**
+ * @brief Multiple regression of one landscape on several others (MRM), with permutation p values
+ */
+typedef struct {
+    char* correlationType; /**< For when written to file (pearson or spearman) */
+    int numPredictors;     /**< Number of predictor landscapes */
+    int trials;            /**< Number of permutations used */
+    float intercept;       /**< Unpermuted intercept */
+    float* coefficient;    /**< Unpermuted coefficient of each predictor */
+    float* pValue;         /**< Fraction of trials with |coefficient| >= each unpermuted |coefficient| */
+    float rSquared;        /**< Unpermuted share of the response's variance explained */
+    float rSquaredP;       /**< Fraction of trials with R^2 >= the unpermuted R^2 */
+} RegressionData;
+
+RegressionData* allocateRegressionData(void);
+
+void freeRegressionData(RegressionData* theData);
+
+/**
+ * @brief Regress a permuted landscape on fixed predictors, factoring the predictors once
+ * @param lResponse Landscape to permute
+ * @param numPredictors Number of predictors
+ * @param predictors Landscapes to hold fixed (field sizes matching lResponse, not collinear)
+ * @param trials Number of permutations to fit (the first is the identity)
+ * @returns Coefficients, R^2 and p values, or NULL if the predictors are collinear
+ * @sideeffect Centers lResponse and every predictor
+ */
+RegressionData* regressAndFindP(Landscape* lResponse, int numPredictors,
+                                Landscape* predictors[], int trials);
+
+/**
+ * @brief Saves regression results to file
+ * @param dataToSave Regression data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.MRM.tdv, one line per term
+ */
+void saveRegressionData(RegressionData* dataToSave, int timestamp);
+
+/**
+ * @brief Creates Pearson (linear) and Spearman (rank) regression tables
+ * @param trials Number of permutations to fit for each type
+ * @param filesets Number of substrata that will be supplied
+ * @param argv Array of command-line arguments, options removed; per field, the
+ *        response file followed by one file for each predictor
+ * @param timestamp Time used to put in filenames
+ * @param options Run options; regression gives the number of predictors
+ * @sideeffect Creates testinfo.TIMESTAMP.[Pearson|Spearman].MRM.tdv files.
+ */
+void processRegression(int trials, int filesets, const char* argv[], int timestamp,
+                       RunOptions* options);
+
+#pragma mark Moments
+/**
+ * @brief Exact permutation moments of a Mantel correlation, and the p value they imply
+ */
+typedef struct {
+    char* correlationType;       /**< For when written to file (pearson or spearman) */
+    float correlationOfInterest; /**< Unpermuted correlation */
+    double mean;                 /**< Mean of r over every relabeling */
+    double variance;             /**< Variance of r over every relabeling */
+    double skewness;             /**< Skewness of r over every relabeling */
+    bool isSkewnessExact;        /**< FALSE if a field was too large (skewness then leaves it out) */
+    float pValue;                /**< Pearson type III estimate of the fraction of relabelings >= r */
+} MomentData;
+
+MomentData* allocateMomentData(void);
+
+/**
+ * @brief Approximate the permutation p value from the exact mean, variance and
+ * skewness of the null distribution, without permuting
+ * @param lPermuted Landscape that would be permuted (symmetric fields)
+ * @param lPreserved Landscape that would be held fixed (symmetric fields)
+ * @returns Moments, and a Pearson type III p value
+ * @sideeffect Centers both landscapes
+ */
+MomentData* correlateAndApproximateP(Landscape* lPermuted, Landscape* lPreserved);
+
+/**
+ * @brief Saves moment-based results to file
+ * @param dataToSave Moment data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.Moments.txt
+ */
+void saveMomentData(MomentData* dataToSave, int timestamp);
+
+#pragma mark Tail sampling
+/**
+ * @brief Small p value estimated by sampling relabelings tilted toward high correlations
+ */
+typedef struct {
+    char* correlationType;       /**< For when written to file (pearson or spearman) */
+    float correlationOfInterest; /**< Unpermuted correlation */
+    int trials;                  /**< Sweeps run, over every rung */
+    int rungs;                   /**< Temperatures in the ladder (1 for plain sampling) */
+    double pValue;               /**< Estimated fraction of relabelings >= r */
+    double standardError;        /**< Of pValue, from the spread between batches */
+    double swapRate;             /**< Fraction of exchanges between rungs accepted */
+} TailData;
+
+TailData* allocateTailData(void);
+
+/**
+ * @brief Estimate a (possibly tiny) permutation p value by tempered MCMC: chains at a
+ * ladder of temperatures relabel by transpositions, each updating r in O(samples),
+ * and exchange states; reweighting ties each rung to the uniform relabeling
+ * @param lPermuted Landscape to be relabeled
+ * @param lPreserved Landscape to be held fixed
+ * @param trials Sweeps to run, shared between the rungs; each costs about one permutation
+ * @returns Estimated p value and its standard error
+ * @sideeffect Centers both landscapes
+ */
+TailData* correlateAndEstimateTailP(Landscape* lPermuted, Landscape* lPreserved, int trials);
+
+/**
+ * @brief Saves tail-sampling results to file
+ * @param dataToSave Tail data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.Tail.txt
+ */
+void saveTailData(TailData* dataToSave, int timestamp);
+
+#pragma mark Bootstrap
+/**
+ * @brief Bootstrap distribution of a Mantel correlation, and intervals from it
+ */
+typedef struct {
+    char* correlationType;       /**< For when written to file (pearson or spearman) */
+    float correlationOfInterest; /**< Correlation of the data as they are */
+    List* listOfCorrelations;    /**< Correlation of each resampled landscape, sorted */
+    float percentileLow;         /**< Percentile interval, at BOOTSTRAP_CONFIDENCE */
+    float percentileHigh;
+    float bcaLow;                /**< Bias-corrected and accelerated interval */
+    float bcaHigh;
+    double bias;                 /**< BCa bias correction z0 */
+    double acceleration;         /**< BCa acceleration, from the leave-one-sample-out jackknife */
+} BootstrapData;
+
+BootstrapData* allocateBootstrapData(void);
+void freeBootstrapData(BootstrapData* theData);
+
+/**
+ * @brief Bootstrap the Mantel correlation: each replicate resamples every field's samples
+ * with replacement, and comparisons between copies of one sample (diagonal entries) are left out
+ * @param lPermuted One landscape (centered first, if it isn't already)
+ * @param lPreserved The other landscape (centered first, if it isn't already)
+ * @param replicates Number of resampled landscapes to correlate
+ * @param threads Threads to share the replicates
+ * @param seed Replicate b draws from seed+2654435761*b, so results don't depend on threads
+ * @returns Sorted replicate correlations, with percentile and BCa intervals
+ */
+BootstrapData* correlateAndBootstrapR(Landscape* lPermuted, Landscape* lPreserved,
+                                      int replicates, int threads, unsigned int seed);
+
+/**
+ * @brief Saves bootstrap results to file
+ * @param dataToSave Bootstrap data to output
+ * @param timestamp Identifier to distinguish files from different runs
+ * @sideeffect Creates testinfo.TIMESTAMP.TYPE.Bootstrap.[txt|tdv]
+ */
+void saveBootstrapData(BootstrapData* dataToSave, int timestamp);
+
+#pragma mark Permutation bank
+/**
+ * @brief Start of a permutation bank file; the stream directory and indices follow
+ */
+typedef struct {
+    char magic[8];        /**< BANK_MAGIC */
+    uint32_t version;     /**< BANK_VERSION */
+    uint32_t numStreams;  /**< Streams of permutations in the bank */
+    uint32_t trials;      /**< Permutations in each stream; the first is the identity */
+    uint32_t seed;        /**< Seed the streams were drawn from */
+} BankFileHeader;
+
+/**
+ * @brief Where one stream of permutations sits in a bank file
+ */
+typedef struct {
+    uint32_t samples;     /**< Size of the field the stream permutes */
+    uint32_t width;       /**< Bytes per index: 2 up to BANK_MAX_NARROW samples, 4 past it */
+    uint64_t offset;      /**< Byte offset of the stream's first permutation */
+} BankStreamEntry;
+
+/**
+ * @brief Permutations precomputed into a file, mapped read-only so any number of
+ * threads (and processes) can draw from one copy
+ */
+typedef struct {
+    int numStreams;            /**< Streams in the bank */
+    int trials;                /**< Permutations in each stream */
+    unsigned int seed;         /**< Seed the streams were drawn from */
+    BankStreamEntry* streams;  /**< Stream directory, inside the mapping */
+    void* mapping;             /**< The whole file */
+    size_t mappingSize;        /**< Bytes mapped */
+} PermBank;
+
+/**
+ * @brief Draw a permutation bank and write it to file
+ * @param filename File to create
+ * @param numStreams Number of streams
+ * @param sizes Field size for each stream; a landscape with several fields of one size
+ *        needs that size listed once per field
+ * @param trials Permutations per stream, counting the identity that starts each one
+ * @param seed Stream s draws from seed+2654435761*s
+ * @returns FALSE if the file couldn't be written
+ */
+bool savePermutationBank(const char* filename, int numStreams, int sizes[], int trials,
+                         unsigned int seed);
+
+/**
+ * @brief Map a permutation bank file, checking that every trial is a permutation
+ * @param filename File made by savePermutationBank
+ * @returns The bank, or NULL if the file is missing or damaged
+ */
+PermBank* openPermutationBank(const char* filename);
+
+/**
+ * @brief Unmap a permutation bank
+ */
+void closePermutationBank(PermBank* theBank);
+
+/**
+ * @brief Match each field to a bank stream of its size: the k-th field of a given size
+ * takes the k-th stream of that size, so landscapes with the same sizes get the same relabelings
+ * @param theBank Bank to draw from
+ * @param theData Landscape to be permuted
+ * @returns Stream for each field (free when done), or NULL if the bank lacks one
+ */
+int* makeBankStreamsForLandscape(PermBank* theBank, Landscape* theData);
+
+/**
+ * @brief Set a permutation to one of the bank's
+ * @param thePerm Permutation to modify; its size must match the stream's
+ * @param theBank Bank to read
+ * @param stream Stream to read
+ * @param trial Permutation within the stream (0 for the identity)
+ */
+void modifyPermFromBank(Perm* thePerm, PermBank* theBank, int stream, int trial);
+
+/**
+ * @brief Finds correlation (and p value) of two landscapes, relabeling lPermuted with the
+ * bank's permutations instead of random ones; results don't depend on the thread count
+ * @param lPermuted Landscape to be permuted; the bank must cover its fields
+ * @param lPreserved Landscape to be preserved
+ * @param trials Number of permutations, at most the bank's
+ * @param threads Threads to share the trials
+ * @param theBank Bank to draw from
+ * @returns Correlation data
+ */
+StatisticalData* correlateAndFindPFromBank(Landscape* lPermuted, Landscape* lPreserved,
+                                           int trials, int threads, PermBank* theBank);
+
+#pragma mark Batch
+/**
+ * @brief Shared, reference-counted data loaded by batch jobs
+ */
+typedef struct {
+    char* key;            /**< "raw:" + path, or transform + ":" + every path in the landscape */
+    Field* field;         /**< Loaded data, for raw entries */
+    Landscape* landscape; /**< Centered (maybe ranked) data, for landscape entries */
+    int references;       /**< Uses still expected; the entry is freed when this reaches zero */
+    bool isLoading;       /**< TRUE once some thread has started filling the entry */
+    bool isReady;         /**< FALSE until the entry has been filled */
+} CacheEntry;
+
+/**
+ * @brief Collection of CacheEntries keyed by path(s), safe to share among threads
+ */
+typedef struct {
+    CacheEntry** entries;  /**< Array of entries */
+    int count;             /**< Entries in use */
+    int capacity;          /**< Entries allocated */
+    pthread_mutex_t lock;  /**< Guards everything above */
+    pthread_cond_t filled; /**< Signalled whenever an entry becomes ready */
+    const char* cacheDir;  /**< Directory of preprocessed landscapes (NULL for off) */
+    long long cacheLimit;  /**< Bytes cacheDir may hold */
+} FieldCache;
+
+/**
+ * @brief One analysis from a manifest
+ */
+typedef struct {
+    int groupSize;         /**< 2 for a Mantel test, 3 for a partial Mantel test */
+    int trials;            /**< Number of permutations */
+    int filesets;          /**< Number of fields in each landscape */
+    char** filenames;      /**< filesets*groupSize names, grouped per field as on the command line */
+    float correlation[2];  /**< Pearson and Spearman results */
+    float pValue[2];       /**< Fraction of trials >= each result */
+} BatchJob;
+
+FieldCache* allocateFieldCache(void);
+
+/**
+ * @brief Initialize an empty field cache
+ * @param theCache FieldCache to initialize
+ */
+void initializeFieldCache(FieldCache* theCache);
+
+/**
+ * @brief Note that a landscape will be wanted later, so it stays cached until then
+ * @param theCache Cache to register with
+ * @param files Number of files in the landscape
+ * @param filenames Files making up the landscape
+ * @param isRanked TRUE for the Spearman (ranked) version of the landscape
+ */
+void registerCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked);
+
+/**
+ * @brief Fetch a centered landscape, loading and preparing it on first use
+ * @param theCache Cache to fetch from
+ * @param files Number of files in the landscape
+ * @param filenames Files making up the landscape
+ * @param isRanked TRUE for the Spearman (ranked) version of the landscape
+ * @returns A shared landscape; don't modify it
+ */
+Landscape* acquireCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked);
+
+/**
+ * @brief Finish with a landscape from acquireCachedLandscape
+ * @sideeffect Frees the landscape once no more uses are expected
+ */
+void releaseCachedLandscape(FieldCache* theCache, int files, char* filenames[], bool isRanked);
+
+/**
+ * @brief Run every analysis listed in a manifest file
+ * @param manifest Name of a file with one job per line: "pair" or "triple", the
+ *        number of trials, then files grouped per field as on the command line
+ * @param timestamp Time used for random seeds, and to put in filenames
+ * @param options Run options; threads gives the size of the worker pool, and pair jobs
+ *        draw from bankFile's permutations when it covers them
+ * @sideeffect Creates testinfo.TIMESTAMP.Batch.tdv with one line per job
+ * @returns Number of jobs run, or -1 if the manifest couldn't be read
+ */
+int processManifest(const char* manifest, int timestamp, RunOptions* options);
+
 #endif
 
 //////// Useful links
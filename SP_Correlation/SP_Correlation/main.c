@@ -12,6 +12,179 @@
 #include <time.h>
 #include "tests.h"
 
+/**
+ * @brief Apply one command-line option to the run options
+ * @param theOptions RunOptions to modify
+ * @param arg Option text, e.g. "-compact=q8"
+ * @returns FALSE if arg isn't a recognized option
+ */
+bool parseOption(RunOptions* theOptions, const char* arg);
+bool parseOption(RunOptions* theOptions, const char* arg)
+{
+    if(!strcmp(arg, "-compact=bf16")) theOptions->storage = FIELD_STORAGE_BF16;
+    else if(!strcmp(arg, "-compact=q16")) theOptions->storage = FIELD_STORAGE_Q16;
+    else if(!strcmp(arg, "-compact=q8")) theOptions->storage = FIELD_STORAGE_Q8;
+    else if(!strncmp(arg, "-allpairs=", 10)) 
+    {
+        theOptions->allPairs = atoi(arg+10);
+        if(theOptions->allPairs<2) return false;
+    }
+    else if(!strncmp(arg, "-onevsmany=", 11)) 
+    {
+        theOptions->oneVsMany = atoi(arg+11);
+        if(theOptions->oneVsMany<1) return false;
+    }
+    else if(!strncmp(arg, "-manifest=", 10)) theOptions->manifest = arg+10;
+    else if(!strncmp(arg, "-threads=", 9)) 
+    {
+        theOptions->threads = atoi(arg+9);
+        if(theOptions->threads<1) return false;
+    }
+    else if(!strncmp(arg, "-cache=", 7)) theOptions->cacheDir = arg+7;
+    else if(!strncmp(arg, "-cachemax=", 10)) 
+    {
+        theOptions->cacheLimit = atoll(arg+10)*1024LL*1024LL;
+        if(theOptions->cacheLimit<0) return false;
+    }
+    else if(!strncmp(arg, "-memory=", 8)) 
+    {
+        theOptions->memoryLimit = atoll(arg+8)*1024LL*1024LL;
+        if(theOptions->memoryLimit<=0) return false;
+    }
+    else if(!strncmp(arg, "-scratch=", 9)) theOptions->scratchDir = arg+9;
+    else if(!strcmp(arg, "-numa=off")) theOptions->numa = false;
+    else if(!strcmp(arg, "-steal")) theOptions->steal = true;
+    else if(!strcmp(arg, "-matrixfree")) theOptions->matrixFree = true;
+    else if(!strcmp(arg, "-residual")) theOptions->residual = true;
+    else if(!strcmp(arg, "-moments")) theOptions->moments = true;
+    else if(!strcmp(arg, "-tail")) theOptions->tail = true;
+    else if(!strncmp(arg, "-target-se=", 11))
+    {
+        //A normal interval this wide has that standard error
+        theOptions->targetWidth = 2*1.96*atof(arg+11);
+        if(theOptions->targetWidth<=0) return false;
+    }
+    else if(!strcmp(arg, "-progress=status")) theOptions->progress = PROGRESS_STATUS;
+    else if(!strcmp(arg, "-progress=ndjson")) theOptions->progress = PROGRESS_NDJSON;
+    else if(!strncmp(arg, "-progress-every=", 16))
+    {
+        theOptions->progressTrials = atoi(arg+16);
+        if(theOptions->progressTrials<1) return false;
+    }
+    else if(!strncmp(arg, "-progress-seconds=", 18))
+    {
+        theOptions->progressSeconds = atof(arg+18);
+        if(theOptions->progressSeconds<=0) return false;
+    }
+    else if(!strncmp(arg, "-time-budget=", 13))
+    {
+        theOptions->timeBudget = atof(arg+13);
+        if(theOptions->timeBudget<=0) return false;
+    }
+    else if(!strncmp(arg, "-bank=", 6)) theOptions->bankFile = arg+6;
+    else if(!strncmp(arg, "-makebank=", 10)) theOptions->makeBankFile = arg+10;
+    else if(!strncmp(arg, "-bootstrap=", 11))
+    {
+        theOptions->bootstrap = atoi(arg+11);
+        if(theOptions->bootstrap<2) return false;
+    }
+    else if(!strncmp(arg, "-target-width=", 14))
+    {
+        theOptions->targetWidth = atof(arg+14);
+        if(theOptions->targetWidth<=0) return false;
+    }
+    else if(!strncmp(arg, "-mrm=", 5)) 
+    {
+        theOptions->regression = atoi(arg+5);
+        if(theOptions->regression<1) return false;
+    }
+    else if(!strncmp(arg, "-correlogram=", 13)) 
+    {
+        //Comma-separated class edges, each above the last
+        const char* text = arg+13;
+        int edges = 1;
+        for(const char* c=text; *c; c++) if(*c==',') edges++;
+        if(edges<2 || edges-1>CORRELOGRAM_MAX_CLASSES) return false;
+        free(theOptions->classBounds);
+        theOptions->classBounds = allocateArrayOfFloats(edges);
+        char* end;
+        for(int k=0; k<edges; k++)
+        {
+            theOptions->classBounds[k] = strtof(text, &end);
+            if(end==text || (k && theOptions->classBounds[k]<=theOptions->classBounds[k-1])) 
+                return false;
+            text = end+1;
+        }
+        theOptions->numClasses = edges-1;
+    }
+    else if(!strncmp(arg, "-generators=", 12)) 
+    {
+        theOptions->generators = atoi(arg+12);
+        if(theOptions->generators<1) return false;
+    }
+    else if(!strncmp(arg, "-batch=", 7)) 
+    {
+        theOptions->batchSize = atoi(arg+7);
+        if(theOptions->batchSize<1) return false;
+    }
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Describe the available options
+ * @sideeffect Prints option list to screen
+ */
+void printOptions(void);
+void printOptions(void)
+{
+    printf("Options:\n");
+    printf("\t-compact=bf16|q16|q8  Hold centered data in compact storage (Pearson only)\n");
+    printf("\t-allpairs=M           Correlate M landscapes pairwise; files are grouped\n");
+    printf("\t                      per field as F1a F1b ... F1M F2a F2b ... F2M ...\n");
+    printf("\t-onevsmany=K          Correlate one preserved landscape with K candidates;\n");
+    printf("\t                      files are grouped per field as P1 C1a ... C1K P2 ...\n");
+    printf("\t-batch=B              Candidates fused into each pass (default 8)\n");
+    printf("\t-manifest=FILE        Run every job listed in FILE instead; each line is\n");
+    printf("\t                      pair|triple {trials} files... (grouped as above)\n");
+    printf("\t-residual             Manifest triple jobs permute residuals (Freedman-Lane)\n");
+    printf("\t-moments              Pair tests skip permuting; p values come from the exact\n");
+    printf("\t                      moments of r over every relabeling (symmetric fields only)\n");
+    printf("\t-tail                 Pair tests estimate small p values by tempered sampling\n");
+    printf("\t                      toward high correlations; {trials} counts sweeps\n");
+    printf("\t-target-width=W       Pair tests run blocks of trials until the 95%% interval\n");
+    printf("\t                      on p is narrower than W; {trials} is then a limit\n");
+    printf("\t-target-se=E          As -target-width, for a standard error of E\n");
+    printf("\t-bootstrap=B          Pair tests also resample samples B times for percentile\n");
+    printf("\t                      and BCa intervals on r (using -threads)\n");
+    printf("\t-progress=status|ndjson  Report the running p value on stderr as a status\n");
+    printf("\t                      line or as JSON lines (every second, unless set below)\n");
+    printf("\t-progress-every=N     Report progress every N trials\n");
+    printf("\t-progress-seconds=S   Report progress every S seconds\n");
+    printf("\t-time-budget=S        Stop pair tests after S seconds, saving the trials done\n");
+    printf("\t-bank=FILE            Pair tests (and manifest pairs) relabel with the permutations\n");
+    printf("\t                      in FILE rather than random ones, so their p values share trials\n");
+    printf("\t-makebank=FILE {trials} S1 S2 ...  Write a bank of {trials} permutations for fields\n");
+    printf("\t                      of S1, S2 ... samples (list a size once per field that has it)\n");
+    printf("\t-threads=N            Worker threads for -manifest or pair runs (default 1)\n");
+    printf("\t-numa=off             Don't pin threads or copy landscapes per memory node\n");
+    printf("\t-steal                With -threads, share each trial's fields by work stealing\n");
+    printf("\t-generators=G         Shuffle on G threads, feeding the -threads consumers\n");
+    printf("\t-cache=DIR            Keep centered/ranked landscapes in DIR for reuse\n");
+    printf("\t-cachemax=MB          Size limit for the -cache directory (default %d)\n",
+           CACHE_DEFAULT_MB);
+    printf("\t-memory=MB            Stream landscapes from disk within MB (Pearson only)\n");
+    printf("\t-scratch=DIR          Where -memory unpacks landscapes (default $TMPDIR or /tmp)\n");
+    printf("\t-matrixfree           Recompute the preserved (points file) distances every\n");
+    printf("\t                      trial instead of storing them (Pearson only)\n");
+    printf("\t-mrm=P                Regress one landscape on P predictors; files are grouped\n");
+    printf("\t                      per field as Y1 X1a ... X1P Y2 X2a ... X2P ...\n");
+    printf("\t-correlogram=D0,D1,.. Correlate each preserved distance class [D0,D1), [D1,D2)...\n");
+    printf("\t                      with the permuted landscape, all in one pass per trial\n");
+    printf("Any input file may hold sample coordinates instead of a distance matrix:\n");
+    printf("\t<Points F:Samples S:Dimensions D:Distance euclidean|greatcircle|manhattan|braycurtis>\n");
+    printf("\tfollowed by S rows of D values (latitude longitude, in degrees, for greatcircle)\n");
+}
 
 /**
  * @brief Entry point for program
@@ -22,15 +195,152 @@
 int main (int argc, const char * argv[])
 {
     //if(true) runTests();
+    //if(true) benchmarkPermutify();
     //return -1;
     //if(true) makeTestFiles();
     int timestamp = (unsigned)time(NULL);
     int fields;
+    int fullArgc = argc;
+    const char** fullArgv = argv;
+    
+    RunOptions options;
+    initializeRunOptions(&options);
+    int firstArg = 1;
+    while(firstArg<argc && argv[firstArg][0]=='-')
+    {
+        if(!parseOption(&options, argv[firstArg]))
+        {
+            printf("Unknown option %s\n", argv[firstArg]);
+            printOptions();
+            return EXIT_FAILURE;
+        }
+        firstArg++;
+    }
+    if(options.progress!=PROGRESS_NONE && !options.progressTrials && !options.progressSeconds)
+        options.progressSeconds = 1;
+    //Skip past options, so argv[1] is {trials} as before
+    argc -= firstArg-1;
+    argv += firstArg-1;
+    
+    //A bank needs only {trials} and field sizes
+    if(options.makeBankFile!=NULL)
+    {
+        int trials = (argc>2) ? atoi(argv[1]) : 0;
+        int sizes[argc>2 ? argc-2 : 1];
+        bool good = (trials>0);
+        for(int i=2; i<argc && good; i++)
+        {
+            sizes[i-2] = atoi(argv[i]);
+            good = (sizes[i-2]>0);
+        }
+        if(!good)
+        {
+            printf("Syntax:\n");
+            printf("%s -makebank=FILE {trials} S1 S2 ...\n", fullArgv[0]);
+            return EXIT_FAILURE;
+        }
+        if(!savePermutationBank(options.makeBankFile, argc-2, sizes, trials, timestamp))
+        {
+            printf("ERROR: Couldn't write permutation bank <%s>\n", options.makeBankFile);
+            return EXIT_FAILURE;
+        }
+        printf("Wrote %d trials for %d field(s) to <%s>\n", trials, argc-2, options.makeBankFile);
+        return EXIT_SUCCESS;
+    }
     
-    if(argc%2 != 0 || argc<4)
+    //Progress and time budgets are only watched in the plain pair-test loop
+    if((options.progress!=PROGRESS_NONE || options.timeBudget>0)
+       && (options.moments || options.tail || options.matrixFree || options.memoryLimit>0
+           || options.allPairs || options.oneVsMany || options.regression || options.numClasses
+           || options.manifest!=NULL))
+    {
+        printf("-progress and -time-budget can't be combined with -moments, -tail, -matrixfree,\n");
+        printf("-memory, -allpairs, -onevsmany, -mrm, -correlogram or -manifest\n");
+        return EXIT_FAILURE;
+    }
+    
+    //Those pair runs return before the bootstrap step
+    if(options.bootstrap && (options.moments || options.tail || options.matrixFree
+                             || options.memoryLimit>0))
+    {
+        printf("-bootstrap can't be combined with -moments, -tail, -matrixfree or -memory\n");
+        return EXIT_FAILURE;
+    }
+    
+    //Matrix-free trials run on one thread, straight from the coordinates
+    if(options.matrixFree && (options.storage!=FIELD_STORAGE_FLOAT || options.cacheDir!=NULL
+                              || options.threads>1 || options.steal || options.generators))
+    {
+        printf("-matrixfree can't be combined with -compact, -cache, -threads, -steal or -generators\n");
+        return EXIT_FAILURE;
+    }
+    
+    //Out-of-core trials run on one thread, from their own scratch copies
+    if(options.memoryLimit>0 && (options.storage!=FIELD_STORAGE_FLOAT || options.cacheDir!=NULL
+                                 || options.threads>1 || options.steal || options.generators))
+    {
+        printf("-memory can't be combined with -compact, -cache, -threads, -steal or -generators\n");
+        return EXIT_FAILURE;
+    }
+    
+    //Banked trials can't be mixed with other ways of choosing them
+    if(options.bankFile!=NULL)
+    {
+        if(options.moments || options.tail || options.targetWidth>0 || options.timeBudget>0
+           || options.progress!=PROGRESS_NONE || options.generators || options.steal
+           || options.matrixFree || options.memoryLimit>0 || options.allPairs || options.oneVsMany
+           || options.regression || options.numClasses)
+        {
+            printf("-bank can't be combined with -moments, -tail, -target-width, -target-se,\n");
+            printf("-progress, -time-budget, -generators, -steal, -matrixfree, -memory,\n");
+            printf("-allpairs, -onevsmany, -mrm or -correlogram\n");
+            return EXIT_FAILURE;
+        }
+        PermBank* theBank = openPermutationBank(options.bankFile);
+        if(theBank==NULL)
+        {
+            printf("ERROR: Couldn't read permutation bank <%s>\n", options.bankFile);
+            return EXIT_FAILURE;
+        }
+        closePermutationBank(theBank);
+    }
+    
+    //Only manifests run partial tests; main() leaves processFileTriples switched off
+    if(options.residual && options.manifest==NULL)
+    {
+        printf("-residual needs -manifest; only manifest triple jobs run partial tests\n");
+        return EXIT_FAILURE;
+    }
+    
+    //Batch jobs bring their own trials and files
+    if(options.manifest!=NULL)
+    {
+        int jobs = processManifest(options.manifest, timestamp, &options);
+        if(jobs<0) return EXIT_FAILURE;
+        printf("\nWriting results of %d jobs to testinfo.%d.Batch.tdv\n", jobs, timestamp);
+        return EXIT_SUCCESS;
+    }
+    
+    int groupSize = 2;
+    if(options.allPairs) groupSize = options.allPairs;
+    if(options.oneVsMany) groupSize = options.oneVsMany+1;
+    if(options.regression) groupSize = options.regression+1;
+    if((options.allPairs!=0) + (options.oneVsMany!=0) + (options.numClasses!=0)
+       + (options.regression!=0) > 1)
+    {
+        printf("Choose only one of -allpairs, -onevsmany, -correlogram and -mrm\n");
+        return EXIT_FAILURE;
+    }
+    if(options.moments && options.tail)
+    {
+        printf("Choose only one of -moments and -tail\n");
+        return EXIT_FAILURE;
+    }
+    if((argc-2)%groupSize != 0 || argc<2+groupSize)
     {
         printf("Syntax:\n");
-        printf("%s {trials} F1a.tdv F2a.tdv F1b.tdv F2b.tdv ...\n", argv[0]);
+        printf("%s [options] {trials} F1a.tdv F2a.tdv F1b.tdv F2b.tdv ...\n", fullArgv[0]);
+        printOptions();
         return EXIT_FAILURE;
     }
     int trials = atoi(argv[1]);
@@ -41,7 +351,7 @@ int main (int argc, const char * argv[])
     }
     fields = argc-2;
 
-    srand(timestamp); //Seed random number generator
+    seedRandom(timestamp); //Seed random number generator
 
     char fname[100];
     sprintf(fname, "testinfo.%d.report.txt", timestamp);
@@ -49,12 +359,59 @@ int main (int argc, const char * argv[])
     FILE* output = fopen(fname, "w");
 
     fprintf(output, "Processing based on command:\n\t");
-    for(int i=0; i<argc; i++) fprintf(output, "%s ", argv[i]);
+    for(int i=0; i<fullArgc; i++) fprintf(output, "%s ", fullArgv[i]);
     fprintf(output, "\n\n");
 
-    if(fields%2==0 && fields%3==0) 
+    if(options.allPairs)
+    {
+        fprintf(output, "Processing %d-field all-pairs Mantel Test of %d landscapes:\n", 
+                fields/groupSize, groupSize);
+        for(int i=0; i<fields/groupSize; i++)
+        {
+            fprintf(output, "\tField %d:", i+1);
+            for(int m=0; m<groupSize; m++) fprintf(output, " %s", argv[groupSize*i+m+2]);
+            fprintf(output, "\n");
+        }
+        fprintf(output, "Timestamp: %d\n",timestamp);
+        processAllPairs(trials, fields/groupSize, argv, timestamp, &options);
+    }
+    else if(options.oneVsMany)
+    {
+        fprintf(output, "Processing %d-field Mantel Test of %d candidates against:\n", 
+                fields/groupSize, options.oneVsMany);
+        for(int i=0; i<fields/groupSize; i++)
+        {
+            fprintf(output, "\t%s\n", argv[groupSize*i+2]);
+        }
+        fprintf(output, "Timestamp: %d\n",timestamp);
+        processOneVsMany(trials, fields/groupSize, argv, timestamp, &options);
+    }
+    else if(options.regression)
+    {
+        fprintf(output, "Processing %d-field regression on %d predictors of:\n", 
+                fields/groupSize, options.regression);
+        for(int i=0; i<fields/groupSize; i++)
+        {
+            fprintf(output, "\t%s\n", argv[groupSize*i+2]);
+        }
+        fprintf(output, "Timestamp: %d\n",timestamp);
+        processRegression(trials, fields/groupSize, argv, timestamp, &options);
+    }
+    else if(options.numClasses)
+    {
+        fprintf(output, "Processing %d-field Mantel correlogram with %d distance classes on:\n", 
+                fields/2, options.numClasses);
+        for(int i=0; i<fields/2; i++)
+        {
+            fprintf(output, "\t%s vs %s\n", argv[2*i+2], argv[2*i+3]);
+        }
+        fprintf(output, "Timestamp: %d\n",timestamp);
+        processCorrelogram(trials, fields/2, argv, timestamp, &options);
+    }
+    else if(fields%2==0 && fields%3==0) 
         fprintf(output, "WARNING: Unable to infer from number of fields whether you want a Mantel or Partial Mantel test. I'll try both.\n");
-    if(fields%2==0)
+    if(fields%2==0 && !options.allPairs && !options.oneVsMany && !options.numClasses
+       && !options.regression)
     {
         fprintf(output, "Processing %d-field Mantel Test on:\n", fields/2);
         for(int i=0; i<fields/2; i++)
@@ -62,7 +419,7 @@ int main (int argc, const char * argv[])
             fprintf(output, "\t%s vs %s\n", argv[2*i+2], argv[2*i+3]);
         }
         fprintf(output, "Timestamp: %d\n",timestamp);
-        processFilePairs(trials, fields/2, argv, timestamp);
+        processFilePairs(trials, fields/2, argv, timestamp, &options);
     }
     
     fprintf(output, "\n\n");
@@ -76,7 +433,7 @@ int main (int argc, const char * argv[])
             printf("\t%s vs %s given %s\n", argv[3*i+2], argv[3*i+3], argv[3*i+4]);
         }
         printf("Timestamp: %d\n",timestamp);
-        processFileTriples(trials, fields/3, argv, timestamp);
+        processFileTriples(trials, fields/3, argv, timestamp, &options);
     }
     */
     fprintf(output, "\n\n");
@@ -42,6 +42,8 @@ bool runTests(void)
     
     assert(testRandInRange());
 
+    assert(testRandBelowWithState());
+
     assert(testInOrder());
 
     assert(testSwapF());
@@ -76,16 +78,26 @@ bool runTests(void)
 
     assert( testSaveFieldToTDV());
 
+    assert(testIsFieldSymmetric());
+
+    assert(testMakeFieldFromPoints());
+
 //    assert(testDisplayField());
 
 #warning tests unimplemented
     assert(testAugmentCAByFields());
+    
+    assert(testAugmentCAByTiledFields());
+    
+    assert(testModifyFieldCompactify());
    
     assert(testMakeLandscapeFromTDVs());
     
     assert(testModifyLandscapeMeanify());
     
     assert(testModifyLandscapeRankify());
+    
+    assert(testMakeLandscapeFromCache());
    
     assert(testMakeListFromField());
     
@@ -98,10 +110,50 @@ bool runTests(void)
     
     assert(testCorrelatePartialAndFindP());
     
+    assert(testCorrelateResidualsAndFindP());
+    
+    assert(testComputeClopperPearson());
+    assert(testCorrelateAndFindPToWidth());
+    assert(testCorrelateAndFindPWithProgress());
+    
     assert(testProcessFilePairs());
     
     assert(testProcessFileTriples());
     
+    assert(testCorrelateAllPairsAndFindP());
+    
+    assert(testCorrelateStreamedAndFindP());
+    
+    assert(testCorrelatePointsAndFindP());
+    
+    assert(testMakeTopologyFromSystem());
+    
+    assert(testCorrelateAndFindPThreaded());
+    
+    assert(testMakeFieldTasksFromLandscape());
+    
+    assert(testCorrelateAndFindPStealing());
+    
+    assert(testMakePermRing());
+    
+    assert(testCorrelateAndFindPPipelined());
+    
+    assert(testCorrelateOneVsManyAndFindP());
+    
+    assert(testCorrelogramAndFindP());
+    
+    assert(testRegressAndFindP());
+    
+    assert(testCorrelateAndApproximateP());
+    
+    assert(testCorrelateAndEstimateTailP());
+    
+    assert(testCorrelateAndBootstrapR());
+    
+    assert(testCorrelateAndFindPFromBank());
+    
+    assert(testAcquireCachedLandscape());
+    
     return reportEnd(true, NULL);
     
 }
@@ -142,6 +194,40 @@ bool testRandInRange(void)
     return reportEnd(true, NULL);
 }
 
+bool testRandBelowWithState(void)
+{
+    reportStart("randBelowWithState");
+    RandomState theState, otherState;
+    seedRandomState(&theState, TEST_SEED);
+    seedRandomState(&otherState, TEST_SEED);
+    
+    //Bounds, including the range that can't go wrong and one that forces rejections
+    uint32_t ranges[4] = {1, 7, 1000, 3000000000u};
+    for(int r=0; r<4; r++)
+    {
+        for(int i=0; i<10000; i++)
+        {
+            if(randBelowWithState(&theState, ranges[r]) >= ranges[r]) return reportEnd(false, "out of range");
+        }
+    }
+    
+    //Equal seeds, equal streams
+    seedRandomState(&theState, TEST_SEED);
+    for(int i=0; i<1000; i++)
+    {
+        if(randBelowWithState(&theState, 1000) != randBelowWithState(&otherState, 1000)) return reportEnd(false, "not reproducible");
+    }
+    
+    //Rough uniformity: each of 10 values about 10000 times in 100000
+    int counts[10] = {0};
+    for(int i=0; i<100000; i++) counts[randBelowWithState(&theState, 10)]++;
+    for(int v=0; v<10; v++)
+    {
+        if(counts[v]<9500 || counts[v]>10500) return reportEnd(false, "not uniform");
+    }
+    return reportEnd(true, NULL);
+}
+
 bool testInOrder(void)
 {
     reportStart("inOrder");
@@ -283,32 +369,44 @@ bool testModifyPermPermutify(void)
     reportStart("modifyPermPermutify");
     int testSize = 5;
     Perm* thePerm = makePerm(testSize, SEED_IDENTITY);
+    Perm* otherPerm = makePerm(testSize, SEED_IDENTITY);
     //showPermutation(thePerm);
     for(int i=0; i<testSize; i++)
     {
         if(thePerm->index[i] != i) return reportEnd(false, "pre-identity fail");
     }
-    for(int i=0; i<testSize-1; i++)
-    {
-        modifyPermPermutify(thePerm, TEST_SEED);
-        //showPermutation(thePerm);
-    }   //Should result in identity
-    for(int i=0; i<testSize; i++)
-    {
-        if(thePerm->index[i] != i) return reportEnd(false, "post-identity fail");
-    }
     modifyPermPermutify(thePerm, TEST_SEED); //Mess it up once
+    //showPermutation(thePerm);
     int displacements=0;
+    bool seen[5] = {false};
     for(int i=0; i<testSize; i++)
     {
         if(thePerm->index[i] != i) displacements++;
+        if(seen[thePerm->index[i]]) return reportEnd(false, "not a permutation");
+        seen[thePerm->index[i]] = true;
     }
     if(displacements<1) return reportEnd(false, "nonidentity fail");
+    if(thePerm->isIdentity) return reportEnd(false, "still marked identity");
     
+    modifyPermPermutify(otherPerm, TEST_SEED); //Same seed, same shuffle
+    for(int i=0; i<testSize; i++)
+    {
+        if(thePerm->index[i] != otherPerm->index[i]) return reportEnd(false, "not reproducible");
+    }
+    
+    modifyPermPermutify(thePerm, SEED_IDENTITY);
+    for(int i=0; i<testSize; i++)
+    {
+        if(thePerm->index[i] != i) return reportEnd(false, "post-identity fail");
+    }
+    if(!thePerm->isIdentity) return reportEnd(false, "identity not marked");
+    free(thePerm->index);
+    free(thePerm);
+    free(otherPerm->index);
+    free(otherPerm);
     return reportEnd(true, NULL);
 }
 
-
 #pragma mark Lists
 
 List* makeTestList(void);
@@ -525,6 +623,85 @@ bool  testSaveFieldToTDV(void)
     return testLoadAndSaveFieldTDV();
 }
 
+bool testIsFieldSymmetric(void)
+{
+    reportStart("isFieldSymmetric");
+    Field* theField = makeRandomField(6);
+    if(!isFieldSymmetric(theField)) return reportEnd(false, "random field not symmetric");
+    
+    //One-sided change, then check it survives the trip through a file
+    theField->element[1][4] += 1;
+    if(isFieldSymmetric(theField)) return reportEnd(false, "asymmetry missed");
+    saveFieldToTDV("testAsymmetric.tdv", theField);
+    Field* loaded = makeFieldFromTDV("testAsymmetric.tdv");
+    if(loaded->isSymmetric) return reportEnd(false, "asymmetric file flagged symmetric");
+    freeField(loaded);
+    theField->element[4][1] += 1;
+    saveFieldToTDV("testAsymmetric.tdv", theField);
+    loaded = makeFieldFromTDV("testAsymmetric.tdv");
+    if(!loaded->isSymmetric) return reportEnd(false, "symmetric file flagged asymmetric");
+    freeField(loaded);
+    freeField(theField);
+    return reportEnd(true, NULL);
+}
+
+bool testMakeFieldFromPoints(void)
+{
+    reportStart("makeFieldFromPoints");
+    //A 3-4-5 right triangle, then the equator-to-pole quarter circle
+    const char* metrics[4] = {"euclidean", "manhattan", "braycurtis", "greatcircle"};
+    float expected[4][3] = { //d(0,1), d(0,2), d(1,2)
+        {3, 4, 5},
+        {3, 4, 7},
+        {3.0/11, 4.0/12, 7.0/15}, //Features shifted by +2 so every total is positive
+        {(float)(EARTH_RADIUS_KM*M_PI/2), (float)(EARTH_RADIUS_KM*M_PI/2), (float)(EARTH_RADIUS_KM*M_PI/2)}};
+    float points[4][3][2] = {
+        {{0,0}, {3,0}, {0,4}},
+        {{0,0}, {3,0}, {0,4}},
+        {{2,2}, {5,2}, {2,6}},
+        {{0,0}, {0,90}, {90,0}}};
+    FILE* theFile;
+    Field* theField;
+    for(int m=0; m<4; m++)
+    {
+        theFile = fopen("testPoints.tdv", "w");
+        fprintf(theFile, "<Points 7:Samples 3:Dimensions 2:Distance %s>\n", metrics[m]);
+        for(int i=0; i<3; i++) fprintf(theFile, "%f\t%f\n", points[m][i][0], points[m][i][1]);
+        fclose(theFile);
+        
+        //Points files load through the ordinary TDV reader
+        theField = makeFieldFromTDV("testPoints.tdv");
+        if(theField->samples!=3 || theField->fieldnum!=7) return reportEnd(false, "header misread");
+        if(!theField->isSymmetric) return reportEnd(false, "distances not symmetric");
+        float got[3] = {theField->element[0][1], theField->element[0][2], theField->element[1][2]};
+        for(int k=0; k<3; k++)
+        {
+            if(fabs(got[k]-expected[m][k]) > 0.0001*expected[m][k])
+                return reportEnd(false, "wrong distance");
+        }
+        freeField(theField);
+    }
+    
+    //Enough rows to be shared between threads: every row filled, same as one at a time
+    PointSet* thePoints = makePointSetFromFile("testPoints.tdv");
+    free(thePoints->coords);
+    thePoints->samples = 3*DISTANCE_THREAD_ROWS+5;
+    thePoints->coords = allocateArrayOfFloats(3*thePoints->samples);
+    for(int i=0; i<3*thePoints->samples; i++) thePoints->coords[i] = randInRange(0, 1000)/1000.0;
+    theField = makeFieldFromPointSet(thePoints);
+    float* row = allocateArrayOfFloats(thePoints->samples);
+    for(int i=0; i<thePoints->samples; i++)
+    {
+        fillDistanceRow(thePoints, i, row);
+        if(memcmp(row, theField->element[i], thePoints->samples*sizeof(float)))
+            return reportEnd(false, "threaded rows differ");
+    }
+    free(row);
+    freeField(theField);
+    freePointSet(thePoints);
+    return reportEnd(true, NULL);
+}
+
 
 bool testDisplayField(void)
 {
@@ -557,8 +734,134 @@ bool testDisplayField(void)
 bool testAugmentCAByFields(void)
 {//CorrelationAggregate* theCA, Field* X, Field* Y
     reportStart("augmentCAByFields");
-    return reportFake();
-    return reportEnd(false, "STUB");  
+    //Specialized sizes, and neighbours that fall back to the generic loop
+    int sizes[] = {4, 7, 8, 16, 33, 64};
+    CorrelationAggregate* theCA = allocateCA();
+    CorrelationAggregate* expected = allocateCA();
+    Field *X, *Y;
+    int n;
+    
+    //Each size on the triangle path, then forced onto the full square
+    for(int s=0; s<12; s++)
+    {
+        n = sizes[s%6];
+        X = makeRandomField(n);
+        Y = makeRandomField(n);
+        X->isSymmetric = Y->isSymmetric = (s<6);
+        //Every other case keeps X as the identity, like a preserved landscape
+        if(s%2) modifyPermPermutify(X->perm, SEED_RANDOM);
+        modifyPermPermutify(Y->perm, SEED_RANDOM);
+        
+        initializeCA(expected);
+        for(int i=0; i<n; i++)
+            for(int j=0; j<n; j++)
+                if(i!=j) augmentCAByValues(expected,
+                                           X->element[X->perm->index[i]][X->perm->index[j]],
+                                           Y->element[Y->perm->index[i]][Y->perm->index[j]]);
+        initializeCA(theCA);
+        augmentCAByFields(theCA, X, Y);
+        
+        if(fabs(theCA->numerator-expected->numerator) > 0.001*fabs(expected->numerator)+0.001
+           || fabs(theCA->denominatorL-expected->denominatorL) > 0.001*expected->denominatorL
+           || fabs(theCA->denominatorR-expected->denominatorR) > 0.001*expected->denominatorR)
+            return reportEnd(false, "aggregate differs from direct sum");
+        if(augmentCAByFixedSizeFields(theCA, X, Y) != (n!=7 && n!=33))
+            return reportEnd(false, "wrong kernel availability");
+        freeField(X);
+        freeField(Y);
+    }
+    free(theCA);
+    free(expected);
+    return reportEnd(true, NULL);
+}
+
+
+
+bool testAugmentCAByTiledFields(void)
+{//CorrelationAggregate* theCA, Field* X, Field* Y
+    reportStart("augmentCAByTiledFields");
+    //One full tile and one partial, both sides permuted
+    int n = TILE_COLUMNS+TILE_COLUMNS/2+3;
+    Field* X = makeRandomField(n);
+    Field* Y = makeRandomField(n);
+    modifyPermPermutify(X->perm, SEED_RANDOM);
+    modifyPermPermutify(Y->perm, SEED_RANDOM);
+    double numerator=0, denominatorL=0, denominatorR=0, xVal, yVal;
+    
+    //Centre the fields roughly so the cross term is not swamped
+    for(int i=0; i<n; i++)
+        for(int j=0; j<n; j++)
+        {
+            X->element[i][j] -= 4.5;
+            Y->element[i][j] -= 4.5;
+        }
+    for(int i=0; i<n; i++)
+    {
+        for(int j=0; j<n; j++)
+        {
+            if(i==j) continue;
+            xVal = X->element[X->perm->index[i]][X->perm->index[j]];
+            yVal = Y->element[Y->perm->index[i]][Y->perm->index[j]];
+            numerator += xVal*yVal;
+            denominatorL += xVal*xVal;
+            denominatorR += yVal*yVal;
+        }
+    }
+    CorrelationAggregate* theCA = allocateCA();
+    bool success = true;
+    //Triangle path, then the full square
+    for(int path=0; path<2; path++)
+    {
+        X->isSymmetric = Y->isSymmetric = (path==0);
+        initializeCA(theCA);
+        augmentCAByTiledFields(theCA, X, Y);
+        
+        success = success
+                && fabs(theCA->denominatorL-denominatorL) < 0.0001*denominatorL
+                && fabs(theCA->denominatorR-denominatorR) < 0.0001*denominatorR
+                && fabs(theCA->numerator-numerator) < 0.0001*sqrt(denominatorL*denominatorR);
+    }
+    free(theCA);
+    freeField(X);
+    freeField(Y);
+    return reportEnd(success, "aggregate differs from direct sum");
+}
+
+
+bool testModifyFieldCompactify(void)
+{
+    reportStart("modifyFieldCompactify");
+    int samples = 12;
+    int storages[] = {FIELD_STORAGE_BF16, FIELD_STORAGE_Q16, FIELD_STORAGE_Q8};
+    Field* original = makeRandomField(samples);
+    Field* compact;
+    float expected, widened;
+    
+    for(int s=0; s<3; s++)
+    {
+        //Same contents as original, but ours to compact
+        compact = makeRandomField(samples);
+        for(int i=0; i<samples; i++)
+            for(int j=0; j<samples; j++)
+                compact->element[i][j] = original->element[i][j]-4.5;
+        
+        modifyFieldCompactify(compact, storages[s]);
+        if(compact->storage != storages[s]) return reportEnd(false, "storage not set");
+        if(compact->element != NULL) return reportEnd(false, "full data kept");
+        for(int i=0; i<samples; i++)
+        {
+            for(int j=0; j<samples; j++)
+            {
+                if(i==j) continue;
+                expected = original->element[i][j]-4.5;
+                widened = fieldElement(compact, i, j);
+                if(fabs(widened-expected) > compact->errorBound+0.00001)
+                    return reportEnd(false, "error bound exceeded");
+            }
+        }
+        //Random fields hold whole numbers 0-9, so the coarsest step is 9/255
+        if(compact->errorBound > 9.0/255) return reportEnd(false, "error bound too loose");
+    }
     return reportEnd(true, NULL);
 }
 
@@ -588,8 +891,76 @@ bool testModifyLandscapeMeanify(void)
 bool testModifyLandscapeRankify(void)
 {//Landscape* theData
     reportStart("modifyLandscapeRankify");
-    return reportFake();
-    return reportEnd(false, "STUB");  
+    //Same data twice; the second is forced onto the full-square path
+    Field* fields[2];
+    Field* copies[2];
+    for(int f=0; f<2; f++)
+    {
+        fields[f] = makeRandomField(5+3*f);
+        copies[f] = makeFieldFromField(fields[f]);
+        copies[f]->isSymmetric = false;
+    }
+    Landscape* triangle = makeLandscapeFromFields(2, fields);
+    Landscape* square = makeLandscapeFromFields(2, copies);
+    if(!triangle->isSymmetric || square->isSymmetric) return reportEnd(false, "symmetry not gathered from fields");
+    modifyLandscapeRankify(triangle);
+    modifyLandscapeRankify(square);
+    
+    for(int f=0; f<2; f++)
+        for(int i=0; i<fields[f]->samples; i++)
+            for(int j=0; j<fields[f]->samples; j++)
+                if(i!=j && triangle->fields[f]->element[i][j] != square->fields[f]->element[i][j])
+                    return reportEnd(false, "triangle ranks differ from full ranks");
+    freeLandscape(triangle);
+    freeLandscape(square);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Landscape cache
+
+bool testMakeLandscapeFromCache(void)
+{
+    reportStart("makeLandscapeFromCache");
+    const char* cacheDir = ".";
+    const char* names[2] = {"testDisk0.tdv", "testDisk1.tdv"};
+    saveFieldToTDV(names[0], makeRandomField(5));
+    saveFieldToTDV(names[1], makeRandomField(8));
+    
+    Landscape* expected = makeLandscapeFromTDVs(2, names);
+    modifyLandscapeMeanify(expected);
+    
+    //First call fills the cache, second reads it back
+    Landscape* theScape;
+    for(int pass=0; pass<2; pass++)
+    {
+        theScape = makeLandscapeFromCache(cacheDir, 1LL<<30, 2, names, false);
+        if(!theScape->isCentered) return reportEnd(false, "not centered");
+        if((pass==1) != (theScape->mapping!=NULL)) return reportEnd(false, "cache not used");
+        for(int f=0; f<2; f++)
+            for(int i=0; i<expected->fields[f]->samples; i++)
+                for(int j=0; j<expected->fields[f]->samples; j++)
+                    if(theScape->fields[f]->element[i][j] != expected->fields[f]->element[i][j])
+                        return reportEnd(false, "element mismatch");
+        freeLandscape(theScape);
+    }
+    
+    //Changed input must not match the old entry
+    saveFieldToTDV(names[1], makeRandomField(8));
+    theScape = makeLandscapeFromCache(cacheDir, 1LL<<30, 2, names, false);
+    if(theScape->mapping!=NULL) return reportEnd(false, "stale entry used");
+    freeLandscape(theScape);
+    
+    //Ranked version is kept separately
+    theScape = makeLandscapeFromCache(cacheDir, 1LL<<30, 2, names, true);
+    if(!theScape->isRankBased || !theScape->isCentered) return reportEnd(false, "not ranked");
+    freeLandscape(theScape);
+    
+    //Zero limit empties the cache
+    modifyCacheEvict(cacheDir, 0);
+    theScape = makeLandscapeFromCache(cacheDir, 0, 2, names, false);
+    if(theScape->mapping!=NULL) return reportEnd(false, "evicted entry used");
+    freeLandscape(theScape);
     return reportEnd(true, NULL);
 }
 
@@ -669,6 +1040,187 @@ bool testCorrelatePartialAndFindP(void)
     return reportEnd(true, NULL);
 }
 
+bool testCorrelateResidualsAndFindP(void)
+{
+    reportStart("correlateResidualsAndFindP");
+    seedRandom(TEST_SEED);
+    int trials = 40;
+    Landscape* scapes[3];
+    Field* fields[3];
+    for(int m=0; m<3; m++)
+    {
+        for(int f=0; f<3; f++) fields[f] = makeRandomField(5+4*f);
+        scapes[m] = makeLandscapeFromFields(3, fields);
+    }
+    //Give the preserved and permuted landscapes something in common with the given one
+    for(int f=0; f<3; f++)
+    {
+        for(int x=0; x<scapes[0]->fields[f]->samples; x++)
+        {
+            for(int y=0; y<scapes[0]->fields[f]->samples; y++)
+            {
+                scapes[0]->fields[f]->element[x][y] += scapes[2]->fields[f]->element[x][y];
+                scapes[1]->fields[f]->element[x][y] += 0.5*scapes[2]->fields[f]->element[x][y];
+            }
+        }
+    }
+    
+    //Residuals are uncorrelated with what they were regressed on
+    Landscape* theResiduals = makeResidualLandscape(scapes[0], scapes[2]);
+    if(fabs(mantelR(theResiduals, scapes[2], NULL)) > 0.0001) 
+        return reportEnd(false, "residuals still correlated");
+    if(!theResiduals->isSymmetric) return reportEnd(false, "residuals lost symmetry");
+    freeLandscape(theResiduals);
+    
+    //Unpermuted, correlating residuals is the partial correlation
+    StatisticalData* expected = correlatePartialAndFindP(scapes[1], scapes[0], scapes[2], 1);
+    StatisticalData* theStats = correlateResidualsAndFindP(scapes[1], scapes[0], scapes[2], trials);
+    if(fabs(theStats->correlationOfInterest - expected->correlationOfInterest) > 0.0001)
+        return reportEnd(false, "disagrees with mantelRPartial");
+    if(theStats->listOfCorrelations->count != trials) return reportEnd(false, "trial count");
+    for(int t=0; t<trials; t++)
+        if(fabs(theStats->listOfCorrelations->data[t]) > 1.0001) return reportEnd(false, "r out of range");
+    //Unpermuted trial always counts itself
+    if(theStats->rankInfo->count < 1) return reportEnd(false, "rank");
+    
+    for(int m=0; m<3; m++) freeLandscape(scapes[m]);
+    return reportEnd(true, NULL);
+}
+
+
+//StatisticalData has no free function of its own
+void freeTestStats(StatisticalData* theStats);
+void freeTestStats(StatisticalData* theStats)
+{
+    free(theStats->listOfCorrelations->data);
+    free(theStats->listOfCorrelations);
+    free(theStats->rankInfo);
+    free(theStats);
+}
+
+Landscape* makeTestLandscape(const char* prefix);
+Landscape* makeTestLandscape(const char* prefix)
+{
+    const char* names[3];
+    char filenames[3][40];
+    for(int f=0; f<3; f++)
+    {
+        sprintf(filenames[f], "%s%d.tdv", prefix, f);
+        saveFieldToTDV(filenames[f], makeRandomField(4+3*f));
+        names[f] = filenames[f];
+    }
+    return makeLandscapeFromTDVs(3, names);
+}
+
+bool testComputeClopperPearson(void)
+{
+    reportStart("computeClopperPearson");
+    double low, high;
+    //Reference values from the beta quantiles
+    computeClopperPearson(0, 10, &low, &high);
+    if(low!=0 || fabs(high-0.308497) > 1e-5) return reportEnd(false, "none of 10");
+    computeClopperPearson(5, 10, &low, &high);
+    if(fabs(low-0.187086) > 1e-5 || fabs(high-0.812914) > 1e-5) return reportEnd(false, "5 of 10");
+    computeClopperPearson(10, 10, &low, &high);
+    if(fabs(low-0.691503) > 1e-5 || high!=1) return reportEnd(false, "10 of 10");
+    computeClopperPearson(3, 1000, &low, &high);
+    if(fabs(low-0.000619) > 1e-5 || fabs(high-0.008742) > 1e-5) return reportEnd(false, "3 of 1000");
+    return reportEnd(true, NULL);
+}
+
+bool testCorrelateAndFindPToWidth(void)
+{
+    reportStart("correlateAndFindPToWidth");
+    Landscape* lPreserved = makeTestLandscape("testWidthP");
+    Landscape* lPermuted = makeTestLandscape("testWidthQ");
+    
+    //Stops at the first block boundary that's narrow enough
+    float targetWidth = 0.04;
+    seedRandom(TEST_SEED);
+    StatisticalData* theStats = correlateAndFindPToWidth(lPermuted, lPreserved, 1000000, targetWidth);
+    int trials = theStats->listOfCorrelations->count;
+    float fraction = fractionAtLeast(theStats->listOfCorrelations, theStats->correlationOfInterest);
+    double low, high;
+    computeClopperPearson((int)lround(fraction*trials), trials, &low, &high);
+    if(trials%PRECISION_BLOCK_TRIALS || trials>=1000000) return reportEnd(false, "trials");
+    if(high-low > targetWidth) return reportEnd(false, "too wide");
+    
+    //The same trials as a fixed run
+    seedRandom(TEST_SEED);
+    StatisticalData* theFixed = correlateAndFindP(lPermuted, lPreserved, trials);
+    if(fractionAtLeast(theFixed->listOfCorrelations, theFixed->correlationOfInterest) != fraction)
+        return reportEnd(false, "fixed run");
+    
+    //And the limit still holds
+    theStats = correlateAndFindPToWidth(lPermuted, lPreserved, 2500, 0.001);
+    if(theStats->listOfCorrelations->count != 2500) return reportEnd(false, "limit");
+    
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+/**
+ * @brief What recordProgress has seen
+ */
+typedef struct {
+    int reports;          /**< Reports handed over */
+    bool isInOrder;       /**< FALSE if trials ever went backward */
+    ProgressReport last;  /**< Most recent report */
+} ProgressRecord;
+
+void recordProgress(ProgressReport* theReport, void* context);
+void recordProgress(ProgressReport* theReport, void* context)
+{
+    ProgressRecord* theRecord = context;
+    if(theRecord->reports && theReport->trials < theRecord->last.trials) theRecord->isInOrder = false;
+    theRecord->last = *theReport;
+    theRecord->reports++;
+}
+
+bool testCorrelateAndFindPWithProgress(void)
+{
+    reportStart("correlateAndFindPWithProgress");
+    Landscape* lPreserved = makeTestLandscape("testProgressP");
+    Landscape* lPermuted = makeTestLandscape("testProgressQ");
+    
+    //A report every 100 trials, the last one final
+    ProgressMonitor theMonitor;
+    ProgressRecord theRecord = {.reports = 0, .isInOrder = true};
+    initializeProgressMonitor(&theMonitor);
+    theMonitor.callback = recordProgress;
+    theMonitor.context = &theRecord;
+    theMonitor.everyTrials = 100;
+    seedRandom(TEST_SEED);
+    StatisticalData* theStats = correlateAndFindPWithProgress(lPermuted, lPreserved, 1050, 0,
+                                                              &theMonitor);
+    if(theRecord.reports != 11 || !theRecord.isInOrder) return reportEnd(false, "reports");
+    if(!theRecord.last.isFinal || theRecord.last.trials != 1050) return reportEnd(false, "final report");
+    float fraction = fractionAtLeast(theStats->listOfCorrelations, theStats->correlationOfInterest);
+    if(fabs(theRecord.last.pValue - fraction) > 0.0001) return reportEnd(false, "running p value");
+    if(!(theRecord.last.low <= theRecord.last.pValue && theRecord.last.pValue <= theRecord.last.high))
+        return reportEnd(false, "interval");
+    
+    //Monitoring doesn't change the trials
+    seedRandom(TEST_SEED);
+    StatisticalData* theFixed = correlateAndFindP(lPermuted, lPreserved, 1050);
+    if(fractionAtLeast(theFixed->listOfCorrelations, theFixed->correlationOfInterest) != fraction)
+        return reportEnd(false, "fixed run");
+    freeTestStats(theFixed);
+    freeTestStats(theStats);
+    
+    //Past the deadline, the run stops with what it has
+    theMonitor.callback = NULL;
+    theMonitor.deadline = secondsNow()-1;
+    theStats = correlateAndFindPWithProgress(lPermuted, lPreserved, 1050, 0, &theMonitor);
+    if(theStats->listOfCorrelations->count != 1) return reportEnd(false, "deadline");
+    if(theStats->trialsRequested != 1050) return reportEnd(false, "trials requested");
+    freeTestStats(theStats);
+    
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
 
 /**
  * @brief Creates files containing data on Spearman and Person correlation of inputs
@@ -696,3 +1248,930 @@ bool testProcessFileTriples(void)
 }
 
 
+#pragma mark All pairs
+
+bool testCorrelateAllPairsAndFindP(void)
+{
+    reportStart("correlateAllPairsAndFindP");
+    seedRandom(TEST_SEED);
+    int numScapes = 3;
+    int trials = 20;
+    Landscape* scapes[3];
+    scapes[0] = makeTestLandscape("testPairsA");
+    scapes[1] = makeTestLandscape("testPairsB");
+    scapes[2] = makeTestLandscape("testPairsC");
+    
+    PairwiseData* thePairs = correlateAllPairsAndFindP(numScapes, scapes, trials);
+    
+    float expected;
+    for(int a=0; a<numScapes; a++)
+    {
+        if(thePairs->correlation[a][a] != 1.0) return reportEnd(false, "diagonal");
+        for(int b=0; b<numScapes; b++)
+        {
+            if(thePairs->correlation[a][b] != thePairs->correlation[b][a])
+                return reportEnd(false, "not symmetric");
+            if(thePairs->pValue[a][b]<0 || thePairs->pValue[a][b]>1)
+                return reportEnd(false, "p out of range");
+            if(a==b) continue;
+            //Fields still hold the identity permutation
+            expected = mantelR(scapes[a], scapes[b], NULL);
+            if(fabs(thePairs->correlation[a][b] - expected) > 0.0001)
+                return reportEnd(false, "disagrees with mantelR");
+            //Unpermuted trial always counts itself
+            if(thePairs->pValue[a][b] < 1.0/trials) return reportEnd(false, "p too small");
+        }
+    }
+    freePairwiseData(thePairs);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Out of core
+
+bool testCorrelateStreamedAndFindP(void)
+{
+    reportStart("correlateStreamedAndFindP");
+    seedRandom(TEST_SEED);
+    int trials = 25;
+    Landscape* lPreserved = makeTestLandscape("testStreamX");
+    Landscape* lPermuted = makeTestLandscape("testStreamY");
+    const char* xNames[3] = {"testStreamX0.tdv", "testStreamX1.tdv", "testStreamX2.tdv"};
+    const char* yNames[3] = {"testStreamY0.tdv", "testStreamY1.tdv", "testStreamY2.tdv"};
+    StreamedLandscape* sPreserved = makeStreamedLandscapeFromTDVs(3, xNames, ".");
+    StreamedLandscape* sPermuted = makeStreamedLandscapeFromTDVs(3, yNames, ".");
+    
+    modifyLandscapeMeanify(lPreserved);
+    modifyLandscapeMeanify(lPermuted);
+    float expected = mantelR(lPreserved, lPermuted, NULL);
+    
+    //Everything at once, then a budget of a few rows (several blocks, one trial per pass)
+    long long budgets[2] = {1<<20, 5*10*sizeof(float)};
+    for(int b=0; b<2; b++)
+    {
+        StatisticalData* theStats = correlateStreamedAndFindP(sPermuted, sPreserved, 
+                                                              trials, budgets[b]);
+        if(fabs(theStats->correlationOfInterest - expected) > 0.0001)
+            return reportEnd(false, "disagrees with mantelR");
+        if(theStats->listOfCorrelations->count != trials) return reportEnd(false, "trial count");
+        for(int t=0; t<trials; t++)
+            if(fabs(theStats->listOfCorrelations->data[t]) > 1.0001) 
+                return reportEnd(false, "r out of range");
+        //Unpermuted trial always counts itself
+        if(theStats->rankInfo->count < 1) return reportEnd(false, "rank");
+    }
+    freeStreamedLandscape(sPreserved);
+    freeStreamedLandscape(sPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Matrix free
+
+bool testCorrelatePointsAndFindP(void)
+{
+    reportStart("correlatePointsAndFindP");
+    int trials = 25;
+    //The last field spans several distance buffers
+    int sizes[3] = {4, 7, DISTANCE_SPAN+37};
+    const char* xNames[3] = {"testPointsX0.tdv", "testPointsX1.tdv", "testPointsX2.tdv"};
+    const char* yNames[3] = {"testPointsY0.tdv", "testPointsY1.tdv", "testPointsY2.tdv"};
+    FILE* theFile;
+    for(int f=0; f<3; f++)
+    {
+        theFile = fopen(xNames[f], "w");
+        fprintf(theFile, "<Points %d:Samples %d:Dimensions 2:Distance euclidean>\n", f, sizes[f]);
+        for(int i=0; i<sizes[f]; i++) fprintf(theFile, "%d\t%d\n", randInRange(0, 99), randInRange(0, 99));
+        fclose(theFile);
+        saveFieldToTDV(yNames[f], makeRandomField(sizes[f]));
+    }
+    Landscape* lPreserved = makeLandscapeFromTDVs(3, xNames);
+    Landscape* lPermuted = makeLandscapeFromTDVs(3, yNames);
+    PointLandscape* pPreserved = makePointLandscapeFromFiles(3, xNames);
+    if(pPreserved->numNonDiagElts != lPreserved->numNonDiagElts) 
+        return reportEnd(false, "element count");
+    
+    //One lopsided field, so both the triangle and the full-row paths run
+    lPermuted->fields[1]->element[0][1] += 1;
+    lPermuted->fields[1]->isSymmetric = false;
+    lPermuted->isSymmetric = false;
+    
+    //Same seed, same permutations: every trial should match the stored distances
+    seedRandom(TEST_SEED);
+    StatisticalData* expected = correlateAndFindP(lPermuted, lPreserved, trials);
+    seedRandom(TEST_SEED);
+    StatisticalData* theStats = correlatePointsAndFindP(lPermuted, pPreserved, trials);
+    if(fabs(theStats->correlationOfInterest - expected->correlationOfInterest) > 0.0001)
+        return reportEnd(false, "disagrees with correlateAndFindP");
+    for(int t=0; t<trials; t++)
+    {
+        if(fabs(theStats->listOfCorrelations->data[t] - expected->listOfCorrelations->data[t]) > 0.0001)
+            return reportEnd(false, "permuted trials disagree");
+    }
+    if(theStats->rankInfo->count != expected->rankInfo->count) return reportEnd(false, "rank");
+    
+    freePointLandscape(pPreserved);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark NUMA
+
+bool testMakeTopologyFromSystem(void)
+{
+    reportStart("makeTopologyFromSystem");
+    Topology* theTopology = makeTopologyFromSystem();
+    int total = 0;
+    
+    if(theTopology->numNodes<1) return reportEnd(false, "no nodes");
+    for(int n=0; n<theTopology->numNodes; n++) total += theTopology->numCPUs[n];
+    if(total<1) return reportEnd(false, "no cpus");
+    //Threads fill nodes in order, with none left out
+    for(int t=1; t<7; t++)
+        if(nodeForThread(theTopology, t, 7) < nodeForThread(theTopology, t-1, 7))
+            return reportEnd(false, "threads out of order");
+    if(nodeForThread(theTopology, 6, 7) >= theTopology->numNodes) return reportEnd(false, "node range");
+    freeTopology(theTopology);
+    return reportEnd(true, NULL);
+}
+
+bool testCorrelateAndFindPThreaded(void)
+{
+    reportStart("correlateAndFindPThreaded");
+    int trials = 40;
+    Landscape* lPreserved = makeTestLandscape("testThreadsP");
+    Landscape* lPermuted = makeTestLandscape("testThreadsQ");
+    
+    StatisticalData* alone = correlateAndFindPThreaded(lPermuted, lPreserved, trials, 1, TEST_SEED, true);
+    StatisticalData* together = correlateAndFindPThreaded(lPermuted, lPreserved, trials, 3, TEST_SEED, true);
+    
+    if(fabs(alone->correlationOfInterest - mantelR(lPreserved, lPermuted, NULL)) > 0.0001)
+        return reportEnd(false, "disagrees with mantelR");
+    //Same seed means same permutations, however the trials are split
+    for(int t=0; t<trials; t++)
+        if(alone->listOfCorrelations->data[t] != together->listOfCorrelations->data[t])
+            return reportEnd(false, "depends on thread count");
+    if(alone->rankInfo->rank != together->rankInfo->rank) return reportEnd(false, "rank");
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Work stealing
+
+//One large field among many tiny ones
+Landscape* makeLopsidedLandscape(void);
+Landscape* makeLopsidedLandscape(void)
+{
+    Field* fields[13];
+    fields[0] = makeRandomField(5);
+    fields[1] = makeRandomField(300);
+    for(int f=2; f<13; f++) fields[f] = makeRandomField(4+f%3);
+    return makeLandscapeFromFields(13, fields);
+}
+
+bool testMakeFieldTasksFromLandscape(void)
+{
+    reportStart("makeFieldTasksFromLandscape");
+    Landscape* theData = makeLopsidedLandscape();
+    int numTasks;
+    FieldTask* theTasks = makeFieldTasksFromLandscape(theData, &numTasks);
+    
+    //Every row of every field lands in exactly one task, in order
+    int field = 0, row = 0;
+    long long heaviest = 0;
+    for(int t=0; t<numTasks; t++)
+    {
+        if(theTasks[t].firstField != field) return reportEnd(false, "field skipped or repeated");
+        if(theTasks[t].lastField-theTasks[t].firstField == 1)
+        {
+            if(theTasks[t].firstRow != row) return reportEnd(false, "rows skipped or repeated");
+            row = theTasks[t].lastRow;
+            if(row == theData->fields[field]->samples)
+            {
+                field++;
+                row = 0;
+            }
+        } else {
+            if(row != 0) return reportEnd(false, "group starts mid-field");
+            field = theTasks[t].lastField;
+        }
+        if(theTasks[t].weight > heaviest) heaviest = theTasks[t].weight;
+    }
+    if(field != theData->numFields) return reportEnd(false, "fields left over");
+    //The big field (field 1) is split, the small ones grouped around it
+    int smallTasks = 0;
+    for(int t=0; t<numTasks; t++) if(theTasks[t].firstField != 1) smallTasks++;
+    if(smallTasks > 2) return reportEnd(false, "small fields not grouped");
+    if(heaviest > STEAL_TASK_ELEMENTS+300) return reportEnd(false, "big field not split");
+    free(theTasks);
+    return reportEnd(true, NULL);
+}
+
+bool testCorrelateAndFindPStealing(void)
+{
+    reportStart("correlateAndFindPStealing");
+    int trials = 20;
+    Landscape* lPreserved = makeLopsidedLandscape();
+    Landscape* lPermuted = makeLopsidedLandscape();
+    
+    StatisticalData* alone = correlateAndFindPStealing(lPermuted, lPreserved, trials, 1, TEST_SEED);
+    StatisticalData* together = correlateAndFindPStealing(lPermuted, lPreserved, trials, 3, TEST_SEED);
+    StatisticalData* byTrial = correlateAndFindPThreaded(lPermuted, lPreserved, trials, 2, TEST_SEED, false);
+    
+    if(fabs(alone->correlationOfInterest - mantelR(lPreserved, lPermuted, NULL)) > 0.0001)
+        return reportEnd(false, "disagrees with mantelR");
+    for(int t=0; t<trials; t++)
+    {
+        //Reduction order is fixed, so thread count can't matter at all
+        if(alone->listOfCorrelations->data[t] != together->listOfCorrelations->data[t])
+            return reportEnd(false, "depends on thread count");
+        //Same permutations as splitting by trial, summed in a different order
+        if(fabs(alone->listOfCorrelations->data[t] - byTrial->listOfCorrelations->data[t]) > 0.0001)
+            return reportEnd(false, "disagrees with trial split");
+    }
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Pipeline
+
+bool testMakePermRing(void)
+{
+    reportStart("makePermRing");
+    PermRing* theRing = makePermRing(5, 2);
+    int* slot;
+    int trial;
+    
+    if(peekPermSlot(theRing, &trial) != NULL) return reportEnd(false, "new ring not empty");
+    //Go round a few times, keeping it part full
+    for(int t=0; t<9; t++)
+    {
+        slot = reservePermSlot(theRing);
+        if(slot == NULL) return reportEnd(false, "no room");
+        slot[0] = t;
+        slot[1] = -t;
+        publishPermSlot(theRing, t);
+        if(t%2)
+        {
+            slot = peekPermSlot(theRing, &trial);
+            if(slot == NULL || slot[0] != trial || slot[1] != -trial) return reportEnd(false, "contents");
+            releasePermSlot(theRing);
+        }
+    }
+    //Five left over: the ring must be full, with the oldest first
+    if(reservePermSlot(theRing) != NULL) return reportEnd(false, "overfilled");
+    slot = peekPermSlot(theRing, &trial);
+    if(trial != 4) return reportEnd(false, "order");
+    freePermRing(theRing);
+    return reportEnd(true, NULL);
+}
+
+bool testCorrelateAndFindPPipelined(void)
+{
+    reportStart("correlateAndFindPPipelined");
+    int trials = 30;
+    Landscape* lPreserved = makeTestLandscape("testPipeP");
+    Landscape* lPermuted = makeTestLandscape("testPipeQ");
+    
+    StatisticalData* piped = correlateAndFindPPipelined(lPermuted, lPreserved, trials, 3, 2, TEST_SEED);
+    StatisticalData* byTrial = correlateAndFindPThreaded(lPermuted, lPreserved, trials, 1, TEST_SEED, false);
+    
+    //Same permutations and kernel, just made elsewhere
+    for(int t=0; t<trials; t++)
+        if(piped->listOfCorrelations->data[t] != byTrial->listOfCorrelations->data[t])
+            return reportEnd(false, "disagrees with unpipelined run");
+    if(piped->correlationOfInterest != byTrial->correlationOfInterest) return reportEnd(false, "r");
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark One vs many
+
+bool testCorrelateOneVsManyAndFindP(void)
+{
+    reportStart("correlateOneVsManyAndFindP");
+    seedRandom(TEST_SEED);
+    int trials = 30;
+    Landscape* lPreserved = makeTestLandscape("testManyP");
+    Landscape* candidates[2];
+    candidates[0] = makeTestLandscape("testManyA");
+    candidates[1] = makeTestLandscape("testManyB");
+    
+    CandidateData* together = correlateOneVsManyAndFindP(lPreserved, 2, candidates, trials, TEST_SEED);
+    CandidateData* alone = correlateOneVsManyAndFindP(lPreserved, 1, candidates+1, trials, TEST_SEED);
+    
+    float expected;
+    for(int c=0; c<2; c++)
+    {
+        expected = mantelR(lPreserved, candidates[c], NULL);
+        if(fabs(together->correlation[c] - expected) > 0.0001)
+            return reportEnd(false, "disagrees with mantelR");
+        if(together->pValue[c] < 1.0/trials || together->pValue[c] > 1)
+            return reportEnd(false, "p out of range");
+    }
+    //Same seed means same permutations, whatever the batch holds
+    if(alone->correlation[0] != together->correlation[1]) return reportEnd(false, "batch r");
+    if(alone->pValue[0] != together->pValue[1]) return reportEnd(false, "batch p");
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Correlogram
+
+bool testCorrelogramAndFindP(void)
+{
+    reportStart("correlogramAndFindP");
+    int trials = 30;
+    int numClasses = 3;
+    //Zeros fall below every class
+    float bounds[4] = {1, 3, 6, 10};
+    Landscape* lPreserved = makeTestLandscape("testClassX");
+    Landscape* lPermuted = makeTestLandscape("testClassY");
+    
+    seedRandom(TEST_SEED);
+    CorrelogramData* theClasses = correlogramAndFindP(lPermuted, lPreserved, numClasses, 
+                                                      bounds, trials);
+    
+    //Each class should match a plain Mantel test against its own 0/1 landscape
+    Landscape* lClass = makeLandscapeFromLandscape(lPreserved);
+    for(int k=0; k<numClasses; k++)
+    {
+        long long comparisons = 0;
+        for(int f=0; f<lClass->numFields; f++)
+        {
+            Field* theField = lClass->fields[f];
+            for(int x=0; x<theField->samples; x++)
+            {
+                for(int y=0; y<theField->samples; y++)
+                {
+                    float distance = lPreserved->fields[f]->element[x][y];
+                    bool inClass = (x!=y && distance>=bounds[k] && distance<bounds[k+1]);
+                    theField->element[x][y] = inClass;
+                    comparisons += inClass;
+                }
+            }
+        }
+        lClass->isRaw = true;
+        lClass->isCentered = false;
+        if(comparisons != theClasses->comparisons[k]) return reportEnd(false, "class sizes");
+        
+        seedRandom(TEST_SEED);
+        StatisticalData* expected = correlateAndFindP(lPermuted, lClass, trials);
+        if(fabs(theClasses->correlation[k] - expected->correlationOfInterest) > 0.0001)
+            return reportEnd(false, "disagrees with correlateAndFindP");
+        int atLeast = 0;
+        for(int t=0; t<trials; t++)
+        {
+            if(fabsf(expected->listOfCorrelations->data[t]) >= fabsf(expected->correlationOfInterest)-0.00001)
+                atLeast++;
+        }
+        if(fabs(theClasses->pValue[k] - atLeast/(FLOATIFY*trials)) > 1.5/trials)
+            return reportEnd(false, "p value");
+        if(theClasses->corrected[k] < theClasses->pValue[k] || theClasses->corrected[k] > 1)
+            return reportEnd(false, "progressive Bonferroni");
+    }
+    if(theClasses->corrected[0] != theClasses->pValue[0]) return reportEnd(false, "first class corrected");
+    
+    freeCorrelogramData(theClasses);
+    freeLandscape(lClass);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Regression
+
+bool testRegressAndFindP(void)
+{
+    reportStart("regressAndFindP");
+    int trials = 30;
+    Landscape* lResponse = makeTestLandscape("testMRMY");
+    Landscape* predictors[2];
+    predictors[0] = makeTestLandscape("testMRMA");
+    predictors[1] = makeTestLandscape("testMRMB");
+    
+    //One predictor: R^2 is the squared Mantel r, trial for trial
+    seedRandom(TEST_SEED);
+    RegressionData* theFit = regressAndFindP(lResponse, 1, predictors, trials);
+    seedRandom(TEST_SEED);
+    StatisticalData* expected = correlateAndFindP(lResponse, predictors[0], trials);
+    float r = expected->correlationOfInterest;
+    if(fabs(theFit->rSquared - r*r) > 0.0001) return reportEnd(false, "R^2 isn't r^2");
+    int atLeast = 0;
+    for(int t=0; t<trials; t++)
+    {
+        float other = expected->listOfCorrelations->data[t];
+        if(other*other >= r*r-0.00001) atLeast++;
+    }
+    if(fabs(theFit->rSquaredP - atLeast/(FLOATIFY*trials)) > 1.5/trials)
+        return reportEnd(false, "R^2 p value");
+    freeRegressionData(theFit);
+    
+    //Two predictors: solve the normal equations directly, on centered data
+    modifyLandscapeMeanify(predictors[1]);
+    double xx[2][2] = {{0,0},{0,0}}, xy[2] = {0,0};
+    for(int f=0; f<lResponse->numFields; f++)
+    {
+        for(int i=0; i<lResponse->fields[f]->samples; i++)
+        {
+            for(int j=0; j<lResponse->fields[f]->samples; j++)
+            {
+                if(i==j) continue;
+                double y = lResponse->fields[f]->element[i][j];
+                double x[2] = {predictors[0]->fields[f]->element[i][j],
+                               predictors[1]->fields[f]->element[i][j]};
+                for(int p=0; p<2; p++)
+                {
+                    xy[p] += x[p]*y;
+                    for(int q=0; q<2; q++) xx[p][q] += x[p]*x[q];
+                }
+            }
+        }
+    }
+    double determinant = xx[0][0]*xx[1][1]-xx[0][1]*xx[1][0];
+    double beta[2] = {(xx[1][1]*xy[0]-xx[0][1]*xy[1])/determinant,
+                      (xx[0][0]*xy[1]-xx[1][0]*xy[0])/determinant};
+    theFit = regressAndFindP(lResponse, 2, predictors, trials);
+    for(int p=0; p<2; p++)
+    {
+        if(fabs(theFit->coefficient[p]-beta[p]) > 0.00001*(1+fabs(beta[p])))
+            return reportEnd(false, "coefficients");
+        if(theFit->pValue[p] <= 0 || theFit->pValue[p] > 1) return reportEnd(false, "p value range");
+    }
+    //Centered data: no intercept left
+    if(fabs(theFit->intercept) > 0.001) return reportEnd(false, "intercept");
+    if(theFit->rSquared < r*r-0.0001 || theFit->rSquared > 1) return reportEnd(false, "R^2 range");
+    freeRegressionData(theFit);
+    
+    //A predictor given twice is collinear, which is an error rather than a fit
+    Landscape* twice[2] = {predictors[0], predictors[0]};
+    if(regressAndFindP(lResponse, 2, twice, trials) != NULL) return reportEnd(false, "collinear");
+    
+    freeLandscape(lResponse);
+    freeLandscape(predictors[0]);
+    freeLandscape(predictors[1]);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Moments
+
+//Step to the next permutation in lexicographic order; FALSE after the last
+bool modifyPermNextInOrder(Perm* thePerm);
+bool modifyPermNextInOrder(Perm* thePerm)
+{
+    int* index = thePerm->index;
+    int i = thePerm->size-2;
+    while(i>=0 && index[i]>index[i+1]) i--;
+    if(i<0) return false;
+    int j = thePerm->size-1;
+    while(index[j]<index[i]) j--;
+    swapI(&index[i], &index[j]);
+    for(int l=i+1, r=thePerm->size-1; l<r; l++, r--) swapI(&index[l], &index[r]);
+    thePerm->isIdentity = false;
+    return true;
+}
+
+bool testCorrelateAndApproximateP(void)
+{
+    reportStart("correlateAndApproximateP");
+    seedRandom(TEST_SEED);
+    
+    //Small enough to try every relabeling of both fields
+    Field* xFields[2] = {makeRandomField(4), makeRandomField(6)};
+    Field* yFields[2] = {makeRandomField(4), makeRandomField(6)};
+    Landscape* lPreserved = makeLandscapeFromFields(2, xFields);
+    Landscape* lPermuted = makeLandscapeFromFields(2, yFields);
+    MomentData* theMoments = correlateAndApproximateP(lPermuted, lPreserved);
+    
+    Perm* first = lPermuted->fields[0]->perm;
+    Perm* second = lPermuted->fields[1]->perm;
+    double count = 0, total = 0, squares = 0, cubes = 0, r;
+    modifyPermPermutify(first, SEED_IDENTITY);
+    do {
+        modifyPermPermutify(second, SEED_IDENTITY);
+        do {
+            r = mantelR(lPreserved, lPermuted, NULL);
+            count++;
+            total += r;
+        } while(modifyPermNextInOrder(second));
+    } while(modifyPermNextInOrder(first));
+    double mean = total/count;
+    modifyPermPermutify(first, SEED_IDENTITY);
+    do {
+        modifyPermPermutify(second, SEED_IDENTITY);
+        do {
+            r = mantelR(lPreserved, lPermuted, NULL)-mean;
+            squares += r*r;
+            cubes += r*r*r;
+        } while(modifyPermNextInOrder(second));
+    } while(modifyPermNextInOrder(first));
+    double variance = squares/count;
+    double skewness = (cubes/count)/pow(variance, 1.5);
+    
+    if(count != 24*720) return reportEnd(false, "enumeration");
+    if(!(fabs(theMoments->mean - mean) <= 0.0001)) return reportEnd(false, "mean");
+    if(!(fabs(theMoments->variance - variance) <= 0.001*variance)) return reportEnd(false, "variance");
+    if(!(fabs(theMoments->skewness - skewness) <= 0.001)) return reportEnd(false, "skewness");
+    if(!theMoments->isSkewnessExact) return reportEnd(false, "small fields left out");
+    free(theMoments);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    
+    //Against the permutation path, on fields large enough for the approximation to hold
+    int trials = 4000;
+    for(int f=0; f<2; f++)
+    {
+        xFields[f] = makeRandomField(20+10*f);
+        yFields[f] = makeRandomField(20+10*f);
+        //A little shared structure, so the p value isn't always near 1/2
+        for(int i=0; i<xFields[f]->samples; i++)
+            for(int j=0; j<xFields[f]->samples; j++)
+                yFields[f]->element[i][j] += 0.15*xFields[f]->element[i][j];
+    }
+    lPreserved = makeLandscapeFromFields(2, xFields);
+    lPermuted = makeLandscapeFromFields(2, yFields);
+    theMoments = correlateAndApproximateP(lPermuted, lPreserved);
+    StatisticalData* theStats = correlateAndFindP(lPermuted, lPreserved, trials);
+    if(fabs(theMoments->correlationOfInterest - theStats->correlationOfInterest) > 0.0001)
+        return reportEnd(false, "correlation");
+    float expected = fractionAtLeast(theStats->listOfCorrelations, theStats->correlationOfInterest);
+    if(!(fabs(theMoments->pValue - expected) <= 0.02)) return reportEnd(false, "p value");
+    
+    free(theMoments);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Tail sampling
+bool testCorrelateAndEstimateTailP(void)
+{
+    reportStart("correlateAndEstimateTailP");
+    
+    //Strong shared structure, for a p value near 1e-5; the last field goes asymmetric
+    Field* xFields[3];
+    Field* yFields[3];
+    seedRandom(TEST_SEED);
+    for(int f=0; f<3; f++)
+    {
+        xFields[f] = makeRandomField(12/(f+1));
+        yFields[f] = makeRandomField(12/(f+1));
+        for(int i=0; i<yFields[f]->samples; i++)
+            for(int j=0; j<yFields[f]->samples; j++)
+                yFields[f]->element[i][j] += 0.6*xFields[f]->element[i][j];
+    }
+    yFields[2]->element[0][1] += 3;
+    xFields[2]->element[2][1] -= 3;
+    yFields[2]->isSymmetric = xFields[2]->isSymmetric = false;
+    Landscape* lPreserved = makeLandscapeFromFields(3, xFields);
+    Landscape* lPermuted = makeLandscapeFromFields(3, yFields);
+    
+    int trials = 2000000;
+    StatisticalData* theStats = correlateAndFindP(lPermuted, lPreserved, trials);
+    float expected = fractionAtLeast(theStats->listOfCorrelations, theStats->correlationOfInterest);
+    TailData* theTail = correlateAndEstimateTailP(lPermuted, lPreserved, 20000);
+    
+    if(fabs(theTail->correlationOfInterest - theStats->correlationOfInterest) > 0.0001)
+        return reportEnd(false, "correlation");
+    if(theTail->rungs<2) return reportEnd(false, "no tempering");
+    if(theTail->trials>20000) return reportEnd(false, "overspent");
+    //Both estimates are noisy; allow four of their combined standard errors
+    double spread = sqrt(theTail->standardError*theTail->standardError + expected/trials);
+    if(!(fabs(theTail->pValue - expected) <= 4*spread)) return reportEnd(false, "p value");
+    if(theTail->standardError > 0.3*theTail->pValue) return reportEnd(false, "standard error");
+    free(theTail);
+    
+    //Nothing shared: plain sampling, matching the permutation p value
+    for(int f=0; f<3; f++)
+        for(int i=0; i<yFields[f]->samples; i++)
+            for(int j=i+1; j<yFields[f]->samples; j++)
+                yFields[f]->element[i][j] = yFields[f]->element[j][i] = randInRange(0, 9);
+    yFields[2]->element[0][1] += 3;
+    theTail = correlateAndEstimateTailP(lPermuted, lPreserved, 20000);
+    theStats = correlateAndFindP(lPermuted, lPreserved, 20000);
+    expected = fractionAtLeast(theStats->listOfCorrelations, theStats->correlationOfInterest);
+    if(!(fabs(theTail->pValue - expected) <= 0.05)) return reportEnd(false, "null p value");
+    
+    free(theTail);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Bootstrap
+
+//Pearson correlation over every field's pairs of distinct samples, each counted by weight
+double weightedCorrelation(Landscape* lX, Landscape* lY, float** weight);
+double weightedCorrelation(Landscape* lX, Landscape* lY, float** weight)
+{
+    double pairs = 0, x = 0, y = 0, xx = 0, yy = 0, xy = 0;
+    for(int f=0; f<lX->numFields; f++)
+    {
+        for(int i=0; i<lX->fields[f]->samples; i++)
+        {
+            for(int j=0; j<lX->fields[f]->samples; j++)
+            {
+                if(i==j) continue;
+                double w = weight[f][i]*weight[f][j];
+                double u = lX->fields[f]->element[i][j], v = lY->fields[f]->element[i][j];
+                pairs += w;
+                x += w*u;
+                y += w*v;
+                xx += w*u*u;
+                yy += w*v*v;
+                xy += w*u*v;
+            }
+        }
+    }
+    return (xy-x*y/pairs)/sqrt((xx-x*x/pairs)*(yy-y*y/pairs));
+}
+
+bool testCorrelateAndBootstrapR(void)
+{
+    reportStart("correlateAndBootstrapR");
+    seedRandom(TEST_SEED);
+    Field* xFields[3];
+    Field* yFields[3];
+    for(int f=0; f<3; f++)
+    {
+        xFields[f] = makeRandomField(5+4*f);
+        yFields[f] = makeRandomField(5+4*f);
+        for(int i=0; i<xFields[f]->samples; i++)
+            for(int j=0; j<xFields[f]->samples; j++)
+                yFields[f]->element[i][j] += 0.5*xFields[f]->element[i][j];
+    }
+    //One asymmetric pair, to cover the full-matrix path
+    xFields[1]->element[0][2] += 4;
+    xFields[1]->isSymmetric = false;
+    Landscape* lPreserved = makeLandscapeFromFields(3, xFields);
+    Landscape* lPermuted = makeLandscapeFromFields(3, yFields);
+    
+    int replicates = 300;
+    unsigned int seed = 12345;
+    BootstrapData* theBootstrap = correlateAndBootstrapR(lPermuted, lPreserved, replicates, 1, seed);
+    BootstrapData* theThreaded = correlateAndBootstrapR(lPermuted, lPreserved, replicates, 3, seed);
+    for(int b=0; b<replicates; b++)
+        if(theBootstrap->listOfCorrelations->data[b] != theThreaded->listOfCorrelations->data[b])
+            return reportEnd(false, "thread count");
+    
+    //Redraw one replicate by hand: duplicated samples, their diagonal comparisons left out
+    float* weight[3];
+    RandomState theState;
+    seedRandomState(&theState, seed + 2654435761u*7);
+    for(int f=0; f<3; f++)
+    {
+        int n = xFields[f]->samples;
+        weight[f] = calloc(n, sizeof(float));
+        for(int i=0; i<n; i++) weight[f][randBelowWithState(&theState, n)]++;
+    }
+    double expected = weightedCorrelation(lPreserved, lPermuted, weight);
+    bool isFound = false;
+    for(int b=0; b<replicates; b++)
+        if(fabs(theBootstrap->listOfCorrelations->data[b] - expected) < 0.00001) isFound = true;
+    if(!isFound) return reportEnd(false, "replicate");
+    
+    //Jackknife by brute force, for the acceleration
+    int totalSamples = 0;
+    for(int f=0; f<3; f++)
+    {
+        for(int i=0; i<xFields[f]->samples; i++) weight[f][i] = 1;
+        totalSamples += xFields[f]->samples;
+    }
+    double jackknife[totalSamples], mean = 0, squares = 0, cubes = 0, d;
+    int k = 0;
+    for(int f=0; f<3; f++)
+    {
+        for(int i=0; i<xFields[f]->samples; i++)
+        {
+            weight[f][i] = 0;
+            jackknife[k] = weightedCorrelation(lPreserved, lPermuted, weight);
+            mean += jackknife[k++];
+            weight[f][i] = 1;
+        }
+    }
+    mean /= totalSamples;
+    for(k=0; k<totalSamples; k++)
+    {
+        d = mean-jackknife[k];
+        squares += d*d;
+        cubes += d*d*d;
+    }
+    if(fabs(theBootstrap->acceleration - cubes/(6*pow(squares, 1.5))) > 0.0001)
+        return reportEnd(false, "acceleration");
+    
+    if(!(theBootstrap->percentileLow < theBootstrap->correlationOfInterest
+         && theBootstrap->correlationOfInterest < theBootstrap->percentileHigh))
+        return reportEnd(false, "percentile interval");
+    if(!(theBootstrap->bcaLow < theBootstrap->bcaHigh)) return reportEnd(false, "BCa interval");
+    
+    for(int f=0; f<3; f++) free(weight[f]);
+    freeBootstrapData(theBootstrap);
+    freeBootstrapData(theThreaded);
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Permutation bank
+
+bool testCorrelateAndFindPFromBank(void)
+{
+    reportStart("correlateAndFindPFromBank");
+    Landscape* lPreserved = makeTestLandscape("testBankP");
+    Landscape* lPermuted = makeTestLandscape("testBankQ");
+    
+    //Sizes out of order, plus a spare; streams are found by size
+    int sizes[4] = {10, 7, 4, 7};
+    int trials = 300;
+    if(!savePermutationBank("testBank.perm", 4, sizes, trials, TEST_SEED))
+        return reportEnd(false, "save");
+    PermBank* theBank = openPermutationBank("testBank.perm");
+    if(theBank==NULL) return reportEnd(false, "open");
+    if(theBank->numStreams != 4 || theBank->trials != trials) return reportEnd(false, "header");
+    
+    int* streams = makeBankStreamsForLandscape(theBank, lPermuted);
+    if(streams==NULL || streams[0]!=2 || streams[1]!=1 || streams[2]!=0)
+        return reportEnd(false, "streams");
+    
+    //Every banked trial is a permutation, and the first is the identity
+    Perm* thePerm = makePerm(7, SEED_IDENTITY);
+    bool seen[7];
+    for(int t=0; t<trials; t++)
+    {
+        modifyPermFromBank(thePerm, theBank, 1, t);
+        for(int i=0; i<7; i++) seen[i] = false;
+        for(int i=0; i<7; i++)
+        {
+            if(thePerm->index[i]<0 || thePerm->index[i]>=7 || seen[thePerm->index[i]])
+                return reportEnd(false, "not a permutation");
+            seen[thePerm->index[i]] = true;
+            if(!t && thePerm->index[i]!=i) return reportEnd(false, "identity");
+        }
+    }
+    
+    //Same relabelings, so the same correlations, however the trials are split or mapped
+    free(thePerm->index);
+    free(thePerm);
+    StatisticalData* theStats = correlateAndFindPFromBank(lPermuted, lPreserved, trials, 1, theBank);
+    PermBank* theOther = openPermutationBank("testBank.perm");
+    StatisticalData* theThreaded = correlateAndFindPFromBank(lPermuted, lPreserved, trials, 3, theOther);
+    for(int t=0; t<trials; t++)
+    {
+        if(theStats->listOfCorrelations->data[t] != theThreaded->listOfCorrelations->data[t])
+            return reportEnd(false, "threads");
+    }
+    for(int f=0; f<3; f++) modifyPermPermutify(lPermuted->fields[f]->perm, SEED_IDENTITY);
+    if(theStats->correlationOfInterest != mantelR(lPreserved, lPermuted, NULL))
+        return reportEnd(false, "correlation of interest");
+    freeTestStats(theStats);
+    freeTestStats(theThreaded);
+    
+    //A bank lacking one of the field sizes can't be drawn from
+    if(!savePermutationBank("testBankShort.perm", 2, sizes+1, trials, TEST_SEED))
+        return reportEnd(false, "save short");
+    PermBank* theShort = openPermutationBank("testBankShort.perm");
+    if(theShort==NULL || makeBankStreamsForLandscape(theShort, lPermuted) != NULL)
+        return reportEnd(false, "missing size");
+    
+    //An index out of range anywhere in the file means a damaged bank
+    long position = theShort->streams[0].offset + 7*sizeof(uint16_t);
+    closePermutationBank(theShort);
+    uint16_t outside = 7;
+    FILE* theFile = fopen("testBankShort.perm", "r+b");
+    fseek(theFile, position, SEEK_SET);
+    fwrite(&outside, sizeof(outside), 1, theFile);
+    fclose(theFile);
+    if(openPermutationBank("testBankShort.perm") != NULL) return reportEnd(false, "out of range");
+    
+    //Fields past BANK_MAX_NARROW samples keep 32-bit indices
+    int wide = BANK_MAX_NARROW+1;
+    if(!savePermutationBank("testBankWide.perm", 1, &wide, 2, TEST_SEED))
+        return reportEnd(false, "save wide");
+    PermBank* theWide = openPermutationBank("testBankWide.perm");
+    if(theWide==NULL || theWide->streams[0].width != 4) return reportEnd(false, "wide");
+    Perm* theWidePerm = makePerm(wide, SEED_IDENTITY);
+    modifyPermFromBank(theWidePerm, theWide, 0, 1);
+    long long sum = 0;
+    for(int i=0; i<wide; i++) sum += theWidePerm->index[i];
+    if(sum != (long long)wide*(wide-1)/2 || theWidePerm->isIdentity) return reportEnd(false, "wide trial");
+    free(theWidePerm->index);
+    free(theWidePerm);
+    
+    //Anything else is turned away
+    theFile = fopen("testBankBad.perm", "w");
+    fprintf(theFile, "Not a permutation bank\n");
+    fclose(theFile);
+    if(openPermutationBank("testBankBad.perm") != NULL) return reportEnd(false, "damaged");
+    
+    free(streams);
+    closePermutationBank(theBank);
+    closePermutationBank(theOther);
+    closePermutationBank(theWide);
+    remove("testBank.perm");
+    remove("testBankShort.perm");
+    remove("testBankWide.perm");
+    remove("testBankBad.perm");
+    freeLandscape(lPreserved);
+    freeLandscape(lPermuted);
+    return reportEnd(true, NULL);
+}
+
+
+#pragma mark Batch
+
+bool testAcquireCachedLandscape(void)
+{
+    reportStart("acquireCachedLandscape");
+    char* names[2] = {"testCache0.tdv", "testCache1.tdv"};
+    saveFieldToTDV(names[0], makeRandomField(5));
+    saveFieldToTDV(names[1], makeRandomField(7));
+    
+    FieldCache* theCache = allocateFieldCache();
+    initializeFieldCache(theCache);
+    //Two jobs want the Pearson version, one the Spearman version
+    registerCachedLandscape(theCache, 2, names, false);
+    registerCachedLandscape(theCache, 2, names, false);
+    registerCachedLandscape(theCache, 2, names, true);
+    
+    Landscape* first = acquireCachedLandscape(theCache, 2, names, false);
+    Landscape* second = acquireCachedLandscape(theCache, 2, names, false);
+    Landscape* ranked = acquireCachedLandscape(theCache, 2, names, true);
+    if(first != second) return reportEnd(false, "loaded twice");
+    if(first == ranked) return reportEnd(false, "transforms mixed up");
+    if(!first->isCentered || !ranked->isCentered) return reportEnd(false, "not centered");
+    if(!ranked->isRankBased) return reportEnd(false, "not ranked");
+    if(first->numFields != 2 || first->fields[1]->samples != 7) return reportEnd(false, "wrong data");
+    
+    releaseCachedLandscape(theCache, 2, names, false);
+    releaseCachedLandscape(theCache, 2, names, true);
+    if(theCache->count != 4) return reportEnd(false, "wrong number of entries");
+    for(int i=0; i<theCache->count; i++)
+    {
+        //One Pearson use outstanding; raw fields and Spearman are done
+        if(!strncmp(theCache->entries[i]->key, "pearson", 7))
+        {
+            if(theCache->entries[i]->landscape == NULL) return reportEnd(false, "freed early");
+        }
+        else if(theCache->entries[i]->references != 0) return reportEnd(false, "leftover reference");
+    }
+    releaseCachedLandscape(theCache, 2, names, false);
+    if(theCache->entries[0]->landscape != NULL) return reportEnd(false, "not freed");
+    return reportEnd(true, NULL);
+}
+
+#pragma mark Benchmarks
+
+//The shuffle as it was before RandomState: rand() reduced with a modulo
+void permutifyWithRand(Perm* thePerm);
+void permutifyWithRand(Perm* thePerm)
+{
+    int j;
+    for(int i=thePerm->size-1; i>0; i--)
+    {
+        j = rand()%(i+1);
+        swapI(&(thePerm->index[i]), &(thePerm->index[j]));
+    }
+}
+
+void benchmarkPermutify(void)
+{
+    int sizes[5] = {8, 64, 1000, 20000, 1000000};
+    RandomState theState;
+    Perm* thePerm;
+    clock_t start;
+    double randTime, stateTime;
+    long shuffled = 50000000; //Elements shuffled per size and method
+    int reps;
+    
+    seedRandomState(&theState, TEST_SEED);
+    srand(TEST_SEED);
+    printf("Shuffling %ld elements per size\n", shuffled);
+    printf("%10s %14s %14s %8s\n", "size", "rand() ns/elt", "state ns/elt", "speedup");
+    for(int s=0; s<5; s++)
+    {
+        thePerm = makePerm(sizes[s], SEED_IDENTITY);
+        reps = (int)(shuffled/sizes[s]);
+        
+        start = clock();
+        for(int r=0; r<reps; r++) permutifyWithRand(thePerm);
+        randTime = (double)(clock()-start)/CLOCKS_PER_SEC;
+        
+        start = clock();
+        for(int r=0; r<reps; r++) modifyPermPermutifyWithState(thePerm, &theState);
+        stateTime = (double)(clock()-start)/CLOCKS_PER_SEC;
+        
+        printf("%10d %14.2f %14.2f %7.2fx\n", sizes[s],
+               1e9*randTime/((double)reps*sizes[s]),
+               1e9*stateTime/((double)reps*sizes[s]),
+               randTime/stateTime);
+        free(thePerm->index);
+        free(thePerm);
+    }
+}
@@ -27,6 +27,11 @@ bool reportFake(void);
  */
 bool testRandInRange(void);
 
+/**
+ * @brief Unbiased random number below a bound
+ */
+bool testRandBelowWithState(void);
+
 /**
  * @brief Check if inputs are in desired order
  */
@@ -124,6 +129,16 @@ bool testMakeFieldFromTDV(void);
  */
 bool  testSaveFieldToTDV(void);
 
+/**
+ * @brief Check whether a field's comparisons are the same in both directions
+ */
+bool testIsFieldSymmetric(void);
+
+/**
+ * @brief Build a Field of distances from sample coordinates
+ */
+bool testMakeFieldFromPoints(void);
+
 /**
  * @brief Save field data to file.
  */
@@ -149,6 +164,16 @@ bool testModifyFieldRankify(void);
  */
 bool testAugmentCAByFields(void);
 
+/**
+ * @brief Augment a correlation aggregate tile by tile
+ */
+bool testAugmentCAByTiledFields(void);
+
+/**
+ * @brief Move a field's comparisons into compact storage
+ */
+bool testModifyFieldCompactify(void);
+
 
 #pragma mark Landscapes
 
@@ -158,6 +183,13 @@ bool testModifyLandscapeMeanify(void);
 
 bool testModifyLandscapeRankify(void);
 
+#pragma mark Landscape cache
+
+/**
+ * @brief Load a centered (optionally ranked) landscape, going through a cache directory
+ */
+bool testMakeLandscapeFromCache(void);
+
 #pragma mark Field->List
 /**
  * @brief Flatten a 2D field to a 1D list
@@ -180,6 +212,26 @@ bool testCorrelateAndFindP(void);
 
 bool testCorrelatePartialAndFindP(void);
 
+/**
+ * @brief Partial Mantel test permuting residuals of the given landscape
+ */
+bool testCorrelateResidualsAndFindP(void);
+
+/**
+ * @brief Exact binomial interval on a fraction of trials
+ */
+bool testComputeClopperPearson(void);
+
+/**
+ * @brief Trials run in blocks until the p value's interval is narrow enough
+ */
+bool testCorrelateAndFindPToWidth(void);
+
+/**
+ * @brief Progress reports during a permutation test, and stopping at a deadline
+ */
+bool testCorrelateAndFindPWithProgress(void);
+
 /**
  * @brief Creates files containing data on Spearman and Person correlation of inputs
  */
@@ -192,5 +244,114 @@ bool testProcessFileTriples(void);
  */
 bool testSaveData(void);
 
+#pragma mark All pairs
+
+/**
+ * @brief Correlate every pair of landscapes against one shared stream of permutations
+ */
+bool testCorrelateAllPairsAndFindP(void);
+
+#pragma mark One vs many
+
+/**
+ * @brief Mantel test over landscapes streamed from disk
+ */
+bool testCorrelateStreamedAndFindP(void);
+
+/**
+ * @brief Mantel test recomputing the preserved distances from coordinates
+ */
+bool testCorrelatePointsAndFindP(void);
+
+/**
+ * @brief Read the machine's NUMA layout
+ */
+bool testMakeTopologyFromSystem(void);
+
+/**
+ * @brief Permutation test split across threads
+ */
+bool testCorrelateAndFindPThreaded(void);
+
+/**
+ * @brief Divide a landscape into balanced tasks
+ */
+bool testMakeFieldTasksFromLandscape(void);
+
+/**
+ * @brief Permutation test with each trial shared by work stealing
+ */
+bool testCorrelateAndFindPStealing(void);
+
+/**
+ * @brief Pass permutation sets through a ring
+ */
+bool testMakePermRing(void);
+
+/**
+ * @brief Permutation test with shuffling on separate threads
+ */
+bool testCorrelateAndFindPPipelined(void);
+
+/**
+ * @brief Correlate several candidates with one preserved landscape in a single pass per trial
+ */
+bool testCorrelateOneVsManyAndFindP(void);
+
+#pragma mark Correlogram
+
+/**
+ * @brief Correlate every distance class with the permuted landscape in one pass per trial
+ */
+bool testCorrelogramAndFindP(void);
+
+#pragma mark Regression
+
+/**
+ * @brief Regress a permuted landscape on fixed predictors
+ */
+bool testRegressAndFindP(void);
+
+#pragma mark Moments
+
+/**
+ * @brief Approximate the permutation p value from exact moments
+ */
+bool testCorrelateAndApproximateP(void);
+
+#pragma mark Tail sampling
+
+/**
+ * @brief Estimate a small p value by tempered sampling
+ */
+bool testCorrelateAndEstimateTailP(void);
+
+#pragma mark Bootstrap
+
+/**
+ * @brief Bootstrap intervals on r, the same for any thread count
+ */
+bool testCorrelateAndBootstrapR(void);
+
+#pragma mark Permutation bank
+
+/**
+ * @brief Banked permutations, and the same p value for any thread count
+ */
+bool testCorrelateAndFindPFromBank(void);
+
+#pragma mark Batch
+
+/**
+ * @brief Fetch a centered landscape, loading and preparing it on first use
+ */
+bool testAcquireCachedLandscape(void);
+
+#pragma mark Benchmarks
+
+/**
+ * @brief Time the rand()-based shuffle against modifyPermPermutifyWithState
+ */
+void benchmarkPermutify(void);
 
 #endif